@@ -40,10 +40,6 @@ project "eden"
 
     links
     {
-        "opengl32",
-        "user32",
-        "kernel32",
-		"shlwapi",
 		"bin/ch_stl",
 		"bin/lua"
     }
@@ -83,4 +79,22 @@ project "eden"
 			"src/win32/**.h",
 			"src/win32/**.cpp",
 			"src/win32/**.rc"
+		}
+
+		links
+		{
+			"opengl32",
+			"user32",
+			"kernel32",
+			"shlwapi"
+		}
+
+	filter "system:linux"
+		cppdialect "C++17"
+
+		links
+		{
+			"GL",
+			"X11",
+			"pthread"
 		}
\ No newline at end of file
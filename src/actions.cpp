@@ -2,14 +2,22 @@
 
 #include "buffer_view.h"
 #include "buffer.h"
+#include "editor.h"
+#include "draw.h"
+#include "prompt.h"
+#include "file_picker.h"
+#include "search.h"
 
 #include <ch_stl/string.h>
+#include <string.h>
 
 void newline() {
 	Buffer_View* const view = get_focused_view();
 	Buffer* const buffer = find_buffer(view->the_buffer);
 	assert(buffer);
 
+	if ((buffer->flags & BF_Windowed) == BF_Windowed) return;
+
 	view->remove_selection();
 
 	if (buffer->line_ending == LE_CRLF) {
@@ -33,6 +41,8 @@ void backspace() {
 	Buffer* const buffer = find_buffer(view->the_buffer);
 	assert(buffer);
 
+	if ((buffer->flags & BF_Windowed) == BF_Windowed) return;
+
 	if (view->has_selection()) {
 		view->remove_selection();
 		return;
@@ -106,11 +116,22 @@ void move_cursor_left(bool move_selection) {
 	view->reset_cursor_timer();
 }
 
+/** Centers the window of a windowed buffer on the cursor, so there are lines either side of it to move to. */
+static void page_window_to_cursor(Buffer_View* view, Buffer* buffer) {
+	const u64 cursor_offset = buffer->window_offset + view->cursor;
+	const u64 half_window = large_file_window_size / 2;
+	move_buffer_window(buffer, cursor_offset > half_window ? cursor_offset - half_window : 0);
+}
+
 void move_cursor_up(bool move_selection) {
 	Buffer_View* const view = get_focused_view();
 	Buffer* const buffer = find_buffer(view->the_buffer);
 	assert(buffer);
 
+	if ((buffer->flags & BF_Windowed) == BF_Windowed && view->current_line == 0 && buffer->window_offset > 0) {
+		page_window_to_cursor(view, buffer);
+	}
+
 	const u64 current_line = view->current_line;
 	if (current_line <= 0) return;
 
@@ -138,6 +159,11 @@ void move_cursor_down(bool move_selection) {
 	Buffer* const buffer = find_buffer(view->the_buffer);
 	assert(buffer);
 
+	if ((buffer->flags & BF_Windowed) == BF_Windowed && view->current_line + 1 >= buffer->eol_table.count &&
+		buffer->window_offset + buffer->gap_buffer.count() < buffer->file_size) {
+		page_window_to_cursor(view, buffer);
+	}
+
 	const u64 current_line = view->current_line;
 	const usize num_lines = buffer->eol_table.count;
 
@@ -209,15 +235,94 @@ void seek_cursor_right(bool move_selection) {
 	view->reset_cursor_timer();
 }
 
+static void on_goto_line_confirmed(const char* text) {
+	u64 line = 0;
+	for (const char* c = text; *c; c += 1) {
+		if (*c < '0' || *c > '9') return;
+		line = line * 10 + (u64)(*c - '0');
+	}
+	if (!line) return;
+
+	Buffer_View* const view = get_focused_view();
+	assert(view);
+	view->jump_to_line(line - 1);
+}
+
+void goto_line() {
+	begin_prompt("Go to line: ", on_goto_line_confirmed);
+}
+
+void toggle_follow() {
+	Buffer_View* const view = get_focused_view();
+	Buffer* const buffer = find_buffer(view->the_buffer);
+	assert(buffer);
+
+	// Windows of large files aren't watched, there's nothing to follow them with
+	if ((buffer->flags & BF_File) != BF_File || (buffer->flags & BF_Windowed) == BF_Windowed) return;
+
+	buffer->set_following(!buffer->is_following);
+	if (buffer->is_following) follow_buffer_end(view);
+}
+
+static void step_font_size(s32 delta) {
+	const s32 new_size = (s32)the_font.size + delta;
+	if (new_size < 2 || new_size > 128) return;
+
+	the_font.size = (u16)new_size;
+	the_font.pack_atlas();
+}
+
+void zoom_in() {
+	step_font_size(2);
+}
+
+void zoom_out() {
+	step_font_size(-2);
+}
+
 void save_buffer() {
 	Buffer_View* const view = get_focused_view();
 	Buffer* const buffer = find_buffer(view->the_buffer);
 	assert(buffer);
 
-	buffer->save_file_to_path();
+	// Writes on a worker, the powerline picks up how it went
+	buffer->start_save();
+}
+
+void find_file() {
+	open_file_picker();
+}
+
+void find_in_buffer() {
+	open_search();
+}
+
+void find_next() {
+	jump_to_next_match(true);
+}
+
+void find_previous() {
+	jump_to_next_match(false);
+}
+
+void clear_search() {
+	if (!is_search_active()) return;
+	end_search();
+}
+
+void next_buffer() {
+	Buffer_View* const view = get_focused_view();
+	assert(view);
+
+	const Buffer_ID next = get_next_buffer(view->the_buffer);
+	if (next != view->the_buffer) show_buffer(view, next);
 }
 
 #if CH_PLATFORM_WINDOWS
+#define OFN_ALLOWMULTISELECT 0x00000200
+#define OFN_EXPLORER 0x00080000
+#define OFN_FILEMUSTEXIST 0x00001000
+
 typedef UINT_PTR (__stdcall *LPOFNHOOKPROC) (HWND, UINT, WPARAM, LPARAM);
 struct OPENFILENAMEA {
 	DWORD        lStructSize;
@@ -283,6 +388,7 @@ void open_dialog() {
     open_file_name.lpstrInitialDir = current_path;
     
     open_file_name.lpstrTitle = "Open File";
+    open_file_name.Flags = OFN_ALLOWMULTISELECT | OFN_EXPLORER | OFN_FILEMUSTEXIST;
     open_file_name.lpstrDefExt = "";
     open_file_name.lCustData = 0;
     open_file_name.lpfnHook = nullptr;
@@ -292,23 +398,19 @@ void open_dialog() {
 		return;
 	}
     
-    u16 *filename16 = (u16*)open_file_name.lpstrFile;
-    u64 filename16_len = 0;
-    
-    for (auto p = filename16; *p; p += 1) filename16_len += 1;
-    
-    Buffer_View* const view = get_focused_view();
-    assert(view);
-    Buffer_ID id = create_buffer();
-    view->the_buffer = id;
-    Buffer* const buffer = find_buffer(id);
-    assert(buffer);
-
-	ch::Path path(open_file_name.lpstrFile);
-    
-	buffer->load_file_into_buffer(path);
+	// One file comes back as a full path. More come back as the directory followed by each name, all null separated
+	const char* const first = open_file_name.lpstrFile;
+	const usize first_len = strlen(first);
+	if (open_file_name.nFileOffset <= first_len) {
+		open_files(first);
+		return;
+	}
 
-    return;
+	for (const char* name = first + first_len + 1; *name; name += strlen(name) + 1) {
+		char path[1024];
+		ch::sprintf(path, "%s\\%s", first, name);
+		open_files(path);
+	}
 }
 #else
 
@@ -20,4 +20,33 @@ void seek_cursor_right(bool move_selection);
 
 void save_buffer();
 
-void open_dialog();
\ No newline at end of file
+/** Asks for a line number and jumps the current view to it. */
+void goto_line();
+
+/** Starts or stops following appends to the current file, like tail -f. Starting jumps to the end. */
+void toggle_follow();
+
+/** Opens any number of files. They load in the background and the first one ready is shown. */
+void open_dialog();
+
+/** Finds a file anywhere under the project root by fuzzy matching its path. */
+void find_file();
+
+/** Searches the current buffer as the query is typed, highlighting every match. Up and down step between them. */
+void find_in_buffer();
+
+/** Selects the next match of the last search after the cursor, or the one before it. */
+void find_next();
+
+void find_previous();
+
+/** Stops highlighting the matches of the last search. Does nothing if there isn't one. */
+void clear_search();
+
+/** Cycles the current view through the open buffers. */
+void next_buffer();
+
+/** Steps the font size. New sizes rasterize in the background and draw scaled from the old size meanwhile. */
+void zoom_in();
+
+void zoom_out();
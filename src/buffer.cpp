@@ -1,11 +1,19 @@
 #include "buffer.h"
+#include "os.h"
 
 #include "config.h"
+#include "editor.h"
+#include "encoding.h"
+#include "buffer_view.h"
+#include "journal.h"
+#include "line_index.h"
+#include "search.h"
 
 #include <ch_stl/hash_table.h>
 #include <vadefs.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
 
 u32 get_char_column_size(u32 c) {
 	if (c == '\t') return get_config().tab_width;
@@ -17,6 +25,10 @@ Buffer::Buffer(Buffer_ID _id) : id(_id) {
     line_column_table.allocator = ch::get_heap_allocator();
 	eol_table.allocator = ch::get_heap_allocator();
 	gap_buffer.allocator = ch::get_heap_allocator();
+	lexemes.allocator = ch::get_heap_allocator();
+	style_runs.allocator = ch::get_heap_allocator();
+	line_style_runs.allocator = ch::get_heap_allocator();
+	line_lex_states.allocator = ch::get_heap_allocator();
 
 	eol_table.push(0);
 	line_column_table.push(0);
@@ -24,7 +36,20 @@ Buffer::Buffer(Buffer_ID _id) : id(_id) {
 	name = ch::make_stack_string("*scratch*");
 }
 
+/** Buffers with files on disk, checked for outside changes whenever a watched directory changes. */
+static ch::Array<Buffer_ID> watched_buffers;
+
+/** Windowed buffers whose line index is still being built. Their line numbers are estimates until it's done. */
+static ch::Array<Buffer_ID> indexing_buffers;
+
 bool Buffer::load_file_into_buffer(const ch::Path& path) {
+	if (!read_file(path)) return false;
+
+	register_file();
+	return true;
+}
+
+bool Buffer::read_file(const ch::Path& path) {
 	if (gap_buffer) return false;
 
 	ch::File f;
@@ -32,12 +57,54 @@ bool Buffer::load_file_into_buffer(const ch::Path& path) {
 	defer(f.close());
 
 	const usize f_size = f.size();
+
+	// Too big to load at all. A window of it is read at a time and a line index is built in the background
+	const u64 large_file_threshold = (u64)get_config().large_file_threshold_mb * 1024 * 1024;
+	if (large_file_threshold && f_size >= large_file_threshold) {
+		f.get_absolute_path(&absolute_path);
+		const ch::String filename = absolute_path.get_filename(true);
+
+		if (name) name.free();
+		name = filename.copy(ch::get_heap_allocator());
+
+		flags |= BF_File | BF_ReadOnly | BF_Windowed;
+		file_size = f_size;
+		disable_parse = true;
+		get_file_stamp(absolute_path, &disk_stamp);
+
+		line_index = start_line_index(absolute_path, disk_stamp, the_window.os_handle);
+		if (!load_window(0)) return false;
+
+		version += 1;
+		saved_version = version;
+		return true;
+	}
+
 	gap_buffer.resize(f_size + ch::default_gap_size);
 
 	f.read(gap_buffer.data, f_size);
 	gap_buffer.gap = gap_buffer.data + f_size;
 	gap_buffer.gap_size = ch::default_gap_size;
 
+	usize bom_size = 0;
+	encoding = detect_encoding(gap_buffer.data, f_size, &bom_size);
+	has_bom = bom_size > 0;
+
+	// Anything that isn't utf8 is decoded into a new gap buffer, nothing past here has to know
+	usize content_size = f_size;
+	if (encoding != BE_UTF8) {
+		ch::Gap_Buffer<u8> decoded;
+		decoded.allocator = gap_buffer.allocator;
+		decoded.resize(get_decoded_size_bound(encoding, f_size - bom_size) + ch::default_gap_size);
+
+		content_size = decode_to_utf8(encoding, gap_buffer.data + bom_size, f_size - bom_size, decoded.data);
+		decoded.gap = decoded.data + content_size;
+		decoded.gap_size = decoded.allocated - content_size;
+
+		gap_buffer.free();
+		gap_buffer = decoded;
+	}
+
 	eol_table.count = 0;
 	line_column_table.count = 0;
 
@@ -71,7 +138,7 @@ bool Buffer::load_file_into_buffer(const ch::Path& path) {
 			col_count = 0;
 		}
 	}
-	eol_table.push((u32)f_size - last_eol);
+	eol_table.push((u32)content_size - last_eol);
 	line_column_table.push(col_count);
 
 	if (!num_nix && num_clrf) {
@@ -89,25 +156,635 @@ bool Buffer::load_file_into_buffer(const ch::Path& path) {
 		flags |= BF_ReadOnly;
 	}
 
+	version += 1;
+	saved_version = version;
+
+	get_file_stamp(absolute_path, &disk_stamp);
+
+	// Lexed here too so a file loaded on a worker comes back ready to draw
+	parsing::parse_cpp(this);
 
 	return true;
 }
 
-bool Buffer::save_file_to_path() {
-	if (!absolute_path) return false;
+void Buffer::register_file() {
+	if ((flags & BF_Windowed) == BF_Windowed) {
+		if (line_index) {
+			indexing_buffers.allocator = ch::get_heap_allocator();
+			indexing_buffers.push(id);
+		}
+		return;
+	}
 
-	ch::File f;
-	if (!f.open(absolute_path, ch::FO_Write | ch::FO_Binary)) return false;
+	if (watch_file(absolute_path)) {
+		watched_buffers.allocator = ch::get_heap_allocator();
+		watched_buffers.push(id);
+	}
+
+	// Pick up whatever we hadn't saved when we last went down
+	if ((flags & BF_ReadOnly) != BF_ReadOnly) {
+		journal = open_journal(absolute_path, disk_stamp);
+		replay_journal(journal, this);
+	}
+}
+
+/** @returns how many lines there are per byte in the loaded window, for estimating past what's been indexed. */
+static f64 get_window_lines_per_byte(const Buffer* buffer) {
+	const usize count = buffer->gap_buffer.count();
+	if (!count) return 0.0;
+	return (f64)(buffer->eol_table.count - 1) / (f64)count;
+}
+
+bool Buffer::load_window(u64 file_offset) {
+	const u64 last_start = file_size > large_file_window_size ? (file_size - large_file_window_size) / line_index_block_size * line_index_block_size : 0;
+	u64 start = file_offset / line_index_block_size * line_index_block_size;
+	if (start > last_start) start = last_start;
+	if (gap_buffer && start / line_index_block_size == window_block) return false;
+
+	// The last window runs to the end of the file so there's never a short one left over
+	const u64 end = start == last_start ? file_size : start + large_file_window_size;
+
+	// One byte early to see if start is already on a line boundary
+	const u64 read_start = start ? start - 1 : 0;
+	const usize read_size = (usize)(end - read_start);
+	if (gap_buffer.allocated < read_size + ch::default_gap_size) {
+		gap_buffer.free();
+		gap_buffer.resize(read_size + ch::default_gap_size);
+	}
+
+	u8* const data = gap_buffer.data;
+	const usize num_read = read_file_at(absolute_path, read_start, data, read_size);
+	if (!num_read) return false;
+
+	// Only whole lines, unless one is too long to fit in the window at all
+	usize first = 0;
+	if (start) {
+		const u8* const newline = (const u8*)memchr(data, '\n', num_read);
+		first = newline ? (usize)(newline - data) + 1 : 1;
+	}
+	usize last = num_read;
+	if (read_start + num_read < file_size) {
+		for (usize i = num_read; i > first; i -= 1) {
+			if (data[i - 1] == '\n') {
+				last = i;
+				break;
+			}
+		}
+	}
+	if (first >= last) {
+		first = start ? 1 : 0;
+		last = num_read;
+	}
+
+	const usize size = last - first;
+	memmove(data, data + first, size);
+	gap_buffer.gap = data + size;
+	gap_buffer.gap_size = gap_buffer.allocated - size;
+
+	window_block = start / line_index_block_size;
+	window_offset = read_start + first;
+
+	refresh_line_tables();
+	refresh_window_line();
+
+	return true;
+}
+
+void Buffer::refresh_window_line() {
+	if (!window_offset) {
+		window_first_line = 0;
+		window_line_is_exact = true;
+		return;
+	}
+
+	// The first line starts just past the first '\n' in its block, or the block itself started a line
+	const u64 block_start = window_block * line_index_block_size;
+	const u64 lines_in_block = window_offset > block_start ? 1 : 0;
+	const f64 lines_per_byte = get_window_lines_per_byte(this);
+
+	bool exact = false;
+	u64 lines_before = (u64)((f64)block_start * lines_per_byte);
+	if (line_index) lines_before = get_lines_before_block(line_index, window_block, lines_per_byte, &exact);
+
+	window_first_line = lines_before + lines_in_block;
+	window_line_is_exact = exact;
+}
+
+u64 Buffer::get_file_line_count(bool* out_exact) const {
+	if ((flags & BF_Windowed) != BF_Windowed) {
+		*out_exact = true;
+		return eol_table.count;
+	}
+
+	const f64 lines_per_byte = get_window_lines_per_byte(this);
+	if (line_index) return get_total_lines(line_index, lines_per_byte, out_exact);
+
+	*out_exact = false;
+	return (u64)((f64)file_size * lines_per_byte) + 1;
+}
+
+/**
+ * A save handed off to a worker. The worker only reads spans and path and writes copied, succeeded and stamp,
+ * everything else belongs to the main thread.
+ */
+struct Buffer_Save {
+	Buffer_ID buffer_id;
+	u64 version;
+	ch::Path path;
+	Buffer_Encoding encoding;
+	bool has_bom;
+	Write_Span spans[2];
+
+	/** Set once the worker has its own copy of spans, the buffer's memory is free to change after that. */
+	volatile s32 copied;
+	Semaphore copy_done;
+
+	/** Set by start_save while this one is still running. */
+	bool save_again;
+
+	bool succeeded;
+	File_Stamp stamp;
+	volatile s32 done;
+
+	Buffer_Save* next;
+};
+
+/** Saves that haven't been picked up by tick_buffers yet. Only touched on the main thread. */
+static Buffer_Save* pending_saves = nullptr;
+
+/** Writes the utf8 in spans to path, encoding it on the way if the file isn't utf8. */
+static bool write_encoded_file(const char* path, const Write_Span* spans, u32 num_spans, Buffer_Encoding encoding, bool has_bom) {
+	if (encoding == BE_UTF8) return write_file_atomic(path, spans, num_spans);
+
+	usize size = 0;
+	for (u32 i = 0; i < num_spans; i += 1) {
+		size += spans[i].size;
+	}
+
+	u8* const encoded = ch_new u8[get_encoded_size_bound(encoding, size)];
+	defer(ch_delete[] encoded);
+
+	// The state carries a codepoint that straddles the gap over to the next span
+	Utf8_Encode_State state;
+	usize encoded_size = 0;
+	for (u32 i = 0; i < num_spans; i += 1) {
+		encoded_size += encode_from_utf8(encoding, (const u8*)spans[i].data, spans[i].size, encoded + encoded_size, &state);
+	}
+
+	const Write_Span out_spans[] = {
+		has_bom ? get_bom(encoding) : Write_Span{ nullptr, 0 },
+		{ encoded, encoded_size },
+	};
+	return write_file_atomic(path, out_spans, 2);
+}
+
+static void write_buffer_save(void* data) {
+	Buffer_Save* const save = (Buffer_Save*)data;
+
+	// Copied before anything slow, so the buffer can be edited again as soon as possible
+	const usize size = save->spans[0].size + save->spans[1].size;
+	u8* const contents = ch_new u8[size ? size : 1];
+	defer(ch_delete[] contents);
+	memcpy(contents, save->spans[0].data, save->spans[0].size);
+	memcpy(contents + save->spans[0].size, save->spans[1].data, save->spans[1].size);
+
+	atomic_store(&save->copied, 1);
+	save->copy_done.signal();
+
+	const Write_Span spans[] = { { contents, size } };
+	save->succeeded = write_encoded_file(save->path, spans, 1, save->encoding, save->has_bom);
+	// Stamp it here rather than on the main thread, so our own write is never taken for someone else's
+	if (save->succeeded) get_file_stamp(save->path, &save->stamp);
+
+	atomic_store(&save->done, 1);
+	post_wake_event(the_window.os_handle);
+}
+
+bool Buffer::start_save() {
+	if (!absolute_path) return false;
 
 	if ((flags & BF_ReadOnly) == BF_ReadOnly) return false;
 
-	// Move gap to the end
-	gap_buffer.move_gap_to_index(gap_buffer.count());
+	if (pending_save) {
+		pending_save->save_again = true;
+		return true;
+	}
+
+	Buffer_Save* const save = ch_new Buffer_Save;
+	save->buffer_id = id;
+	save->version = version;
+	save->path = absolute_path;
+	save->encoding = encoding;
+	save->has_bom = has_bom;
+	save->copied = 0;
+	save->save_again = false;
+	save->succeeded = false;
+	save->done = 0;
+	save->next = pending_saves;
+
+	// No copy here. The worker copies the gap buffer's memory itself and prepare_for_edit only waits if we edit before it has
+	const u8* const gap_end = gap_buffer.gap + gap_buffer.gap_size;
+	save->spans[0] = { gap_buffer.data, (usize)(gap_buffer.gap - gap_buffer.data) };
+	save->spans[1] = { gap_end, (usize)(gap_buffer.data + gap_buffer.allocated - gap_end) };
+
+	if (journal) journal_save_started(journal, version);
+
+	pending_save = save;
+	save_status = SS_Saving;
+	pending_saves = save;
+	push_job(write_buffer_save, save);
+
+	return true;
+}
+
+void Buffer::record_edit(usize offset, usize removed, const u8* inserted, usize inserted_size) {
+	if (journal) journal_edit(journal, offset, removed, inserted, inserted_size);
+	on_search_buffer_edited(id, offset, removed, inserted_size);
+}
+
+void Buffer::prepare_for_edit() {
+	if (save_status == SS_Saved) save_status = SS_None;
+
+	// Only an edit that comes in before the worker has taken its copy has to wait for it
+	if (pending_save && !atomic_load(&pending_save->copied)) pending_save->copy_done.wait();
+}
+
+static void finish_buffer_loads();
+
+/** Reloads the buffer if the file was changed by someone else, or flags it if that would lose edits. */
+static void check_file_stamp(Buffer* buffer) {
+	File_Stamp stamp;
+	if (!get_file_stamp(buffer->absolute_path, &stamp) || stamp == buffer->disk_stamp) return;
+
+	// Never throw away edits. Just let the user know and leave it to them
+	if (buffer->is_dirty) {
+		buffer->save_status = SS_Changed_On_Disk;
+		return;
+	}
+
+	buffer->reload_changed_file();
+}
+
+void tick_buffers() {
+	finish_buffer_loads();
+
+	Buffer_Save** link = &pending_saves;
+	while (*link) {
+		Buffer_Save* const save = *link;
+		if (!atomic_load(&save->done)) {
+			link = &save->next;
+			continue;
+		}
+		*link = save->next;
+		defer(ch_delete save);
+
+		// The buffer may have been closed while this was writing
+		Buffer* const buffer = find_buffer(save->buffer_id);
+		if (!buffer || buffer->pending_save != save) continue;
+
+		buffer->pending_save = nullptr;
+		if (save->succeeded) {
+			buffer->saved_version = save->version;
+			buffer->disk_stamp = save->stamp;
+			if (buffer->journal) {
+				// Edits made while it was writing still need the journal, just on top of the new file
+				if (buffer->version == save->version) {
+					reset_journal(buffer->journal, save->stamp);
+				} else {
+					journal_save_finished(buffer->journal, save->version, save->stamp);
+				}
+			}
+			buffer->is_dirty = buffer->version != buffer->saved_version;
+			buffer->save_status = SS_Saved;
+		} else {
+			buffer->save_status = SS_Failed;
+		}
+
+		// The change notification was consumed while this was writing, so it's on us to look again
+		if (buffer->missed_file_change) {
+			buffer->missed_file_change = false;
+			check_file_stamp(buffer);
+		}
+
+		if (save->save_again) buffer->start_save();
+	}
+
+	if (consume_file_changes()) {
+		for (usize i = 0; i < watched_buffers.count; i += 1) {
+			Buffer* const buffer = find_buffer(watched_buffers[i]);
+			if (!buffer) continue;
 
-	f.seek_top();
-	f.write_raw(gap_buffer.data, gap_buffer.count());
-	f.set_end_of_file();
-	f.close();
+			// Our own save is going to change the stamp, let it finish first
+			if (buffer->pending_save) {
+				buffer->missed_file_change = true;
+				continue;
+			}
+
+			check_file_stamp(buffer);
+		}
+	}
+
+	for (usize i = 0; i < indexing_buffers.count; i += 1) {
+		Buffer* const buffer = find_buffer(indexing_buffers[i]);
+		assert(buffer);
+
+		// Bumping the version redraws the gutter and powerline with the better numbers
+		const u64 old_first_line = buffer->window_first_line;
+		buffer->refresh_window_line();
+
+		const bool is_done = is_line_index_done(buffer->line_index);
+		if (is_done || buffer->window_first_line != old_first_line) buffer->version += 1;
+		if (is_done) {
+			indexing_buffers.remove(i);
+			i -= 1;
+		}
+	}
+}
+
+/** @returns how many bytes at the start of the old contents and new_data match. */
+static usize find_common_prefix(const Write_Span* old_spans, const u8* new_data, usize new_size) {
+	usize result = 0;
+	for (u32 i = 0; i < 2; i += 1) {
+		const u8* const old_data = (const u8*)old_spans[i].data;
+		const usize size = old_spans[i].size < new_size - result ? old_spans[i].size : new_size - result;
+
+		// Whole blocks first, then find the byte that differs
+		usize j = 0;
+		while (j + 4096 <= size && memcmp(old_data + j, new_data + result + j, 4096) == 0) j += 4096;
+		while (j < size && old_data[j] == new_data[result + j]) j += 1;
+
+		result += j;
+		if (j < old_spans[i].size) break;
+	}
+	return result;
+}
+
+/** @returns how many bytes at the end of the old contents and new_data match, up to max_size. */
+static usize find_common_suffix(const Write_Span* old_spans, const u8* new_data, usize new_size, usize max_size) {
+	usize result = 0;
+	for (u32 i = 2; i > 0; i -= 1) {
+		const Write_Span& span = old_spans[i - 1];
+		const u8* const old_end = (const u8*)span.data + span.size;
+		const u8* const new_end = new_data + new_size - result;
+		const usize size = span.size < max_size - result ? span.size : max_size - result;
+
+		usize j = 0;
+		while (j + 4096 <= size && memcmp(old_end - j - 4096, new_end - j - 4096, 4096) == 0) j += 4096;
+		while (j < size && *(old_end - j - 1) == *(new_end - j - 1)) j += 1;
+
+		result += j;
+		if (j < span.size) break;
+	}
+	return result;
+}
+
+/** Measures lines the same way refresh_line_tables does. If ends_buffer the last line has no eol and is added too. */
+static void measure_lines(const u8* data, usize size, bool ends_buffer, ch::Array<u32>* eol_sizes, ch::Array<u32>* col_counts) {
+	u32 decoder_state = ch::utf8_accept;
+	u32 codepoint = 0;
+
+	usize line_start = 0;
+	u32 col_count = 0;
+	for (usize i = 0; i < size; i += 1) {
+		ch::utf8_decode(&decoder_state, &codepoint, data[i]);
+		if (decoder_state == ch::utf8_reject) {
+			decoder_state = ch::utf8_accept;
+			codepoint = '?';
+		} else if (decoder_state != ch::utf8_accept) {
+			continue;
+		}
+
+		const u32 c = codepoint;
+		col_count += get_char_column_size(c);
+
+		if (c == '\r' || c == '\n') {
+			if (c == '\r' && i + 1 < size && data[i + 1] == '\n') {
+				i += 1;
+				col_count += get_char_column_size('\n');
+			}
+
+			eol_sizes->push((u32)(i + 1 - line_start));
+			line_start = i + 1;
+
+			col_counts->push(col_count);
+			col_count = 0;
+		}
+	}
+
+	if (ends_buffer) {
+		eol_sizes->push((u32)(size - line_start));
+		col_counts->push(col_count);
+	}
+}
+
+/** Replaces table[first, first + old_count) with lines. */
+static void splice_line_table(ch::Array<u32>& table, usize first, usize old_count, const ch::Array<u32>& lines) {
+	const usize new_count = lines.count;
+	if (new_count > old_count) {
+		const usize grow = new_count - old_count;
+		for (usize i = 0; i < grow; i += 1) {
+			table.push(0);
+		}
+		for (usize i = table.count - 1; i >= first + new_count; i -= 1) {
+			table[i] = table[i - grow];
+		}
+	} else {
+		const usize shrink = old_count - new_count;
+		for (usize i = first + new_count; i + shrink < table.count; i += 1) {
+			table[i] = table[i + shrink];
+		}
+		table.count -= shrink;
+	}
+
+	for (usize i = 0; i < new_count; i += 1) {
+		table[first + i] = lines[i];
+	}
+}
+
+/** How much of the old end of the file is read back to check that it really was only appended to. */
+const usize append_check_size = 64;
+
+bool Buffer::read_appended_bytes(const File_Stamp& stamp) {
+	// Only utf8 is on disk exactly as it is in the buffer
+	if (encoding != BE_UTF8 || is_dirty) return false;
+
+	const usize old_count = gap_buffer.count();
+	if (old_count != disk_stamp.size || stamp.size <= disk_stamp.size) return false;
+
+	const usize check_size = old_count < append_check_size ? old_count : append_check_size;
+	const usize read_size = check_size + (usize)(stamp.size - disk_stamp.size);
+	u8* const data = ch_new u8[read_size];
+	defer(ch_delete[] data);
+
+	// It may still be growing, whatever made it in by now is taken and the rest picked up next time
+	const usize num_read = read_file_at(absolute_path, old_count - check_size, data, read_size);
+	if (num_read <= check_size) return false;
+
+	for (usize i = 0; i < check_size; i += 1) {
+		if (data[i] != gap_buffer[old_count - check_size + i]) return false;
+	}
+
+	const u8* const appended = data + check_size;
+	const usize appended_size = num_read - check_size;
+
+	prepare_for_edit();
+	for (usize i = 0; i < appended_size; i += 1) {
+		gap_buffer.push(appended[i]);
+	}
+
+	// A crlf split across two appends. The '\n' belongs to the line the '\r' already ended
+	const usize first_line = eol_table.count - 1;
+	usize line_start = old_count - eol_table[first_line];
+	usize first_changed_line = first_line;
+	usize first_changed_start = line_start;
+	if (old_count && gap_buffer[old_count - 1] == '\r' && appended[0] == '\n' && first_line > 0) {
+		first_changed_line = first_line - 1;
+		first_changed_start = line_start - eol_table[first_line - 1];
+		eol_table[first_line - 1] += 1;
+		line_column_table[first_line - 1] += get_char_column_size('\n');
+		line_start += 1;
+	}
+
+	// Everything from the start of the last line is measured again, the append finishes it off. It's all before the gap now
+	eol_table.count = first_line;
+	line_column_table.count = first_line;
+	measure_lines(gap_buffer.data + line_start, gap_buffer.count() - line_start, true, &eol_table, &line_column_table);
+
+	version += 1;
+	saved_version = version;
+	mark_syntax_dirty_from(first_changed_line, first_changed_start);
+	disk_stamp.modified = stamp.modified;
+	disk_stamp.size = old_count + appended_size;
+	if (journal) reset_journal(journal, disk_stamp);
+
+	on_buffer_appended(id, old_count, first_line);
+	on_search_buffer_edited(id, old_count, 0, appended_size);
+
+	return true;
+}
+
+void Buffer::set_following(bool follow) {
+	if (is_following == follow) return;
+	is_following = follow;
+	version += 1;
+}
+
+void Buffer::mark_syntax_dirty_from(u64 line, u64 index) {
+	// Dirtied some other way since the last parse, it has to start over from the top anyway
+	if (syntax_dirty && syntax_resume_version != version - 1) return;
+
+	if (!syntax_dirty || line < syntax_resume_line) {
+		syntax_resume_line = line;
+		syntax_resume_index = index;
+	}
+	syntax_resume_version = version;
+	syntax_dirty = true;
+}
+
+bool Buffer::reload_changed_file() {
+	File_Stamp stamp;
+	if (!get_file_stamp(absolute_path, &stamp)) return false;
+
+	if (read_appended_bytes(stamp)) return true;
+
+	// map_file refuses empty files, which just means there's nothing left
+	Mapped_File file;
+	if (!map_file(absolute_path, &file) && stamp.size) return false;
+	defer(unmap_file(&file));
+
+	const u8* new_data = file.data;
+	usize new_size = file.size;
+
+	// Decode with what the buffer was loaded as, a regenerated file keeps its encoding
+	u8* decoded = nullptr;
+	defer(ch_delete[] decoded);
+	if (encoding != BE_UTF8) {
+		const Write_Span bom = get_bom(encoding);
+		if (has_bom && new_size >= bom.size && memcmp(new_data, bom.data, bom.size) == 0) {
+			new_data += bom.size;
+			new_size -= bom.size;
+		}
+
+		decoded = ch_new u8[get_decoded_size_bound(encoding, new_size)];
+		new_size = decode_to_utf8(encoding, new_data, new_size, decoded);
+		new_data = decoded;
+	}
+
+	const u8* const gap_end = gap_buffer.gap + gap_buffer.gap_size;
+	const Write_Span old_spans[] = {
+		{ gap_buffer.data, (usize)(gap_buffer.gap - gap_buffer.data) },
+		{ gap_end, (usize)(gap_buffer.data + gap_buffer.allocated - gap_end) },
+	};
+	const usize old_size = gap_buffer.count();
+
+	usize prefix = find_common_prefix(old_spans, new_data, new_size);
+	if (prefix == old_size && prefix == new_size) {
+		disk_stamp = stamp;
+		return true;
+	}
+
+	// Only whole lines are replaced so the line tables either side of the change stay valid. 
+	// Both ends are moved to just after an eol that sits in the matching part, so it's an eol in both
+	while (prefix > 0 && new_data[prefix - 1] != '\n') prefix -= 1;
+
+	const usize max_common = old_size < new_size ? old_size : new_size;
+	usize suffix_start = new_size - find_common_suffix(old_spans, new_data, new_size, max_common - prefix);
+	while (suffix_start < new_size && new_data[suffix_start] != '\n') suffix_start += 1;
+	const usize suffix = suffix_start < new_size ? new_size - suffix_start - 1 : 0;
+
+	const usize old_end = old_size - suffix;
+	const usize new_end = new_size - suffix;
+
+	const u64 first_line = get_line_from_index(prefix);
+	const u64 end_line = suffix ? get_line_from_index(old_end) : eol_table.count;
+
+	ch::Array<u32> new_eol_sizes;
+	ch::Array<u32> new_col_counts;
+	new_eol_sizes.allocator = ch::get_heap_allocator();
+	new_col_counts.allocator = ch::get_heap_allocator();
+	defer(new_eol_sizes.free());
+	defer(new_col_counts.free());
+	measure_lines(new_data + prefix, new_end - prefix, suffix == 0, &new_eol_sizes, &new_col_counts);
+
+	prepare_for_edit();
+	for (usize i = prefix; i < old_end; i += 1) {
+		gap_buffer.remove_at_index(prefix);
+	}
+	for (usize i = prefix; i < new_end; i += 1) {
+		gap_buffer.insert(new_data[i], i);
+	}
+
+	splice_line_table(eol_table, first_line, end_line - first_line, new_eol_sizes);
+	splice_line_table(line_column_table, first_line, end_line - first_line, new_col_counts);
+
+	version += 1;
+	saved_version = version;
+	mark_syntax_dirty_from(first_line, prefix);
+	is_dirty = false;
+	disk_stamp = stamp;
+	if (save_status == SS_Changed_On_Disk) save_status = SS_None;
+	if (journal) reset_journal(journal, stamp);
+
+	on_buffer_region_replaced(id, prefix, old_end, new_end);
+	on_search_buffer_edited(id, prefix, old_end - prefix, new_end - prefix);
+
+	return true;
+}
+
+bool Buffer::save_file_to_path() {
+	if (!absolute_path) return false;
+
+	if ((flags & BF_ReadOnly) == BF_ReadOnly) return false;
+
+	// Write either side of the gap where they are, moving the gap would memmove everything after the cursor
+	const u8* const gap_end = gap_buffer.gap + gap_buffer.gap_size;
+	const Write_Span spans[] = {
+		{ gap_buffer.data, (usize)(gap_buffer.gap - gap_buffer.data) },
+		{ gap_end, (usize)(gap_buffer.data + gap_buffer.allocated - gap_end) },
+	};
+	if (!write_encoded_file(absolute_path, spans, 2, encoding, has_bom)) return false;
+	get_file_stamp(absolute_path, &disk_stamp);
+	if (journal) reset_journal(journal, disk_stamp);
 
 	is_dirty = false;
 
@@ -115,34 +792,80 @@ bool Buffer::save_file_to_path() {
 }
 
 void Buffer::empty() {
+	prepare_for_edit();
+	record_edit(0, gap_buffer.count(), nullptr, 0);
     gap_buffer.gap = gap_buffer.data;
     gap_buffer.gap_size = gap_buffer.allocated;
     eol_table.count = 0;
     line_column_table.count = 0;
     syntax_dirty = true;
+    version += 1;
     lexemes.count = 0;
+    style_runs.count = 0;
+    line_style_runs.count = 0;
+    line_lex_states.count = 0;
 }
 
 void Buffer::free() {
+	if ((flags & BF_Windowed) == BF_Windowed) {
+		for (usize i = 0; i < indexing_buffers.count; i += 1) {
+			if (indexing_buffers[i] != id) continue;
+
+			indexing_buffers.remove(i);
+			break;
+		}
+
+		if (line_index) release_line_index(line_index);
+		line_index = nullptr;
+	}
+
+	if ((flags & BF_File) == BF_File) {
+		for (usize i = 0; i < watched_buffers.count; i += 1) {
+			if (watched_buffers[i] != id) continue;
+
+			unwatch_file(absolute_path);
+			watched_buffers.remove(i);
+			break;
+		}
+	}
+
+	// Unsaved edits keep their journal so they can still be recovered, a clean buffer's is deleted
+	if (journal) close_journal(journal, is_dirty);
+	journal = nullptr;
+
+	// A running save may still be copying out of this memory
+	prepare_for_edit();
 	gap_buffer.free();
+	pending_save = nullptr;
+
 	eol_table.free();
 	line_column_table.free();
 	lexemes.free();
+	style_runs.free();
+	line_style_runs.free();
+	line_lex_states.free();
 }
 
 void Buffer::add_char(u32 c, usize index) {
+	prepare_for_edit();
 	gap_buffer.insert(c, index);
 
+	const u8 byte = (u8)c;
+	record_edit(index, 0, &byte, 1);
+
 	refresh_line_tables();
 }
 
 void Buffer::remove_char(usize index) {
+	prepare_for_edit();
+
 	const u32 c = gap_buffer[index];
 
 	const usize next = find_next_char(index);
 	for (u8 i = 0; i < (u8)(next - index); i += 1) {
 		gap_buffer.remove_at_index(index);	
 	}
+	record_edit(index, next - index, nullptr, 0);
 
 	refresh_line_tables();
 }
@@ -155,6 +878,8 @@ void Buffer::print_to(const char* fmt, ...) {
 	const usize size = vsprintf(write_buffer, fmt, args);
 	va_end(args);
 
+	prepare_for_edit();
+	record_edit(gap_buffer.count(), 0, (const u8*)write_buffer, size);
 	for (usize i = 0; i < size; i += 1) {
 		gap_buffer.push(write_buffer[i]);
 	}
@@ -163,6 +888,10 @@ void Buffer::print_to(const char* fmt, ...) {
 }
 
 void Buffer::refresh_line_tables() {
+	// Every edit comes through here, so any cached highlighting is now stale.
+	syntax_dirty = true;
+	version += 1;
+
 	eol_table.count = 0;
 	line_column_table.count = 0;
 
@@ -193,7 +922,7 @@ void Buffer::refresh_line_tables() {
 	line_column_table.push(col_count);
 }
 
-usize Buffer::find_next_char(usize index) {
+usize Buffer::find_next_char(usize index) const {
 	assert(index < gap_buffer.count());
 
 	static const u8 utf8_size_table[] = { 0, 0, 0, 0, 2, 2, 3, 4 };
@@ -299,6 +1028,16 @@ Buffer* find_buffer(Buffer_ID id) {
 	return the_buffers.find(id);
 }
 
+Buffer_ID get_next_buffer(Buffer_ID id) {
+	for (Buffer_ID next = id + 1; next <= last_buffer_id; next += 1) {
+		if (find_buffer(next)) return next;
+	}
+	for (Buffer_ID next = 1; next < id; next += 1) {
+		if (find_buffer(next)) return next;
+	}
+	return id;
+}
+
 bool remove_buffer(Buffer_ID id) {
 	Buffer* const buffer = find_buffer(id);
 	if (buffer) {
@@ -308,4 +1047,169 @@ bool remove_buffer(Buffer_ID id) {
 	}
 	
 	return false;
-}
\ No newline at end of file
+}
+
+/**
+ * A file being read on a worker into a buffer of its own. The buffer is only added to the_buffers once it's done,
+ * until then nothing on the main thread can see it.
+ */
+struct Buffer_Load {
+	Buffer buffer;
+	ch::Path path;
+	bool succeeded;
+	volatile s32 done;
+
+	Buffer_Load* next;
+};
+
+/** Loads handed to workers that haven't been picked up yet. Only touched on the main thread. */
+static Buffer_Load* running_loads = nullptr;
+static u32 num_running_loads = 0;
+
+/**
+ * Paths waiting their turn. Only a couple of loads per worker are queued at once, so saves and glyphs
+ * don't end up behind hundreds of files.
+ */
+static ch::Array<ch::Path> queued_loads;
+static usize next_queued_load = 0;
+
+/** Set by open_files, cleared once the first of its files is shown. */
+static bool show_next_load = false;
+
+static void read_buffer_load(void* data) {
+	Buffer_Load* const load = (Buffer_Load*)data;
+
+	load->succeeded = load->buffer.read_file(load->path);
+
+	atomic_store(&load->done, 1);
+	post_wake_event(the_window.os_handle);
+}
+
+static void start_queued_loads() {
+	const u32 max_running = (get_num_workers() ? get_num_workers() : 1) * 2;
+	while (next_queued_load < queued_loads.count && num_running_loads < max_running) {
+		last_buffer_id += 1;
+
+		Buffer_Load* const load = ch_new Buffer_Load;
+		load->buffer = Buffer(last_buffer_id);
+		load->path = queued_loads[next_queued_load];
+		load->succeeded = false;
+		load->done = 0;
+		load->next = running_loads;
+
+		running_loads = load;
+		num_running_loads += 1;
+		next_queued_load += 1;
+		push_job(read_buffer_load, load);
+	}
+
+	if (next_queued_load == queued_loads.count) {
+		queued_loads.count = 0;
+		next_queued_load = 0;
+	}
+}
+
+static void finish_buffer_loads() {
+	Buffer_Load** link = &running_loads;
+	while (*link) {
+		Buffer_Load* const load = *link;
+		if (!atomic_load(&load->done)) {
+			link = &load->next;
+			continue;
+		}
+		*link = load->next;
+		num_running_loads -= 1;
+		defer(ch_delete load);
+
+		if (!load->succeeded) {
+			load->buffer.free();
+			continue;
+		}
+
+		const Buffer_ID id = load->buffer.id;
+		the_buffers.push(id, load->buffer);
+		find_buffer(id)->register_file();
+
+		if (show_next_load) {
+			show_next_load = false;
+			show_loaded_buffer(id);
+		}
+	}
+
+	start_queued_loads();
+}
+
+static void queue_load(const char* path, void* data) {
+	queued_loads.allocator = ch::get_heap_allocator();
+	queued_loads.push(ch::Path(path));
+}
+
+/** Opens every pattern listed in the file at list_path, one per line. Blank lines are skipped. */
+static usize open_listed_files(const char* list_path) {
+	Mapped_File list;
+	if (!map_file(list_path, &list)) return 0;
+	defer(unmap_file(&list));
+
+	usize result = 0;
+	usize line_start = 0;
+	while (line_start < list.size) {
+		usize line_end = line_start;
+		while (line_end < list.size && list.data[line_end] != '\n') line_end += 1;
+		const usize next_line = line_end + 1;
+
+		// Trim both ends, lists written on windows have a '\r' on every line
+		while (line_start < line_end && (list.data[line_start] == ' ' || list.data[line_start] == '\t')) line_start += 1;
+		while (line_end > line_start && (list.data[line_end - 1] == ' ' || list.data[line_end - 1] == '\t' || list.data[line_end - 1] == '\r')) line_end -= 1;
+
+		char pattern[1024];
+		const usize size = line_end - line_start;
+		if (size && size < sizeof(pattern)) {
+			memcpy(pattern, list.data + line_start, size);
+			pattern[size] = 0;
+			result += find_files(pattern, queue_load, nullptr);
+		}
+
+		line_start = next_line;
+	}
+
+	return result;
+}
+
+/** Compares paths the way the filesystem does, either slash separates. */
+static bool is_same_path(const char* a, const char* b) {
+	for (;; a += 1, b += 1) {
+		u8 ca = (u8)*a;
+		u8 cb = (u8)*b;
+		if (ca == '\\') ca = '/';
+		if (cb == '\\') cb = '/';
+#if CH_PLATFORM_WINDOWS
+		if (ca >= 'A' && ca <= 'Z') ca = ca - 'A' + 'a';
+		if (cb >= 'A' && cb <= 'Z') cb = cb - 'A' + 'a';
+#endif
+		if (ca != cb) return false;
+		if (!ca) return true;
+	}
+}
+
+void open_file(const char* path) {
+	for (Buffer_ID id = 1; id <= last_buffer_id; id += 1) {
+		const Buffer* const buffer = find_buffer(id);
+		if (!buffer || (buffer->flags & BF_File) != BF_File || !is_same_path(buffer->absolute_path, path)) continue;
+
+		show_loaded_buffer(id);
+		return;
+	}
+
+	queue_load(path, nullptr);
+	show_next_load = true;
+	start_queued_loads();
+}
+
+usize open_files(const char* pattern) {
+	const usize result = pattern[0] == '@' ? open_listed_files(pattern + 1) : find_files(pattern, queue_load, nullptr);
+	if (!result) return 0;
+
+	show_next_load = true;
+	start_queued_loads();
+	return result;
+}
@@ -4,6 +4,7 @@
 #include <ch_stl/gap_buffer.h>
 #include <ch_stl/hash.h>
 #include "draw.h"
+#include "os.h"
 #include "parsing.h"
 
 using Buffer_ID = usize;
@@ -35,28 +36,70 @@ CH_FORCEINLINE const char* get_line_ending_display(Line_Ending ending) {
 	return nullptr;
 }
 
-/** Encoding of the loaded buffer. Default for buffers will be user defined. As more encodings are added this needs to be updated. */
+/**
+ * Encoding of the file on disk. The buffer itself is always utf8, anything else is converted on load and save.
+ * As more encodings are added this needs to be updated.
+ *
+ * @see encoding.h
+ */
 enum Buffer_Encoding {
-	BE_ANSI,
-	BE_UTF8
+	BE_ANSI, // Read and written as latin-1
+	BE_UTF8,
+	BE_UTF16LE,
+	BE_UTF16BE,
 };
 
 CH_FORCEINLINE const char* get_buffer_encoding_display(Buffer_Encoding encoding) {
 	switch (encoding) {
 		case BE_ANSI: 
-			return "ansi";
+			return "latin-1";
 		case BE_UTF8:
 			return "utf-8";
+		case BE_UTF16LE:
+			return "utf-16le";
+		case BE_UTF16BE:
+			return "utf-16be";
 	}
 	return nullptr;
 }
 
+/** Where the last save of a buffer got to. Shown in the powerline. */
+enum Save_Status {
+	SS_None,
+	SS_Saving,
+	SS_Saved,
+	SS_Failed,
+	SS_Changed_On_Disk, // Someone else changed the file while we had unsaved edits
+};
+
+CH_FORCEINLINE const char* get_save_status_display(Save_Status status) {
+	switch (status) {
+		case SS_None:
+			return "";
+		case SS_Saving:
+			return " | saving";
+		case SS_Saved:
+			return " | saved";
+		case SS_Failed:
+			return " | save failed";
+		case SS_Changed_On_Disk:
+			return " | changed on disk";
+	}
+	return nullptr;
+}
+
+struct Buffer_Save;
+
 enum Buffer_Flags {
 	BF_File = 1,
 	BF_Scratch = 1 << 1,
 	BF_ReadOnly = 1 << 2,
+	BF_Windowed = 1 << 3, // Only a window of the file is loaded, always read only
 };
 
+/** How much of a windowed file is in memory at once. */
+const u64 large_file_window_size = 8 * 1024 * 1024;
+
 /**
  * Wrapper around gap buffer that keeps cached data about the contents of the gap buffer
  *
@@ -104,6 +147,9 @@ struct Buffer {
 	 */
 	Buffer_Encoding encoding = BE_UTF8;
 
+	/** If the file started with a utf16 byte order mark. It's stripped on load and written back on save. */
+	bool has_bom = false;
+
 	/**
 	 * Attributes to give details about what type of buffer this is.
 	 *
@@ -118,9 +164,82 @@ struct Buffer {
 	 */
 	bool is_dirty = false;
 
+	/** Bumped on every change to the contents. Lets views tell if what they last drew is still current. */
+	u64 version = 0;
+
+	/** version of the contents that last made it to disk. */
+	u64 saved_version = 0;
+
+	/**
+	 * Save running on a worker. It copies gap_buffer's memory before it writes anything, an edit that comes
+	 * in before the copy is done waits for it.
+	 *
+	 * @see start_save, prepare_for_edit
+	 */
+	Buffer_Save* pending_save = nullptr;
+	Save_Status save_status = SS_None;
+
+	/** The file as we last loaded or saved it. Anything else on disk came from somewhere else. */
+	File_Stamp disk_stamp;
+
+	/** Files changed while pending_save was running. The stamp is checked again once the save is picked up. */
+	bool missed_file_change = false;
+
+	/**
+	 * Edits since the file was last saved, for getting them back after a crash. Only file buffers have one.
+	 *
+	 * @see record_edit
+	 */
+	struct Buffer_Journal* journal = nullptr;
+
+	/**
+	 * Files over the large file threshold only have a window of whole lines loaded into gap_buffer.
+	 * Indices into gap_buffer are relative to window_offset, and line window_first_line of the file is line 0 of the buffer.
+	 *
+	 * @see load_window
+	 */
+	struct Line_Index* line_index = nullptr;
+	u64 file_size = 0;
+	u64 window_offset = 0;
+	u64 window_block = 0;
+	u64 window_first_line = 0;
+	bool window_line_is_exact = true;
+
+	/**
+	 * Follows a file that's being appended to, like a log. Views with their cursor at the end scroll along with it.
+	 * Each append is lexed on from the state the last line was in, nothing above it is looked at again.
+	 *
+	 * @see set_following, read_appended_bytes
+	 */
+	bool is_following = false;
+
 	bool disable_parse = false;
     bool syntax_dirty = true;
+
+	/**
+	 * Lexemes from the last parse. A parse that resumed partway down only has the lexemes from where it resumed.
+	 *
+	 * @see mark_syntax_dirty_from
+	 */
     ch::Array<parsing::Lexeme> lexemes;
+
+	/** The lexer's state going into each line as of the last parse, so a parse can pick it back up partway down. */
+	ch::Array<u8> line_lex_states;
+
+	/** Where the next parse resumes from. Only used if nothing else dirtied the syntax since, version tells. */
+	u64 syntax_resume_line = 0;
+	u64 syntax_resume_index = 0;
+	u64 syntax_resume_version = 0;
+
+	/**
+	 * Highlighting derived from the lexemes once per parse. Runs are stored line after line,
+	 * line_style_runs[i] is the index of line i's first run and has one extra entry at the end.
+	 *
+	 * @see parsing::Style_Run
+	 */
+	ch::Array<parsing::Style_Run> style_runs;
+	ch::Array<u32> line_style_runs;
+
     f64 lex_time = 0;
     f64 parse_time = 0;
     u64 lex_parse_count = 0;
@@ -136,6 +255,31 @@ struct Buffer {
 	 */
 	bool load_file_into_buffer(const ch::Path& path);
 
+	/**
+	 * The part of load_file_into_buffer that only touches this buffer: reading, decoding, measuring lines and lexing.
+	 * Safe to run on a worker for a buffer nothing else can see yet.
+	 *
+	 * @returns true if the file was read
+	 */
+	bool read_file(const ch::Path& path);
+
+	/** Hooks a freshly read file up to the file watcher and its journal. Main thread only, once the buffer is in place. */
+	void register_file();
+
+	/**
+	 * Replaces the window of a windowed buffer with the one around file_offset. The window starts on the line
+	 * boundary at or just after the block file_offset is in, and is kept full at the end of the file.
+	 *
+	 * @returns false if the window didn't move or couldn't be read
+	 */
+	bool load_window(u64 file_offset);
+
+	/** Works out window_first_line again from the line index. Called as the scan gets further. */
+	void refresh_window_line();
+
+	/** @returns the number of lines in the whole file, estimated until the line index is done. */
+	u64 get_file_line_count(bool* out_exact) const;
+
 	/**
 	 * Saves to a file at the listed path.
 	 *
@@ -143,6 +287,49 @@ struct Buffer {
 	 */
 	bool save_file_to_path();
 
+	/**
+	 * Snapshots the contents and saves them on a worker. The result shows up in save_status once tick_buffers sees it.
+	 * If a save is already running another one is started as soon as it finishes.
+	 *
+	 * @returns false if this buffer can't be saved
+	 */
+	bool start_save();
+
+	/**
+	 * Brings in changes someone else made to the file. Only the lines between the first and last difference are replaced,
+	 * line tables and views outside of them are left alone.
+	 *
+	 * @returns false if the file couldn't be read
+	 */
+	bool reload_changed_file();
+
+	/**
+	 * Reads just the bytes appended to the file since it was last read and measures the lines they add.
+	 * Nothing before the last line is looked at again.
+	 *
+	 * @returns false if the file changed some other way and needs a full reload
+	 */
+	bool read_appended_bytes(const File_Stamp& stamp);
+
+	void set_following(bool follow);
+
+	/**
+	 * Dirties the syntax for an edit that left everything before line alone, so the next parse can resume there
+	 * instead of starting over from the top. Must be called after version is bumped for the edit.
+	 *
+	 * @param index is where line starts
+	 */
+	void mark_syntax_dirty_from(u64 line, u64 index);
+
+	/**
+	 * Journals that removed bytes at offset were replaced with inserted, and tells the search so its matches follow along.
+	 * Must be called for every change to gap_buffer.
+	 */
+	void record_edit(usize offset, usize removed, const u8* inserted, usize inserted_size);
+
+	/** Must be called before anything writes to gap_buffer, so a running save keeps reading the contents it started with. */
+	void prepare_for_edit();
+
 	/** Empties the gap buffer and resets all cached state. */
     void empty();
 
@@ -169,7 +356,7 @@ struct Buffer {
 	 * @param index is the location to start searching at
 	 * @return is the found "next" index
 	 */
-	usize find_next_char(usize index);
+	usize find_next_char(usize index) const;
 
 	/**
 	 * Finds prev codepoint based on file encoding
@@ -188,6 +375,11 @@ struct Buffer {
 	 */
 	u32 get_char(usize index);
 
+	/** @returns true if style_runs are up to date with the current contents. */
+	CH_FORCEINLINE bool has_style_runs() const {
+		return !syntax_dirty && !disable_parse && line_style_runs.count == eol_table.count + 1;
+	}
+
 	u64 get_index_from_line(u64 line) const;
 	u64 get_line_from_index(u64 index) const;
     u64 get_wrapped_line_from_index(u64 index, u64 max_line_width) const;
@@ -196,6 +388,30 @@ struct Buffer {
 	void mark_file_dirty();
 };
 
+/**
+ * Picks up finished saves. Updates is_dirty against the version that was actually written.
+ * Also reloads files that were changed on disk by something else.
+ */
+void tick_buffers();
+
+/**
+ * Opens the files matching pattern on workers, a few at a time. Each is read, measured and lexed off the main thread
+ * and only becomes a buffer once it's ready. The first one ready after a call is shown in the focused view.
+ *
+ * @param pattern is a path with optional wildcards in its last part, or @path to a file listing one of those per line
+ * @returns the number of files queued
+ */
+usize open_files(const char* pattern);
+
+/**
+ * Opens the file at path the same way as open_files, without treating any of it as a wildcard.
+ * If the file is already open its buffer is shown instead.
+ */
+void open_file(const char* path);
+
+/** @returns the buffer after id, wrapping around to the first. */
+Buffer_ID get_next_buffer(Buffer_ID id);
+
 /** Creates a new buffer and @returns the new buffer's id. */
 Buffer_ID create_buffer();
 
@@ -3,6 +3,12 @@
 #include "editor.h"
 #include "config.h"
 #include "gui.h"
+#include "line_index.h"
+#include "prompt.h"
+#include "file_picker.h"
+#include "search.h"
+
+#include <string.h>
 
 static ch::Array<Buffer_View> views;
 static usize focused_view;
@@ -47,6 +53,98 @@ static bool is_point_in_glyph(ch::Vector2 p, const Font_Glyph* g, f32 x, f32 y)
 	return is_point_in_rect(p, x0, y0, x1, y1);
 }
 
+/** @returns how wide the line number gutter is in a view width wide, 0 if it isn't shown. */
+static f32 get_line_number_width(const Buffer* buffer, f32 width) {
+	if (!get_config().show_line_numbers) return 0.f;
+
+	bool exact;
+	const u32 line_number_columns = ch::get_num_digits(buffer->get_file_line_count(&exact)) + 2;
+	const f32 result = line_number_columns * the_font[' ']->advance;
+	if (result >= width) return 0.f;
+
+	return result;
+}
+
+/** @returns how tall line is once wrapped, estimated from the column table. */
+static CH_FORCEINLINE f32 get_line_height(const Buffer* buffer, usize line, f32 width, f32 text_width) {
+	const f32 line_height = (f32)the_font.size + the_font.line_gap;
+	const Font_Glyph* space_glyph = the_font[' '];
+
+	f32 y = 0.f;
+	f32 line_size_x = buffer->line_column_table[line] * space_glyph->advance;
+	while (line_size_x + space_glyph->advance * 2 > text_width) {
+		// width needs to be more than zero
+		line_size_x -= width;
+		y += line_height;
+	}
+
+	return y + line_height;
+}
+
+/**
+ * Finds the first line at least partly visible when scrolled to scroll_y. Lines are walked from wherever the view
+ * last landed, using the column table to estimate wrapping.
+ *
+ * @param out_y is set to where the line starts relative to the top of the view
+ */
+static usize find_first_visible_line(Buffer_View* view, const Buffer* buffer, f32 scroll_y, f32 width, f32 text_width, usize* out_line_start, f32* out_y) {
+	const f32 line_height = (f32)the_font.size + the_font.line_gap;
+
+	if (view->scroll_anchor_version != buffer->version || view->scroll_anchor_width != width ||
+		view->scroll_anchor_text_width != text_width || view->scroll_anchor_line_height != line_height ||
+		view->scroll_anchor_line >= buffer->line_column_table.count) {
+		view->scroll_anchor_line = 0;
+		view->scroll_anchor_start = 0;
+		view->scroll_anchor_y = 0.f;
+	}
+
+	// Kept relative to the top of the buffer so it doesn't pick up rounding from scroll_y
+	usize line = view->scroll_anchor_line;
+	usize line_start = view->scroll_anchor_start;
+	f32 line_y = view->scroll_anchor_y;
+
+	// Back up while the line above is still on screen, then forward past any that aren't
+	while (line > 0 && line_y - scroll_y > -line_height) {
+		const f32 above = get_line_height(buffer, line - 1, width, text_width);
+		if (line_y - above - scroll_y <= -line_height) break;
+
+		line -= 1;
+		line_start -= buffer->eol_table[line];
+		line_y -= above;
+	}
+	for (; line < buffer->line_column_table.count; line += 1) {
+		if (line_y - scroll_y > -line_height) break;
+
+		line_y += get_line_height(buffer, line, width, text_width);
+		line_start += buffer->eol_table[line];
+	}
+
+	// Past the end the line count is the result, which isn't a line to start from next time
+	if (line < buffer->line_column_table.count) {
+		view->scroll_anchor_line = line;
+		view->scroll_anchor_start = line_start;
+		view->scroll_anchor_y = line_y;
+		view->scroll_anchor_version = buffer->version;
+		view->scroll_anchor_width = width;
+		view->scroll_anchor_text_width = text_width;
+		view->scroll_anchor_line_height = line_height;
+	}
+
+	*out_line_start = line_start;
+	*out_y = line_y - scroll_y;
+	return line;
+}
+
+/** @returns how tall the lines [first, end) are, estimated the same way as find_first_visible_line. */
+static f32 get_lines_height(const Buffer* buffer, usize first, usize end, f32 width, f32 text_width) {
+	f32 y = 0.f;
+	for (usize i = first; i < end && i < buffer->line_column_table.count; i += 1) {
+		y += get_line_height(buffer, i, width, text_width);
+	}
+
+	return y;
+}
+
 static void imm_line_number(u64 current_line_number, u64 max_line_number, f32* x, f32 y, bool on_cursor_line) {
 	const Font_Glyph* space_glyph = the_font[' '];
 
@@ -83,6 +181,307 @@ static void imm_cursor(bool edit_mode, const Font_Glyph* g, float x, float y, co
 #define LINE_SIZE_DEBUG 0
 #define EOL_DEBUG 0
 
+/**
+ * Lays out a single line exactly how it will be drawn, including wrapping. Drawing, line caching
+ * and mouse picking all go through here so they can never disagree about where a glyph is.
+ *
+ * @param f is called as f(index, c, glyph, is_missing, x, y, next_x) for every codepoint. y is relative to the top of the line.
+ * @returns the number of rows the line takes up
+ */
+template <typename F>
+static u32 layout_line(const Buffer* buffer, usize line_start, usize line_end, f32 text_x, f32 x1, F f, f32* out_end_x = nullptr, f32* out_end_y = nullptr) {
+	const Config& config = get_config();
+	const Font_Glyph* space_glyph = the_font[' '];
+	const Font_Glyph* unknown_glyph = the_font['?'];
+	const f32 line_height = (f32)the_font.size + the_font.line_gap;
+	const ch::Gap_Buffer<u8>& gap_buffer = buffer->gap_buffer;
+
+	f32 x = text_x;
+	f32 y = 0.f;
+	u32 rows = 1;
+
+	for (ch::UTF8_Iterator<const ch::Gap_Buffer<u8>> it(gap_buffer, line_end, line_start); it.can_advance(); it.advance()) {
+		const u32 c = it.get();
+
+		const Font_Glyph* g = the_font[c];
+		bool is_missing = false;
+		if (!g) {
+			g = unknown_glyph;
+			is_missing = true;
+		}
+
+		f32 next_x;
+		if (c == '\t') {
+			next_x = x + space_glyph->advance * config.tab_width;
+		} else if (c == '\n' || c == '\r') {
+			g = space_glyph;
+			next_x = x + space_glyph->advance;
+		} else {
+			next_x = x + g->advance;
+		}
+
+		f(it.index, c, g, is_missing, x, y, next_x);
+		x = next_x;
+
+		if (c == '\r' || c == '\n') {
+			if (c == '\r' && it.can_advance() && it.peek() == '\n') it.advance();
+			break;
+		}
+
+		if (x + space_glyph->advance * 2 > x1) {
+			x = text_x;
+			y += line_height;
+			rows += 1;
+		}
+	}
+
+	if (out_end_x) *out_end_x = x;
+	if (out_end_y) *out_end_y = y;
+
+	return rows;
+}
+
+/** Walks a line's style runs in step with the layout. */
+struct Style_Run_Cursor {
+	const parsing::Style_Run* run = nullptr;
+	const parsing::Style_Run* end = nullptr;
+	usize run_end = 0;
+
+	Style_Run_Cursor(const Buffer* buffer, usize line, usize line_start) {
+		if (!buffer->has_style_runs()) return;
+
+		run = buffer->style_runs.cbegin() + buffer->line_style_runs[line];
+		end = buffer->style_runs.cbegin() + buffer->line_style_runs[line + 1];
+		run_end = line_start + (run < end ? run->length : 0);
+	}
+
+	CH_FORCEINLINE u8 get(usize index) {
+		if (!run) return parsing::SS_DEFAULT;
+
+		while (index >= run_end && run + 1 < end) {
+			run += 1;
+			run_end += run->length;
+		}
+		if (run < end && index < run_end) return run->style;
+		return parsing::SS_DEFAULT;
+	}
+};
+
+static u64 hash_bytes(u64 hash, const void* data, usize size) {
+	const u8* bytes = (const u8*)data;
+	for (usize i = 0; i < size; i += 1) {
+		hash ^= bytes[i];
+		hash *= 0x100000001B3ull;
+	}
+	return hash;
+}
+
+/**
+ * Glyph instances for one line, each positioned relative to the top left of its own row so a line of
+ * any length stays well inside the instances' s16 range. The key covers everything that can change the
+ * output: the bytes, their styles, the font size, the wrap width and the theme.
+ */
+const usize line_glyph_cache_prefix_size = 16;
+
+struct Line_Glyph_Cache_Entry {
+	u64 key = 0;
+	u32 rows = 0;
+	ch::Array<Imm_Instance> instances;
+
+	// Where each row's instances start, with the instance count on the end so row r is [row_starts[r], row_starts[r + 1])
+	ch::Array<u32> row_starts;
+
+	// Checked along with the key so two lines whose keys collide can't be mistaken for each other
+	usize line_size = 0;
+	u8 prefix[line_glyph_cache_prefix_size] = {};
+};
+
+// Direct mapped so a lookup is a single probe. Collisions just regenerate the line.
+const usize line_glyph_cache_size = 1024;
+static Line_Glyph_Cache_Entry line_glyph_cache[line_glyph_cache_size];
+
+static u64 get_line_glyph_cache_key(const Buffer* buffer, usize line, usize line_start, usize line_end, f32 wrap_width) {
+	const ch::Gap_Buffer<u8>& gap_buffer = buffer->gap_buffer;
+	const usize pre_gap_count = gap_buffer.gap - gap_buffer.data;
+
+	u64 hash = 0xCBF29CE484222325ull;
+	if (line_start < pre_gap_count) {
+		const usize end = line_end < pre_gap_count ? line_end : pre_gap_count;
+		hash = hash_bytes(hash, gap_buffer.data + line_start, end - line_start);
+	}
+	if (line_end > pre_gap_count) {
+		const usize start = line_start > pre_gap_count ? line_start : pre_gap_count;
+		hash = hash_bytes(hash, gap_buffer.data + gap_buffer.gap_size + start, line_end - start);
+	}
+
+	if (buffer->has_style_runs()) {
+		const u32 first_run = buffer->line_style_runs[line];
+		const u32 last_run = buffer->line_style_runs[line + 1];
+		hash = hash_bytes(hash, buffer->style_runs.cbegin() + first_run, (last_run - first_run) * sizeof(parsing::Style_Run));
+	}
+
+	const u32 theme_version = get_theme_version();
+	hash = hash_bytes(hash, &the_font.size, sizeof(the_font.size));
+	hash = hash_bytes(hash, &wrap_width, sizeof(wrap_width));
+	hash = hash_bytes(hash, &theme_version, sizeof(theme_version));
+
+	return hash ? hash : 1;
+}
+
+/** Copies up to line_glyph_cache_prefix_size bytes from the start of the line, reading across the gap. */
+static void get_line_prefix(const Buffer* buffer, usize line_start, usize line_end, u8* out_prefix) {
+	const usize size = line_end - line_start < line_glyph_cache_prefix_size ? line_end - line_start : line_glyph_cache_prefix_size;
+	for (usize i = 0; i < line_glyph_cache_prefix_size; i += 1) {
+		out_prefix[i] = i < size ? buffer->gap_buffer[line_start + i] : 0;
+	}
+}
+
+/**
+ * Draws the glyphs of a line that has no selection on it. The instances are only rebuilt when the
+ * line's key changes, so scrolling and cursor blinking just replay them. Only the rows between y0
+ * and y1 are replayed.
+ *
+ * @returns the number of rows the line takes up
+ */
+static u32 imm_line_cached(const Buffer* buffer, usize line, usize line_start, usize line_end, f32 text_x, f32 line_y, f32 x1, f32 y0, f32 y1) {
+	const f32 line_height = (f32)the_font.size + the_font.line_gap;
+
+	const f32 wrap_width = x1 - text_x;
+	const u64 key = get_line_glyph_cache_key(buffer, line, line_start, line_end, wrap_width);
+
+	u8 prefix[line_glyph_cache_prefix_size];
+	get_line_prefix(buffer, line_start, line_end, prefix);
+
+	Line_Glyph_Cache_Entry* const entry = &line_glyph_cache[key % line_glyph_cache_size];
+	const bool is_same_line = entry->key == key && entry->line_size == line_end - line_start && memcmp(entry->prefix, prefix, sizeof(prefix)) == 0;
+	if (!is_same_line) {
+		const ch::Color* const theme = get_theme();
+
+		entry->instances.allocator = ch::get_heap_allocator();
+		entry->instances.count = 0;
+		entry->row_starts.allocator = ch::get_heap_allocator();
+		entry->row_starts.count = 0;
+
+		Style_Run_Cursor styles(buffer, line, line_start);
+		f32 row_y = 0.f;
+		entry->row_starts.push(0);
+		entry->rows = layout_line(buffer, line_start, line_end, 0.f, wrap_width, [&](usize index, u32 c, const Font_Glyph* g, bool is_missing, f32 x, f32 y, f32 next_x) {
+			const u8 style = styles.get(index);
+			if (y != row_y) {
+				row_y = y;
+				entry->row_starts.push((u32)entry->instances.count);
+			}
+			if (ch::is_whitespace(c)) return;
+
+			Imm_Instance instance;
+			make_glyph_instance(&instance, g, the_font, x, 0.f, is_missing ? ch::magenta : theme[style]);
+			entry->instances.push(instance);
+		});
+
+		// A wrap right at the end leaves a row with nothing in it
+		while (entry->row_starts.count <= entry->rows) {
+			entry->row_starts.push((u32)entry->instances.count);
+		}
+		entry->key = key;
+		entry->line_size = line_end - line_start;
+		memcpy(entry->prefix, prefix, sizeof(prefix));
+	}
+
+	u32 row = line_y + line_height < y0 ? (u32)((y0 - line_y) / line_height) : 0;
+	for (; row < entry->rows; row += 1) {
+		const f32 row_y = line_y + row * line_height;
+		if (row_y > y1) break;
+
+		const u32 first = entry->row_starts[row];
+		imm_instances(entry->instances.begin() + first, entry->row_starts[row + 1] - first, text_x, row_y);
+	}
+	return entry->rows;
+}
+
+/**
+ * Draws a line that intersects the selection or a search match. These change as the selection is dragged
+ * so they skip the cache.
+ *
+ * @param matches are the sorted starts of matches from the first that could reach into the line
+ * @returns the number of rows the line takes up
+ */
+static u32 imm_line_selected(const Buffer* buffer, usize line, usize line_start, usize line_end, f32 text_x, f32 line_y, f32 x1, f32 y0, f32 y1, usize selection_min, usize selection_max, const usize* matches, usize num_matches, usize match_size) {
+	const Config& config = get_config();
+	const ch::Color* const theme = get_theme();
+	const f32 font_height = (f32)the_font.size;
+	const f32 line_height = font_height + the_font.line_gap;
+
+	// Matches can overlap, so track where the furthest one reached so far ends
+	usize next_match = 0;
+	usize match_end = 0;
+
+	Style_Run_Cursor styles(buffer, line, line_start);
+	return layout_line(buffer, line_start, line_end, text_x, x1, [&](usize index, u32 c, const Font_Glyph* g, bool is_missing, f32 x, f32 y, f32 next_x) {
+		ch::Color color = is_missing ? ch::magenta : theme[styles.get(index)];
+
+		while (next_match < num_matches && matches[next_match] <= index) {
+			match_end = matches[next_match] + match_size;
+			next_match += 1;
+		}
+		// Rows out of view are still laid out to keep the match and selection state right, they just aren't drawn
+		const bool in_view = line_y + y + line_height > y0 && line_y + y <= y1;
+
+		if (in_view && index < match_end) {
+			imm_quad(x, line_y + y, next_x, line_y + y + line_height, config.search_match_color);
+		}
+
+		const bool is_selected = index >= selection_min && index < selection_max;
+		if (is_selected) color = config.selected_text_color;
+		if (in_view && is_selected) {
+			imm_quad(x, line_y + y, next_x, line_y + y + line_height, config.selection_color);
+		}
+
+		if (in_view && !ch::is_whitespace(c) && line_y + y + font_height > y0) {
+			imm_glyph(g, the_font, x, line_y + y, color);
+		}
+	});
+}
+
+/**
+ * Finds the buffer index under the mouse by laying out the visible lines.
+ * Only done on frames where the mouse is actually pressed.
+ *
+ * @returns true if the mouse was over text
+ */
+static bool pick_buffer_index(const Buffer* buffer, ch::Vector2 p, usize first_line, usize line_start, f32 text_x, f32 line_y, f32 x1, f32 y1, usize* out_index) {
+	const f32 line_height = (f32)the_font.size + the_font.line_gap;
+	const usize buffer_count = buffer->gap_buffer.count();
+
+	for (usize line = first_line; line < buffer->eol_table.count && line_y <= y1; line += 1) {
+		const usize line_end = line_start + buffer->eol_table[line];
+
+		bool found = false;
+		usize hit = line_start;
+		f32 last_next_x = text_x;
+		const u32 rows = layout_line(buffer, line_start, line_end, text_x, x1, [&](usize index, u32 c, const Font_Glyph* g, bool is_missing, f32 x, f32 y, f32 next_x) {
+			if (p.y < line_y + y || p.y > line_y + y + line_height) return;
+			if (!found || p.x >= x) {
+				hit = index;
+				found = true;
+				last_next_x = next_x;
+			}
+		});
+
+		if (p.y >= line_y && p.y <= line_y + rows * line_height) {
+			// Past the end of the last line puts the cursor at the end of the buffer.
+			if (line_end == buffer_count && (!found || p.x >= last_next_x)) hit = line_end;
+
+			*out_index = hit;
+			return true;
+		}
+
+		line_y += rows * line_height;
+		line_start = line_end;
+	}
+
+	return false;
+}
+
 // TODO: Finish up to fit gui system
 static void gui_buffer_view(UI_ID id, Buffer_View* view, f32 x0, f32 y0, f32 x1, f32 y1) {
 	const ch::Vector2 mouse_pos = current_mouse_position;
@@ -96,12 +495,12 @@ static void gui_buffer_view(UI_ID id, Buffer_View* view, f32 x0, f32 y0, f32 x1,
 	imm_quad(x0, y0, x1, y1, config.background_color);
 
 	const f32 font_height = the_font.size;
+	const f32 line_height = font_height + the_font.line_gap;
 	const Font_Glyph* space_glyph = the_font[' '];
-	const Font_Glyph* unknown_glyph = the_font['?'];
 
 	// TODO: Remove this
 	bool edit_mode = true;
-	bool show_cursor = true;
+	const bool show_cursor = view->show_cursor;
 	usize* cursor = &view->cursor;
 	usize* selection = &view->selection;
 
@@ -111,27 +510,17 @@ static void gui_buffer_view(UI_ID id, Buffer_View* view, f32 x0, f32 y0, f32 x1,
 	const usize num_lines = buffer->eol_table.count;
 	const ch::Gap_Buffer<u8>& gap_buffer = buffer->gap_buffer;
 
-	const f32 starting_x = x0;
-	const f32 starting_y = y0 - view->current_scroll_y;
-	f32 x = starting_x;
-	f32 y = starting_y;
-	u64 line_number = 1;
-
 	const f32 width = x1 - x0;
 	assert(width > 0);
 
-	f32 line_number_quad_width = 0.f;
-
-	const u32 line_number_columns = ch::get_num_digits(num_lines) + 2;
-
-	bool show_line_numbers = config.show_line_numbers;
+	// Windowed buffers number their lines from where the window is in the file
+	bool is_line_count_exact;
+	const u64 max_line_number = buffer->get_file_line_count(&is_line_count_exact);
 
-	if (line_number_columns * space_glyph->advance >= width) {
-		show_line_numbers = false;
-	}
+	const f32 line_number_quad_width = get_line_number_width(buffer, width);
+	const bool show_line_numbers = line_number_quad_width > 0.f;
 
 	if (show_line_numbers) {
-		line_number_quad_width = (line_number_columns * space_glyph->advance);
 		const f32 ln_x0 = x0;
 		const f32 ln_y0 = y0;
 		const f32 ln_x1 = ln_x0 + line_number_quad_width;
@@ -139,289 +528,130 @@ static void gui_buffer_view(UI_ID id, Buffer_View* view, f32 x0, f32 y0, f32 x1,
 		imm_quad(ln_x0, ln_y0, ln_x1, ln_y1, config.line_number_background_color);
 	}
 
-	usize starting_index = 0;
-	for (usize i = 0; i < buffer->line_column_table.count; i += 1) {
-		if (y > -font_height) {
-			starting_index = buffer->get_index_from_line(i);
-			line_number = i + 1;
-			break;
-		}
-
-		f32 line_size_x = buffer->line_column_table[i] * space_glyph->advance;
-
-		while (line_size_x + space_glyph->advance * 2 > width - line_number_quad_width) {
-			// width needs to be more than zero
-			line_size_x -= width;
-			y += font_height;
-		}
+	const f32 text_x = x0 + line_number_quad_width;
 
-		y += font_height;
-	}
+	usize first_line_start;
+	f32 y;
+	const usize first_line = find_first_visible_line(view, buffer, view->current_scroll_y, width, width - line_number_quad_width, &first_line_start, &y);
+	y += y0;
 
 	if (*cursor > gap_buffer.count()) {
 		*cursor = gap_buffer.count();
 		*selection = *cursor;
 	}
 
-	// Some bookkeeping variables are needed to identify the current syntax highlight.
-	const parsing::Lexeme* const lexemes_begin = buffer->lexemes.cbegin();
-	const parsing::Lexeme* const lexemes_end = buffer->lexemes.cend();
-	const parsing::Lexeme* lexeme = lexemes_begin;
-
-	if (show_line_numbers) imm_line_number(line_number, num_lines, &x, y, view->current_line == 0);
-	if (view->current_line == 0) {
-		imm_quad(x, y, x1, y + font_height + the_font.line_gap, config.line_number_background_color);
-	}
-
-	// @HACK: We have to do this until we move away from wait for events
-	bool found_new_cursor_pos = false;
 	const bool mouse_over = is_point_in_rect(mouse_pos, x0, y0, x1, y1);
-
-	for (ch::UTF8_Iterator<const ch::Gap_Buffer<u8>> it(gap_buffer, gap_buffer.count(), starting_index); it.can_advance(); it.advance()) {
-		const u32 c = it.get();
-		ch::Color color = config.foreground_color;
-
-		const f32 old_x = x;
-		const f32 old_y = y;
-
-		if (!buffer->syntax_dirty && !buffer->disable_parse)
-		{
-			while (lexeme + 1 < lexemes_end && ((ch::Gap_Buffer<u8>&)gap_buffer).get_index_as_cursor(it.index + 1) - 1 >= (const u8*)lexeme[1].i) {
-				lexeme += 1;
-			}
-
-			assert(lexeme < lexemes_end);
-			// @Temporary method to determine the colour of the current lexeme.
-			// More nuanced parsing and configurable colours are on the roadmap. -phillip
-			ch::Color stringlit = { 1.0f, 1.0f, 0.2f, 1.0f };
-			ch::Color comment = { 0.3f, 0.3f, 0.3f, 1.0f };
-			ch::Color preproc = { 0.1f, 1.0f, 0.6f, 1.0f };
-			ch::Color op = { 0.7f, 0.7f, 0.7f, 1.0f };
-			ch::Color numlit = { 0.5f, 0.5f, 1.0f, 1.0f };
-			ch::Color type = { 0.0f, 0.7f, 0.9f, 1.0f };
-			ch::Color keyword = { 1.0f, 1.0f, 1.0f, 1.0f };
-			ch::Color param = { 1.0f, 0.6f, 0.125f, 1.0f };
-			ch::Color label = op;
-			switch (lexeme->dfa) {
-			case parsing::DFA_FUNCTION:
-				if (parsing::is_keyword(lexeme)) {
-					color = keyword;
-				}
-				else {
-					color = preproc;
-				}
-				break;
-			case parsing::DFA_PARAM:
-				if (parsing::is_keyword(lexeme)) {
-					color = keyword;
-				}
-				else {
-					color = param;
-				}
-				break;
-			case parsing::DFA_KEYWORD:
-				color = keyword;
-				break;
-			case parsing::DFA_PREPROC:
-				color = preproc;
-				break;
-			case parsing::DFA_MACRO:
-				color = numlit;
-				break;
-			case parsing::DFA_STRINGLIT:
-			case parsing::DFA_STRINGLIT_BS:
-			case parsing::DFA_CHARLIT:
-			case parsing::DFA_CHARLIT_BS:
-				color = stringlit;
-				break;
-			case parsing::DFA_BLOCK_COMMENT:
-			case parsing::DFA_BLOCK_COMMENT_STAR:
-			case parsing::DFA_LINE_COMMENT:
-				color = comment;
-				break;
-			case parsing::DFA_WHITE_BS:
-			case parsing::DFA_WHITE:
-				if (lexeme > lexemes_begin && lexeme[-1].dfa == parsing::DFA_STRINGLIT) {
-					color = stringlit;
-				}
-				if (lexeme > lexemes_begin && lexeme[-1].dfa == parsing::DFA_CHARLIT) {
-					color = stringlit;
-				}
-				if (lexeme > lexemes_begin && lexeme[-1].dfa <= parsing::DFA_LINE_COMMENT) {
-					color = comment;
-				}
-				break;
-			case parsing::DFA_IDENT:
-				if (parsing::is_keyword(lexeme)) {
-					color = keyword;
-				}
-				else {
-
-				}
-				break;
-			case parsing::DFA_OP:
-			case parsing::DFA_OP2:
-				color = op;
-				break;
-			case parsing::DFA_NEWLINE:
-				break;
-			case parsing::DFA_NUMLIT:
-				color = numlit;
-				break;
-			case parsing::DFA_SLASH:
-				if (lexeme + 1 < lexemes_end && lexeme[1].dfa <= parsing::DFA_LINE_COMMENT) {
-					color = comment;
-				}
-				else {
-					color = op;
-				}
-				break;
-			case parsing::DFA_TYPE:
-				if (parsing::is_keyword(lexeme)) {
-					color = keyword;
-				}
-				else {
-					color = type;
-				}
-				break;
-			case parsing::DFA_LABEL:
-				color = label;
-				break;
-			default: ch_debug_trap;
-			}
-		}
-
-		const Font_Glyph* g = the_font[c];
-		if (!g) {
-			color = ch::magenta;
-			g = unknown_glyph;
-		}
-
-		if (c == '\t') {
-			x += space_glyph->advance * config.tab_width;
-		}
-		else if (c == '\n' || c == '\r') {
-			x += space_glyph->advance;
-			g = space_glyph;
+	if (mouse_over && (was_lmb_pressed || is_lmb_down)) {
+		usize new_cursor;
+		if (pick_buffer_index(buffer, mouse_pos, first_line, first_line_start, text_x, y, x1, y1, &new_cursor)) {
+			*cursor = new_cursor;
+			if (was_lmb_pressed) *selection = *cursor;
 		}
-		else {
-			x += g->advance;
-		}
-
-		const usize i = it.index;
+	}
 
-		const bool mouse_on_line = ((c == '\n' || c == '\r' || it.is_on_last()) && mouse_pos.y >= old_y && mouse_pos.y <= old_y + font_height + the_font.line_gap);
-		const bool mouse_past_eol = mouse_pos.x >= old_x;
-		if ((is_point_in_rect(mouse_pos, old_x, old_y, x, old_y + font_height + the_font.line_gap) || (mouse_on_line && mouse_past_eol)) && mouse_over) {
-			const usize new_cursor = it.is_on_last() ? it.index + 1 : it.index;
-			if (was_lmb_pressed) {
-				*cursor = new_cursor;
-				*selection = *cursor;
-				found_new_cursor_pos = true;
-			}
-			else if (is_lmb_down) {
-				*cursor = new_cursor;
+	const usize selection_min = *cursor < *selection ? *cursor : *selection;
+	const usize selection_max = *cursor < *selection ? *selection : *cursor;
+	const bool has_selection = edit_mode && selection_min != selection_max;
+
+	const usize* matches = nullptr;
+	usize match_size = 0;
+	const usize num_matches = get_search_matches(view->the_buffer, &matches, &match_size);
+
+	// Lines are drawn in order, so the first match that could reach each one only ever moves forward
+	usize first_match = 0;
+	if (num_matches) {
+		const usize from = first_line_start >= match_size ? first_line_start - match_size + 1 : 0;
+		usize hi = num_matches;
+		while (first_match < hi) {
+			const usize mid = first_match + (hi - first_match) / 2;
+			if (matches[mid] < from) {
+				first_match = mid + 1;
+			} else {
+				hi = mid;
 			}
 		}
+	}
 
-		const bool should_draw_selection_or_cursor = ((mouse_over && was_lmb_pressed && found_new_cursor_pos) || !was_lmb_pressed || (was_lmb_pressed && !mouse_over));
-
-		const bool is_in_selection = ((orig_cursor > orig_selection && i >= orig_selection && i < orig_cursor) || (orig_cursor < orig_selection && i < orig_selection && i >= orig_cursor)) && should_draw_selection_or_cursor;
-		if (is_in_selection && edit_mode) {
-			imm_quad(old_x, old_y, x, old_y + font_height + the_font.line_gap, config.selection_color);
-		}
+	view->end_in_view = false;
 
-		const bool is_in_cursor = *cursor == i && should_draw_selection_or_cursor;
-		if (is_in_cursor) {
-			if (show_cursor || !edit_mode) {
-				imm_cursor(edit_mode, g, old_x, old_y, config.cursor_color);
-			}
+	usize line_start = first_line_start;
+	for (usize line = first_line; line < num_lines && y <= y1; line += 1) {
+		const usize line_end = line_start + buffer->eol_table[line];
+		const bool is_last_line = line + 1 == num_lines;
+		const bool on_cursor_line = view->current_line == line;
 
-			if (is_in_cursor && show_cursor) {
-				color = config.background_color;
-			}
+		// Lets a followed buffer scroll along with appends without measuring everything above them
+		if (is_last_line) {
+			view->end_in_view = true;
+			view->last_line_y = y - y0;
 		}
 
-		if (c == '\r' || c == '\n') {
-			if (c == '\r' && it.can_advance()) {
-				const u32 peek_c = it.peek();
-				if (peek_c == '\n') {
-					it.advance();
-#if EOL_DEBUG
-					const ch::Vector2 nl_size = imm_string("\\r\\n ", the_font, old_x, old_y, ch::magenta);
-					x += nl_size.x;
-#endif
-				}
-#if EOL_DEBUG
-				else {
-					const ch::Vector2 cr_size = imm_string("\\r ", the_font, old_x, old_y, ch::magenta);
-					x += cr_size.x;
-				}
-#endif
-			}
-#if EOL_DEBUG
-			else {
-				const ch::Vector2 nl_size = imm_string("\\n ", the_font, old_x, old_y, ch::magenta);
-				x += nl_size.x;
-			}
-#endif
+		// A long wrapped line can start far above the view, its first row is only drawn when it can be seen
+		const bool first_row_in_view = y + line_height > y0;
 
-#if LINE_SIZE_DEBUG
-			char temp[100];
-			ch::sprintf(temp, "col: %lu, bytes: %lu", buffer->line_column_table[line_number - 1], buffer->eol_table[line_number - 1]);
-			imm_string(temp, the_font, x, y, ch::magenta);
-#endif;
-
-			x = starting_x;
-			y += font_height + the_font.line_gap;
-			line_number += 1;
+		f32 x = x0;
+		if (show_line_numbers && first_row_in_view) imm_line_number(buffer->window_first_line + line + 1, max_line_number, &x, y, on_cursor_line);
 
-			const bool on_cursor_line = view->current_line == line_number - 1;
-			if (show_line_numbers) {
-				imm_line_number(line_number, num_lines, &x, y, on_cursor_line);
-			}
-
-			if (on_cursor_line) {
-				imm_quad(x, y, x1, y + font_height + the_font.line_gap, config.line_number_background_color);
-			}
-
-			continue;
+		if (on_cursor_line && first_row_in_view) {
+			imm_quad(text_x, y, x1, y + line_height, config.line_number_background_color);
 		}
 
-		if (x + space_glyph->advance * 2 > x1) {
-			const Font_Glyph* return_g = the_font[0x21B5];
-			imm_glyph(g, the_font, old_x, old_y, color);
-
-			x = starting_x;
-			y += font_height + the_font.line_gap;
-
-			if (show_line_numbers) {
-				x += space_glyph->advance * (ch::get_num_digits(num_lines) + 2);
-			}
+		while (first_match < num_matches && matches[first_match] + match_size <= line_start) {
+			first_match += 1;
+		}
+		const bool has_match = first_match < num_matches && matches[first_match] < line_end;
 
+		u32 rows;
+		if (has_match || (has_selection && selection_min < line_end && selection_max > line_start)) {
+			rows = imm_line_selected(buffer, line, line_start, line_end, text_x, y, x1, y0, y1, selection_min, selection_max, matches + first_match, num_matches - first_match, match_size);
+		} else {
+			rows = imm_line_cached(buffer, line, line_start, line_end, text_x, y, x1, y0, y1);
 		}
 
-		if (is_in_selection && (!is_in_cursor || !show_cursor)) color = config.selected_text_color;
+		const bool cursor_on_line = (*cursor >= line_start && *cursor < line_end) || (is_last_line && *cursor == line_end);
+		if (cursor_on_line && (show_cursor || !edit_mode)) {
+			// Where a glyph lands only depends on what's before it, so nothing past the cursor needs laying out
+			const usize cursor_end = *cursor < line_end ? buffer->find_next_char(*cursor) : line_end;
+
+			bool found_cursor = false;
+			f32 end_x, end_y;
+			layout_line(buffer, line_start, cursor_end, text_x, x1, [&](usize index, u32 c, const Font_Glyph* g, bool is_missing, f32 gx, f32 gy, f32 next_x) {
+				if (index != *cursor) return;
+				found_cursor = true;
+				if (y + gy + line_height <= y0 || y + gy > y1) return;
+
+				imm_cursor(edit_mode, g, gx, y + gy, config.cursor_color);
+				if (show_cursor && edit_mode && !ch::is_whitespace(c)) {
+					imm_glyph(g, the_font, gx, y + gy, config.background_color);
+				}
+			}, &end_x, &end_y);
 
-		if (!ch::is_whitespace(c) && old_y + font_height > y0) {
-			imm_glyph(g, the_font, old_x, old_y, color);
+			if (!found_cursor && y + end_y + line_height > y0 && y + end_y <= y1) imm_cursor(edit_mode, space_glyph, end_x, y + end_y, config.cursor_color);
 		}
 
-		if (y > y1) break;
-
 #if LINE_SIZE_DEBUG || EOL_DEBUG
-		if (it.is_on_last()) {
+		{
+			f32 end_x, end_y;
+			layout_line(buffer, line_start, line_end, text_x, x1, [](usize, u32, const Font_Glyph*, bool, f32, f32, f32) {}, &end_x, &end_y);
 #if EOL_DEBUG
-			ch::Vector2 eos_size = imm_string("0 ", the_font, x, y, ch::magenta);
-			x += eos_size.x;
+			const char* eol = "0 ";
+			if (line_end > line_start && gap_buffer[line_end - 1] == '\n') {
+				eol = (line_end - line_start > 1 && gap_buffer[line_end - 2] == '\r') ? "\\r\\n " : "\\n ";
+			} else if (line_end > line_start && gap_buffer[line_end - 1] == '\r') {
+				eol = "\\r ";
+			}
+			end_x += imm_string(eol, the_font, end_x, y + end_y, ch::magenta).x;
 #endif
 #if LINE_SIZE_DEBUG
 			char temp[100];
-			ch::sprintf(temp, "col: %lu, bytes: %lu", buffer->line_column_table[line_number - 1], buffer->eol_table[line_number - 1]);
-			imm_string(temp, the_font, x, y, ch::magenta);
+			ch::sprintf(temp, "col: %lu, bytes: %lu", buffer->line_column_table[line], buffer->eol_table[line]);
+			imm_string(temp, the_font, end_x, y + end_y, ch::magenta);
 #endif
 		}
 #endif
+
+		y += rows * line_height;
+		line_start = line_end;
 	}
 
 #if PARSE_SPEED_DEBUG
@@ -459,9 +689,7 @@ static void gui_buffer_view(UI_ID id, Buffer_View* view, f32 x0, f32 y0, f32 x1,
 	}
 #endif
 
-	if (*cursor == gap_buffer.count() && (show_cursor || !edit_mode)) imm_cursor(edit_mode, space_glyph, x, y, config.cursor_color);
-
-	if (*cursor != orig_cursor || *selection != orig_cursor) {
+	if (*cursor != orig_cursor || *selection != orig_selection) {
 		view->update_column_info(true);
 	}
 }
@@ -472,6 +700,13 @@ void Buffer_View::remove_selection() {
 	Buffer* buffer = find_buffer(the_buffer);
 	assert(buffer);
 
+	// Windows of large files are read only, there's nowhere to put an edit
+	if ((buffer->flags & BF_Windowed) == BF_Windowed) return;
+	buffer->prepare_for_edit();
+
+	const usize start = cursor < selection ? cursor : selection;
+	const usize count_before = buffer->gap_buffer.count();
+
 	if (cursor > selection) {
 		for (usize i = selection; i < cursor; i = buffer->find_next_char(i)) {
 			buffer->gap_buffer.remove_at_index(selection);
@@ -485,6 +720,7 @@ void Buffer_View::remove_selection() {
 		}
 		selection = cursor;
 	}
+	buffer->record_edit(start, count_before - buffer->gap_buffer.count(), nullptr, 0);
 
 	buffer->refresh_line_tables();
 	update_column_info(true);
@@ -515,9 +751,9 @@ void Buffer_View::ensure_cursor_in_view() {
 
 	return;
 
-    u64 max_line_width = get_view_columns((f32)the_window.get_viewport_size().ux, this - views.begin()); // @Hack: this "self-contained view acting only on itself" abstraction is bad
+    u64 max_line_width = get_view_columns((f32)get_viewport_size().ux, this - views.begin()); // @Hack: this "self-contained view acting only on itself" abstraction is bad
 
-    f32 view_height = (f32)the_window.get_viewport_size().uy;
+    f32 view_height = (f32)get_viewport_size().uy;
     f32 font_height = (f32)the_font.size;
 
     f32 cursor_y = (buffer->get_wrapped_line_from_index(cursor, max_line_width)) * font_height; // @Todo: need to compute the exact value for wrapped line scrolling
@@ -534,6 +770,8 @@ void Buffer_View::on_char_entered(u32 c) {
 	Buffer* buffer = find_buffer(the_buffer);
 	assert(buffer);
 
+	if ((buffer->flags & BF_Windowed) == BF_Windowed) return;
+
 	// @NOTE(CHall): Needs to ensure we're doing the correct encoding with push
 
 	remove_selection();
@@ -548,9 +786,246 @@ void Buffer_View::on_char_entered(u32 c) {
 	buffer->mark_file_dirty();
 }
 
+static const f32 powerline_padding = 2.f;
+
+static f32 get_powerline_height() {
+	return (f32)the_font.size + the_font.line_gap;
+}
+
+static f32 get_view_height() {
+	return (f32)get_viewport_size().uy - (get_powerline_height() + powerline_padding * 2.f);
+}
+
+/** Scrolls just far enough for text ending end_y below the top of the view to be on screen, with no easing. */
+static void scroll_end_into_view(Buffer_View* view, const Buffer* buffer, f32 width, f32 text_width, f32 end_y) {
+	const f32 overflow = end_y - get_view_height();
+	if (overflow > 0.f) {
+		view->target_scroll_y += overflow;
+		view->current_scroll_y = view->target_scroll_y;
+		end_y -= overflow;
+	}
+
+	const usize num_lines = buffer->eol_table.count;
+	view->end_in_view = true;
+	view->last_line_y = end_y - get_lines_height(buffer, num_lines - 1, num_lines, width, text_width);
+}
+
+// The end of the buffer is at the end of the last line, so its line and column are in the tables already.
+static void put_cursor_at_end(Buffer_View* view, const Buffer* buffer) {
+	view->cursor = buffer->gap_buffer.count();
+	view->selection = view->cursor;
+	view->current_line = buffer->eol_table.count - 1;
+	view->current_column = buffer->line_column_table[view->current_line];
+	view->desired_column = view->current_column;
+}
+
+/** @returns where the last line ends relative to the top of the view, measured from the scroll anchor if it's still good. */
+static f32 get_end_y(Buffer_View* view, const Buffer* buffer, f32 width, f32 text_width) {
+	usize line_start;
+	f32 line_y;
+	const usize line = find_first_visible_line(view, buffer, view->target_scroll_y, width, text_width, &line_start, &line_y);
+	return line_y + get_lines_height(buffer, line, buffer->eol_table.count, width, text_width);
+}
+
+void on_buffer_appended(Buffer_ID the_buffer, usize old_count, usize first_line) {
+	const Buffer* const buffer = find_buffer(the_buffer);
+	assert(buffer);
+
+	const f32 viewport_width = (f32)get_viewport_size().ux;
+
+	for (usize i = 0; i < views.count; i += 1) {
+		Buffer_View* const view = &views[i];
+		if (view->the_buffer != the_buffer) continue;
+
+		// Nothing above the append moved, so views can keep walking from where they last landed
+		if (view->scroll_anchor_version == buffer->version - 1 && view->scroll_anchor_line < first_line) {
+			view->scroll_anchor_version = buffer->version;
+		}
+
+		if (view->cursor != old_count || view->selection != old_count) continue;
+		put_cursor_at_end(view, buffer);
+
+		if (!buffer->is_following) continue;
+
+		const f32 width = get_view_width(viewport_width, i);
+		const f32 text_width = width - get_line_number_width(buffer, width);
+
+		// The old last line was where it was drawn, only what came after it needs measuring.
+		// If it was off screen the end is found again from the top of the view
+		f32 end_y;
+		if (view->end_in_view) {
+			end_y = view->last_line_y + get_lines_height(buffer, first_line, buffer->eol_table.count, width, text_width);
+		} else {
+			end_y = get_end_y(view, buffer, width, text_width);
+		}
+		scroll_end_into_view(view, buffer, width, text_width, end_y);
+	}
+}
+
+void follow_buffer_end(Buffer_View* view) {
+	const Buffer* const buffer = find_buffer(view->the_buffer);
+	assert(buffer);
+
+	put_cursor_at_end(view, buffer);
+	view->reset_cursor_timer();
+
+	const f32 width = get_view_width((f32)get_viewport_size().ux, view - views.begin());
+	const f32 text_width = width - get_line_number_width(buffer, width);
+	scroll_end_into_view(view, buffer, width, text_width, get_end_y(view, buffer, width, text_width));
+}
+
+void Buffer_View::jump_to_line(u64 line) {
+	Buffer* const buffer = find_buffer(the_buffer);
+	assert(buffer);
+
+	// Bring in the window the line is in first. With a finished index that's exact, before then it's a guess
+	if ((buffer->flags & BF_Windowed) == BF_Windowed) {
+		u64 file_offset = 0;
+		if (buffer->line_index) {
+			bool exact;
+			const f64 lines_per_byte = buffer->gap_buffer.count() ? (f64)(buffer->eol_table.count - 1) / (f64)buffer->gap_buffer.count() : 0.0;
+			file_offset = find_line_block(buffer->line_index, line, lines_per_byte, &exact) * line_index_block_size;
+		} else {
+			bool exact;
+			const u64 num_lines = buffer->get_file_line_count(&exact);
+			file_offset = num_lines ? (u64)((f64)line / (f64)num_lines * (f64)buffer->file_size) : 0;
+		}
+
+		const u64 half_window = large_file_window_size / 2;
+		move_buffer_window(buffer, file_offset > half_window ? file_offset - half_window : 0);
+	}
+
+	u64 buffer_line = line > buffer->window_first_line ? line - buffer->window_first_line : 0;
+	if (buffer_line >= buffer->eol_table.count) buffer_line = buffer->eol_table.count - 1;
+
+	cursor = buffer->get_index_from_line(buffer_line);
+	selection = cursor;
+	update_column_info(true);
+	reset_cursor_timer();
+
+	// A third of the way down so there's some context above it
+	const f32 width = get_view_width((f32)get_viewport_size().ux, this - views.begin());
+	const f32 text_width = width - get_line_number_width(buffer, width);
+	target_scroll_y = get_lines_height(buffer, 0, buffer_line, width, text_width) - get_view_height() / 3.f;
+	if (target_scroll_y < 0.f) target_scroll_y = 0.f;
+}
+
+void Buffer_View::select_and_show(usize start, usize end) {
+	Buffer* const buffer = find_buffer(the_buffer);
+	assert(buffer);
+
+	selection = start;
+	cursor = end;
+	update_column_info(true);
+	reset_cursor_timer();
+
+	const f32 line_height = (f32)the_font.size + the_font.line_gap;
+	const f32 width = get_view_width((f32)get_viewport_size().ux, this - views.begin());
+	const f32 text_width = width - get_line_number_width(buffer, width);
+	const f32 line_y = get_lines_height(buffer, 0, buffer->get_line_from_index(start), width, text_width);
+
+	const f32 view_height = get_view_height();
+	if (line_y >= target_scroll_y && line_y + line_height <= target_scroll_y + view_height) return;
+
+	target_scroll_y = line_y - view_height / 3.f;
+	if (target_scroll_y < 0.f) target_scroll_y = 0.f;
+}
+
+/**
+ * Where a view was looking in the file before its buffer's window moved. Everything is a file offset
+ * so it can be found again in the new window.
+ */
+struct View_Window_Anchor {
+	Buffer_View* view;
+	u64 top_offset;
+	f32 top_y;
+	f32 scroll_lag;
+	u64 cursor;
+	u64 selection;
+};
+
+static u64 window_to_buffer_index(const Buffer* buffer, u64 file_offset) {
+	if (file_offset < buffer->window_offset) return 0;
+
+	const u64 result = file_offset - buffer->window_offset;
+	const usize count = buffer->gap_buffer.count();
+	return result < count ? result : count;
+}
+
+void move_buffer_window(Buffer* buffer, u64 file_offset) {
+	const f32 viewport_width = (f32)get_viewport_size().ux;
+
+	ch::Array<View_Window_Anchor> anchors;
+	anchors.allocator = ch::get_heap_allocator();
+	defer(anchors.free());
+
+	for (usize i = 0; i < views.count; i += 1) {
+		Buffer_View* const view = &views[i];
+		if (view->the_buffer != buffer->id) continue;
+
+		const f32 width = get_view_width(viewport_width, i);
+		const f32 text_width = width - get_line_number_width(buffer, width);
+
+		usize top_line_start;
+		View_Window_Anchor anchor;
+		anchor.view = view;
+		find_first_visible_line(view, buffer, view->target_scroll_y, width, text_width, &top_line_start, &anchor.top_y);
+		anchor.top_offset = buffer->window_offset + top_line_start;
+		anchor.scroll_lag = view->current_scroll_y - view->target_scroll_y;
+		anchor.cursor = buffer->window_offset + view->cursor;
+		anchor.selection = buffer->window_offset + view->selection;
+		anchors.push(anchor);
+	}
+
+	if (!buffer->load_window(file_offset)) return;
+
+	for (usize i = 0; i < anchors.count; i += 1) {
+		const View_Window_Anchor& anchor = anchors[i];
+		Buffer_View* const view = anchor.view;
+
+		const f32 width = get_view_width(viewport_width, view - views.begin());
+		const f32 text_width = width - get_line_number_width(buffer, width);
+
+		// Keep the same line at the top. If it isn't in the new window there's nothing to line up with
+		const u64 window_end = buffer->window_offset + buffer->gap_buffer.count();
+		if (anchor.top_offset >= buffer->window_offset && anchor.top_offset <= window_end) {
+			const usize top_line = buffer->get_line_from_index(anchor.top_offset - buffer->window_offset);
+			view->target_scroll_y = get_lines_height(buffer, 0, top_line, width, text_width) - anchor.top_y;
+			view->current_scroll_y = view->target_scroll_y + anchor.scroll_lag;
+		} else {
+			view->target_scroll_y = 0.f;
+			view->current_scroll_y = 0.f;
+		}
+
+		// Cursors outside the window are held at its edge
+		view->cursor = window_to_buffer_index(buffer, anchor.cursor);
+		view->selection = window_to_buffer_index(buffer, anchor.selection);
+		view->update_column_info();
+	}
+}
+
+/** Moves the window of a windowed buffer once the view scrolls near either end of it. */
+static void page_buffer_window(Buffer_View* view, Buffer* buffer, f32 width) {
+	const f32 text_width = width - get_line_number_width(buffer, width);
+
+	usize top_line_start;
+	f32 top_y;
+	const usize top_line = find_first_visible_line(view, buffer, view->target_scroll_y, width, text_width, &top_line_start, &top_y);
+
+	const usize num_lines = buffer->eol_table.count;
+	const bool near_start = buffer->window_offset > 0 && top_line < num_lines / 8;
+	const bool near_end = buffer->window_offset + buffer->gap_buffer.count() < buffer->file_size && top_line > num_lines * 5 / 8;
+	if (!near_start && !near_end) return;
+
+	// Centered on the top of the view, so there's half a window of room either way
+	const u64 top_offset = buffer->window_offset + top_line_start;
+	const u64 half_window = large_file_window_size / 2;
+	move_buffer_window(buffer, top_offset > half_window ? top_offset - half_window : 0);
+}
+
 void tick_views(f32 dt) {
 	f32 x = 0.f;
-	const ch::Vector2 viewport_size = the_window.get_viewport_size();
+	const ch::Vector2 viewport_size = get_viewport_size();
 	const f32 viewport_width = (f32)viewport_size.ux;
 	const f32 viewport_height = (f32)viewport_size.uy;
 	const ch::Vector2 mouse_pos = current_mouse_position;
@@ -579,20 +1054,145 @@ void tick_views(f32 dt) {
 
 		parsing::parse_cpp(the_buffer);
 
-		const float powerline_padding = 2.f;
-		const float powerline_height = (float)the_font.size + the_font.line_gap;
+		const f32 x0 = x;
+		const f32 y0 = 0.f;
+		const f32 x1 = x0 + get_view_width(viewport_width, i);
+		const f32 y1 = viewport_height - (get_powerline_height() + powerline_padding * 2.f);
+
+		if (is_point_in_rect(mouse_pos, x0, y0, x1, y1) && !(view->target_scroll_y == 0.f && current_mouse_scroll_y > 0.f)) view->target_scroll_y -= current_mouse_scroll_y;
+
+		// @TODO(CHall): Calculate max buffer size
+		if (view->target_scroll_y < 0.f) {
+			view->target_scroll_y = 0.f;
+		}
+
+		view->current_scroll_y = ch::interp_to(view->current_scroll_y, view->target_scroll_y, dt, config.scroll_speed);
+
+		// Snap once we're within half a pixel so a settled view stops asking to be redrawn
+		const f32 scroll_left = view->target_scroll_y - view->current_scroll_y;
+		if (scroll_left > -0.5f && scroll_left < 0.5f) view->current_scroll_y = view->target_scroll_y;
+
+		if ((the_buffer->flags & BF_Windowed) == BF_Windowed) page_buffer_window(view, the_buffer, x1 - x0);
+
+		x += get_view_width(viewport_width, i);
+	}
+}
+
+static View_Draw_State get_view_draw_state(const Buffer_View* view, f32 x0, f32 x1) {
+	const Buffer* const buffer = find_buffer(view->the_buffer);
+	assert(buffer);
+
+	View_Draw_State result;
+	result.the_buffer = view->the_buffer;
+	result.buffer_version = buffer->version;
+	result.buffer_is_dirty = buffer->is_dirty;
+	result.save_status = buffer->save_status;
+	result.scroll_y = view->current_scroll_y;
+	result.cursor = view->cursor;
+	result.selection = view->selection;
+	result.show_cursor = view->show_cursor;
+	result.prompt_version = view == get_focused_view() && is_prompt_active() ? get_prompt_version() : 0;
+	result.picker_version = view == get_focused_view() && is_file_picker_active() ? get_file_picker_version() : 0;
+	const usize* matches;
+	usize match_size;
+	result.search_version = get_search_matches(view->the_buffer, &matches, &match_size) ? get_search_version() : 0;
+	result.x0 = x0;
+	result.x1 = x1;
+	return result;
+}
+
+/** Everything outside of the views that affects how all of them look. */
+struct Layout_Draw_State {
+	ch::Vector2 viewport_size;
+	u16 font_size = 0;
+	u32 atlas_version = 0;
+	u32 theme_version = 0;
+	usize num_views = 0;
+
+	bool operator==(const Layout_Draw_State& other) const {
+		return viewport_size.ux == other.viewport_size.ux && viewport_size.uy == other.viewport_size.uy && font_size == other.font_size && atlas_version == other.atlas_version && theme_version == other.theme_version && num_views == other.num_views;
+	}
+};
+
+static Layout_Draw_State last_drawn_layout;
+
+static Layout_Draw_State get_layout_draw_state() {
+	Layout_Draw_State result;
+	result.viewport_size = get_viewport_size();
+	result.font_size = the_font.size;
+	result.atlas_version = the_font.atlas_version;
+	result.theme_version = get_theme_version();
+	result.num_views = views.count;
+	return result;
+}
+
+static bool does_view_need_redraw(usize i, f32 x0, f32 x1, f32 viewport_height) {
+	const Buffer_View* const view = &views[i];
+	if (!(get_view_draw_state(view, x0, x1) == view->last_drawn)) return true;
+
+	// Mouse input is only handled while drawing, so any that lands on the view has to draw it.
+	const ch::Vector2 mouse_pos = current_mouse_position;
+	if (!is_point_in_rect(mouse_pos, x0, 0.f, x1, viewport_height)) return false;
+
+	const bool mouse_moved = mouse_pos.x != last_mouse_position.x || mouse_pos.y != last_mouse_position.y;
+	return was_mouse_button_pressed(CH_MOUSE_LEFT) || was_mouse_button_released(CH_MOUSE_LEFT) || (is_mouse_button_down(CH_MOUSE_LEFT) && mouse_moved);
+}
+
+bool views_need_redraw() {
+	const ch::Vector2 viewport_size = get_viewport_size();
+	const f32 viewport_width = (f32)viewport_size.ux;
+	const f32 viewport_height = (f32)viewport_size.uy;
+
+	if (!viewport_width || !viewport_height) return false;
+	if (!(get_layout_draw_state() == last_drawn_layout)) return true;
+
+	f32 x = 0.f;
+	for (usize i = 0; i < views.count; i += 1) {
+		const f32 x1 = x + get_view_width(viewport_width, i);
+		if (does_view_need_redraw(i, x, x1, viewport_height)) return true;
+		x = x1;
+	}
+
+	return false;
+}
+
+void draw_views(bool force_redraw) {
+	f32 x = 0.f;
+	const ch::Vector2 viewport_size = get_viewport_size();
+	const f32 viewport_width = (f32)viewport_size.ux;
+	const f32 viewport_height = (f32)viewport_size.uy;
+
+    if (!viewport_width || !viewport_height) return;
+
+	const Config& config = get_config();
+
+	// Anything that moves every view around means nothing we kept is any good.
+	const Layout_Draw_State layout = get_layout_draw_state();
+	if (!(layout == last_drawn_layout)) force_redraw = true;
+	last_drawn_layout = layout;
+
+	for (usize i = 0; i < views.count; i += 1) {
+		Buffer_View* const view = &views[i];
+		Buffer* const the_buffer = find_buffer(view->the_buffer);
+		assert(the_buffer);
+
+		const f32 view_x0 = x;
+		const f32 view_x1 = x + get_view_width(viewport_width, i);
+		x = view_x1;
+
+		if (!force_redraw && !does_view_need_redraw(i, view_x0, view_x1, viewport_height)) continue;
+
+		begin_dirty_rect(view_x0, 0.f, view_x1, viewport_height);
+
+		const float powerline_height = get_powerline_height();
 
 		// @NOTE(CHall): Draw buffer
 		{
-			const f32 x0 = x;
+			const f32 x0 = view_x0;
 			const f32 y0 = 0.f;
-			const f32 x1 = x0 + get_view_width(viewport_width, i);
+			const f32 x1 = view_x1;
 			const f32 y1 = viewport_height - (powerline_height + powerline_padding * 2.f);
 
-			if (is_point_in_rect(mouse_pos, x0, y0, x1, y1) && !(view->target_scroll_y == 0.f && current_mouse_scroll_y > 0.f)) view->target_scroll_y -= current_mouse_scroll_y;
-
-			view->current_scroll_y = ch::interp_to(view->current_scroll_y, view->target_scroll_y, dt, config.scroll_speed);
-
 			gui_button(the_buffer, 0.f, 0.f, 100.f, 100.f);
 
 			gui_buffer_view(view, view, x0, y0, x1, y1);
@@ -600,9 +1200,9 @@ void tick_views(f32 dt) {
 
 		// @NOTE(CHall): Draw powerline
 		{
-			const f32 x0 = x;
+			const f32 x0 = view_x0;
 			const f32 y0 = viewport_height - powerline_height - powerline_padding;
-			const f32 x1 = x0 + get_view_width(viewport_width, i);
+			const f32 x1 = view_x1;
 			const f32 y1 = y0 + powerline_height + powerline_padding;
 
 			imm_quad(x0, y0, x1, y1, config.foreground_color);
@@ -613,44 +1213,98 @@ void tick_views(f32 dt) {
 				const f32 horz_padding = 10.f;
 
 				const usize current_column = view->current_column + 1;
-				const usize current_line = view->current_line + 1;
-				const usize num_lines = the_buffer->eol_table.count;
-
-				u64 total_col = 0;
-				u64 cursor_col = 0;
-				for (usize i = 0; i < the_buffer->line_column_table.count; i += 1) {
-					const u64 col = the_buffer->line_column_table[i];
-
-					if (i == view->current_line) {
-						cursor_col = total_col + view->current_column;
+				const usize current_line = the_buffer->window_first_line + view->current_line + 1;
+
+				bool is_line_count_exact;
+				const u64 num_lines = the_buffer->get_file_line_count(&is_line_count_exact);
+
+				f32 percent_through_file = 0.f;
+				if ((the_buffer->flags & BF_Windowed) == BF_Windowed) {
+					// Walking the columns of the whole file isn't an option, bytes are close enough
+					percent_through_file = ((f32)(the_buffer->window_offset + view->cursor) / (f32)the_buffer->file_size) * 100.f;
+				} else if (the_buffer->is_following) {
+					// Redrawn on every append, so the same goes for a log that keeps growing
+					const usize count = the_buffer->gap_buffer.count();
+					percent_through_file = count ? ((f32)view->cursor / (f32)count) * 100.f : 0.f;
+				} else {
+					u64 total_col = 0;
+					u64 cursor_col = 0;
+					for (usize i = 0; i < the_buffer->line_column_table.count; i += 1) {
+						const u64 col = the_buffer->line_column_table[i];
+
+						if (i == view->current_line) {
+							cursor_col = total_col + view->current_column;
+						}
+
+						total_col += col;
 					}
-
-					total_col += col;
+					percent_through_file = total_col ? ((f32)cursor_col / (f32)total_col) * 100.f : 0.f;
 				}
-				const f32 percent_through_file = total_col ? ((f32)cursor_col / (f32)total_col) * 100.f : 0.f;
+				const char* line_prefix = the_buffer->window_line_is_exact ? "" : "~";
+				const char* num_lines_prefix = is_line_count_exact ? "" : "~";
 
 				const char* line_ending = get_line_ending_display(the_buffer->line_ending);
 				const char* encoding = get_buffer_encoding_display(the_buffer->encoding);
 
 				const bool is_read_only = (the_buffer->flags & BF_ReadOnly) == BF_ReadOnly;
 				char buffer[512];
-				ch::sprintf(buffer, "%s | %s | %llu:%llu | %.0f%% | %llu lines%s", line_ending, encoding, current_line, current_column, percent_through_file, num_lines, is_read_only ? " | read-only" : "");
+				ch::sprintf(buffer, "%s | %s | %s%llu:%llu | %.0f%% | %s%llu lines%s%s", line_ending, encoding, line_prefix, current_line, current_column, percent_through_file, num_lines_prefix, num_lines, is_read_only ? " | read-only" : "", the_buffer->is_following ? " | following" : "");
 
 				const ch::Vector2 fi_size = get_string_draw_size(buffer, the_font);
 				imm_string(buffer, the_font, x1 - fi_size.x - horz_padding, text_y, config.background_color);
 
-				ch::sprintf(buffer, "%.*s%s", the_buffer->name.count, the_buffer->name.data, the_buffer->is_dirty ? "*" : "");
-				imm_string(buffer, the_font, x0 + horz_padding, text_y, config.background_color);
+				if (view == get_focused_view() && is_prompt_active()) {
+					ch::sprintf(buffer, "%s%s", get_prompt_label(), get_prompt_text());
+					const ch::Vector2 prompt_size = imm_string(buffer, the_font, x0 + horz_padding, text_y, config.background_color);
+
+					const f32 cursor_x = x0 + horz_padding + prompt_size.x;
+					imm_quad(cursor_x, text_y, cursor_x + the_font[' ']->advance, text_y + powerline_height, config.background_color);
+				} else {
+					ch::sprintf(buffer, "%.*s%s%s", the_buffer->name.count, the_buffer->name.data, the_buffer->is_dirty ? "*" : "", get_save_status_display(the_buffer->save_status));
+					imm_string(buffer, the_font, x0 + horz_padding, text_y, config.background_color);
+				}
 			}
-		}
 
-		// @TODO(CHall): Calculate max buffer size
+			// File picker matches stack up from the powerline, best one nearest the prompt
+			if (view == get_focused_view() && is_file_picker_active()) {
+				const Project_Match* matches;
+				const usize num_matches = get_file_picker_matches(&matches);
+				const usize selection = get_file_picker_selection();
 
-		if (view->target_scroll_y < 0.f) {
-			view->target_scroll_y = 0.f;
+				const usize max_shown = (usize)(y0 / powerline_height);
+				const usize num_shown = num_matches < max_shown ? num_matches : max_shown;
+				for (usize i = 0; i < num_shown; i += 1) {
+					const f32 match_y0 = y0 - (f32)(i + 1) * powerline_height;
+					const bool is_selected = i == selection;
+
+					imm_quad(x0, match_y0, x1, match_y0 + powerline_height, is_selected ? config.selection_color : config.line_number_background_color);
+
+					char path[1024];
+					ch::sprintf(path, "%.*s", (int)(matches[i].path_len < 1000 ? matches[i].path_len : 1000), matches[i].path);
+					imm_string(path, the_font, x0 + 10.f, match_y0, is_selected ? config.selected_text_color : config.foreground_color);
+				}
+			}
 		}
 
-		x += get_view_width(viewport_width, i);
+		view->last_drawn = get_view_draw_state(view, view_x0, view_x1);
+	}
+}
+
+static usize remap_index(usize index, usize start, usize old_end, usize new_end) {
+	if (index >= old_end) return index - old_end + new_end;
+	// Anything inside the replaced lines goes to the start of them, it's the only spot known to still be a char boundary
+	if (index > start) return start;
+	return index;
+}
+
+void on_buffer_region_replaced(Buffer_ID the_buffer, usize start, usize old_end, usize new_end) {
+	for (usize i = 0; i < views.count; i += 1) {
+		Buffer_View& view = views[i];
+		if (view.the_buffer != the_buffer) continue;
+
+		view.cursor = remap_index(view.cursor, start, old_end, new_end);
+		view.selection = remap_index(view.selection, start, old_end, new_end);
+		view.update_column_info();
 	}
 }
 
@@ -662,6 +1316,37 @@ Buffer_View* get_focused_view() {
 	return nullptr;
 }
 
+void show_buffer(Buffer_View* view, Buffer_ID the_buffer) {
+	view->the_buffer = the_buffer;
+	view->cursor = 0;
+	view->selection = 0;
+	view->target_scroll_y = 0.f;
+	view->current_scroll_y = 0.f;
+	// The top of the first line is the only anchor that's good for any buffer
+	view->scroll_anchor_line = 0;
+	view->scroll_anchor_start = 0;
+	view->scroll_anchor_y = 0.f;
+	view->update_column_info(true);
+	view->reset_cursor_timer();
+}
+
+void show_loaded_buffer(Buffer_ID the_buffer) {
+	Buffer_View* const view = get_focused_view();
+	if (!view) return;
+
+	const Buffer_ID old_buffer = view->the_buffer;
+	show_buffer(view, the_buffer);
+
+	const Buffer* const old = find_buffer(old_buffer);
+	if (!old || (old->flags & BF_File) == BF_File || old->is_dirty || old->gap_buffer.count()) return;
+
+	// Other views may still be looking at it
+	for (usize i = 0; i < views.count; i += 1) {
+		if (views[i].the_buffer == old_buffer) return;
+	}
+	remove_buffer(old_buffer);
+}
+
 usize push_view(Buffer_ID the_buffer) {
 	Buffer_View view = {};
 	view.the_buffer = the_buffer;
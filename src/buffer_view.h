@@ -4,6 +4,32 @@
 
 const f32 min_width_ratio = 0.2f;
 
+/**
+ * Everything a view's pixels depend on, snapshotted when it was last drawn.
+ * If nothing here changed the view is left alone and the retained backbuffer is reused.
+ */
+struct View_Draw_State {
+	Buffer_ID the_buffer = invalid_buffer_id;
+	u64 buffer_version = 0;
+	bool buffer_is_dirty = false;
+	Save_Status save_status = SS_None;
+	f32 scroll_y = 0.f;
+	usize cursor = 0;
+	usize selection = 0;
+	bool show_cursor = false;
+	u32 prompt_version = 0;
+	u32 picker_version = 0;
+	u32 search_version = 0;
+	f32 x0 = 0.f;
+	f32 x1 = 0.f;
+
+	CH_FORCEINLINE bool operator==(const View_Draw_State& other) const {
+		return the_buffer == other.the_buffer && buffer_version == other.buffer_version && buffer_is_dirty == other.buffer_is_dirty && save_status == other.save_status && 
+			scroll_y == other.scroll_y && cursor == other.cursor && selection == other.selection && show_cursor == other.show_cursor && prompt_version == other.prompt_version && picker_version == other.picker_version && search_version == other.search_version && 
+			x0 == other.x0 && x1 == other.x1;
+	}
+};
+
 struct Buffer_View {
 	Buffer_ID the_buffer = 0;
 	f32 width_ratio = 0.5f;
@@ -21,6 +47,24 @@ struct Buffer_View {
 	bool show_cursor = true;
 	f32 cursor_blink_time = 0.f;
 
+	/** Where the last line started when last drawn, relative to the top of the view. Only set if it was on screen. */
+	bool end_in_view = false;
+	f32 last_line_y = 0.f;
+
+	/**
+	 * A line the last search for the first visible line landed on and how far down the buffer it starts, so the
+	 * next one walks from there instead of from the top. Good for as long as the buffer's version and the layout match.
+	 */
+	usize scroll_anchor_line = 0;
+	usize scroll_anchor_start = 0;
+	f32 scroll_anchor_y = 0.f;
+	u64 scroll_anchor_version = 0;
+	f32 scroll_anchor_width = 0.f;
+	f32 scroll_anchor_text_width = 0.f;
+	f32 scroll_anchor_line_height = 0.f;
+
+	View_Draw_State last_drawn;
+
 	CH_FORCEINLINE bool has_selection() const { return cursor != selection; }
 
 	CH_FORCEINLINE void reset_cursor_timer() {
@@ -39,12 +83,60 @@ struct Buffer_View {
 	void ensure_cursor_in_view();
 
 	void on_char_entered(u32 c);
+
+	/**
+	 * Puts the cursor at the start of line and scrolls it into view. Lines count from the start of the file,
+	 * windowed buffers are moved to the window it's in.
+	 */
+	void jump_to_line(u64 line);
+
+	/** Selects [start, end) with the cursor at end. Scrolls it a third of the way down if it's off screen. */
+	void select_and_show(usize start, usize end);
 };
 
+/** Updates cursor blink, parsing and scrolling for every view. Does no drawing. */
 void tick_views(f32 dt);
 
+/** @returns true if any view changed since it was last drawn. */
+bool views_need_redraw();
+
+/**
+ * Draws the views that changed since they were last drawn.
+ *
+ * @param force_redraw draws every view, used when the backbuffer contents were lost
+ */
+void draw_views(bool force_redraw);
+
 Buffer_View* get_focused_view();
 
+/** Moves the cursors of views on the_buffer after the bytes [start, old_end) were replaced with [start, new_end). */
+void on_buffer_region_replaced(Buffer_ID the_buffer, usize start, usize old_end, usize new_end);
+
+/**
+ * Moves the cursors at old_count to the new end of the_buffer after something was appended to it.
+ * If the buffer is being followed those views also scroll to keep the end in view.
+ *
+ * @param first_line is the first line that was measured again, the one that was last before the append
+ */
+void on_buffer_appended(Buffer_ID the_buffer, usize old_count, usize first_line);
+
+/** Switches view over to the_buffer, starting from the top. */
+void show_buffer(Buffer_View* view, Buffer_ID the_buffer);
+
+/** Shows a buffer that just finished loading in the focused view. An untouched scratch buffer it replaces is closed. */
+void show_loaded_buffer(Buffer_ID the_buffer);
+
+/** Puts the cursor at the end of the view's buffer and scrolls the end into view. */
+void follow_buffer_end(Buffer_View* view);
+
+/**
+ * Moves the window of a windowed buffer to file_offset. Views on it keep the same line at the top and
+ * their cursors on the same bytes, as far as the new window allows.
+ *
+ * @see Buffer::load_window
+ */
+void move_buffer_window(Buffer* buffer, u64 file_offset);
+
 usize push_view(Buffer_ID the_buffer);
 usize insert_view(Buffer_ID the_buffer, usize index);
 bool remove_view(usize view_index);
@@ -1,5 +1,6 @@
 #include "config.h"
 #include "editor.h"
+#include "parsing.h"
 
 #include <ch_stl/filesystem.h>
 
@@ -15,6 +16,34 @@ const Config& get_config() {
 	return default_config;
 }
 
+static ch::Color theme[parsing::SS_COUNT];
+static u32 theme_version;
+
+static void refresh_theme(const Config& config) {
+	theme[parsing::SS_DEFAULT]   = config.foreground_color;
+	theme[parsing::SS_KEYWORD]   = config.syntax_keyword_color;
+	theme[parsing::SS_TYPE]      = config.syntax_type_color;
+	theme[parsing::SS_FUNCTION]  = config.syntax_function_color;
+	theme[parsing::SS_PARAM]     = config.syntax_param_color;
+	theme[parsing::SS_PREPROC]   = config.syntax_preproc_color;
+	theme[parsing::SS_MACRO]     = config.syntax_macro_color;
+	theme[parsing::SS_STRINGLIT] = config.syntax_string_color;
+	theme[parsing::SS_NUMLIT]    = config.syntax_number_color;
+	theme[parsing::SS_COMMENT]   = config.syntax_comment_color;
+	theme[parsing::SS_OP]        = config.syntax_operator_color;
+	theme[parsing::SS_LABEL]     = config.syntax_label_color;
+
+	theme_version += 1;
+}
+
+const ch::Color* get_theme() {
+	return theme;
+}
+
+u32 get_theme_version() {
+	return theme_version;
+}
+
 template <typename T>
 static bool parse_type(ch::String& v, T* t) {
 	static_assert(false, "Config var type has no parse code");
@@ -151,6 +180,7 @@ void init_config() {
 	}
 
 	loaded_config = new_conf;
+	refresh_theme(*loaded_config);
 }
 
 void try_refresh_config() {
@@ -4,16 +4,32 @@
 
 #define CONFIG_VAR(macro) \
 macro(u16, font_size, 24) \
+macro(bool, font_sdf, false) \
 macro(ch::Color, background_color, 0x052329FF) \
 macro(ch::Color, foreground_color, 0xD6B58DFF) \
 macro(ch::Color, cursor_color, 0x81E38EFF) \
 macro(ch::Color, selection_color, 0x000EFFFF) \
 macro(ch::Color, selected_text_color, ch::white) \
+macro(ch::Color, search_match_color, 0x2A5A1FFF) \
 macro(bool, show_line_numbers, true) \
 macro(ch::Color, line_number_background_color, 0x041E24FF) \
 macro(ch::Color, line_number_text_color, 0x083945FF) \
 macro(f32, scroll_speed, 50.f) \
 macro(u16, tab_width, 4) \
+macro(ch::Color, syntax_keyword_color, 0xFFFFFFFF) \
+macro(ch::Color, syntax_type_color, 0x00B2E5FF) \
+macro(ch::Color, syntax_function_color, 0x19FF99FF) \
+macro(ch::Color, syntax_param_color, 0xFF9920FF) \
+macro(ch::Color, syntax_preproc_color, 0x19FF99FF) \
+macro(ch::Color, syntax_macro_color, 0x7F7FFFFF) \
+macro(ch::Color, syntax_string_color, 0xFFFF33FF) \
+macro(ch::Color, syntax_number_color, 0x7F7FFFFF) \
+macro(ch::Color, syntax_comment_color, 0x4C4C4CFF) \
+macro(ch::Color, syntax_operator_color, 0xB2B2B2FF) \
+macro(ch::Color, syntax_label_color, 0xB2B2B2FF) \
+macro(u32, glyph_cache_budget_kb, 16384) \
+macro(u32, atlas_idle_timeout_s, 60) \
+macro(u32, large_file_threshold_mb, 256) \
 macro(u32, last_window_width, 1920) \
 macro(u32, last_window_height, 1080) \
 macro(bool, was_maximized, false)
@@ -28,6 +44,15 @@ extern Config default_config;
 
 const Config& get_config();
 
+/**
+ * Colour table for syntax highlighting, indexed by parsing::Syntax_Style.
+ * Built from the syntax_*_color config vars whenever the config is loaded.
+ */
+const ch::Color* get_theme();
+
+/** Bumped every time the theme table changes so cached geometry can be invalidated. */
+u32 get_theme_version();
+
 void init_config();
 void try_refresh_config();
 void shutdown_config();
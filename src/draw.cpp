@@ -2,99 +2,545 @@
 #include "editor.h"
 #include "gui.h"
 #include "config.h"
+#include "os.h"
 
 #include <ch_stl/filesystem.h>
+#include <ch_stl/memory.h>
+#include <ch_stl/time.h>
+
+#include <string.h>
 
 #define STB_RECT_PACK_IMPLEMENTATION
 #include <stb/stb_rect_pack.h>
 #define STB_TRUETYPE_IMPLEMENTATION
 #include <stb/stb_truetype.h>
 
-struct Bitmap {
-	s32 width, height;
-	u8* data;
+Font* bound_font;
+
+static CH_FORCEINLINE u16 read_u16_be(const u8* p) {
+	return (u16)((p[0] << 8) | p[1]);
+}
+
+static CH_FORCEINLINE u32 read_u32_be(const u8* p) {
+	return ((u32)p[0] << 24) | ((u32)p[1] << 16) | ((u32)p[2] << 8) | (u32)p[3];
+}
+
+static void map_codepoint(Font* font, u32 codepoint, u32 glyph_index) {
+	if (!glyph_index || glyph_index >= font->num_font_glyphs) return;
+	font->codepoints[glyph_index] = (s32)codepoint;
+	font->add_glyph_index(codepoint, (u16)glyph_index);
+}
+
+/**
+ * Walks the unicode cmap subtable STBTT picked and maps every codepoint it covers.
+ *
+ * @param data_size is the size of the font file, nothing is read past it
+ * @returns false if the subtable isn't format 4 or 12, or runs off the end of the file
+ */
+static bool parse_cmap(Font* font, usize data_size) {
+	const u8* const data = font->info.data;
+	if (!font->info.index_map || (usize)font->info.index_map + 8 > data_size) return false;
+
+	const u8* const subtable = data + font->info.index_map;
+	const u16 format = read_u16_be(subtable);
+
+	// Bytes the subtable can span, the smaller of what it claims and what's left of the file.
+	usize size = data_size - font->info.index_map;
+
+	switch (format) {
+	case 4: {
+		// Segment mapping to delta values, covers the BMP.
+		const usize length = read_u16_be(subtable + 2);
+		if (length < size) size = length;
+		if (size < 14) return false;
+
+		const u32 seg_count_x2 = read_u16_be(subtable + 6);
+		const usize end_codes = 14;
+		const usize start_codes = end_codes + seg_count_x2 + 2;
+		const usize id_deltas = start_codes + seg_count_x2;
+		const usize id_range_offsets = id_deltas + seg_count_x2;
+		if (seg_count_x2 & 1 || id_range_offsets + seg_count_x2 > size) return false;
+
+		for (u32 seg = 0; seg < seg_count_x2; seg += 2) {
+			const u32 start = read_u16_be(subtable + start_codes + seg);
+			const u32 end = read_u16_be(subtable + end_codes + seg);
+			const u16 delta = read_u16_be(subtable + id_deltas + seg);
+			const u16 range_offset = read_u16_be(subtable + id_range_offsets + seg);
+
+			for (u32 c = start; c <= end && c < 0xFFFF; c += 1) {
+				u32 glyph_index;
+				if (!range_offset) {
+					glyph_index = (u16)(c + delta);
+				} else {
+					// The offset is relative to where it's stored, a quirk of the format.
+					const usize glyph_index_offset = id_range_offsets + seg + range_offset + (c - start) * 2;
+					if (glyph_index_offset + 2 > size) return false;
+					glyph_index = read_u16_be(subtable + glyph_index_offset);
+					if (glyph_index) glyph_index = (u16)(glyph_index + delta);
+				}
+
+				map_codepoint(font, c, glyph_index);
+			}
+		}
+	} return true;
+	case 12: {
+		// Segmented coverage, groups of sequential codepoints mapped to sequential glyphs.
+		if (size < 16) return false;
+		const usize length = read_u32_be(subtable + 4);
+		if (length < size) size = length;
+
+		const u32 num_groups = read_u32_be(subtable + 12);
+		if (size < 16 || num_groups > (size - 16) / 12) return false;
+		const u8* group = subtable + 16;
+
+		for (u32 i = 0; i < num_groups; i += 1, group += 12) {
+			const u32 start = read_u32_be(group);
+			u32 end = read_u32_be(group + 4);
+			const u32 start_glyph = read_u32_be(group + 8);
+			if (end > 0x10FFFF) end = 0x10FFFF;
+
+			for (u32 c = start; c <= end; c += 1) {
+				map_codepoint(font, c, start_glyph + (c - start));
+			}
+		}
+	} return true;
+	}
+
+	return false;
+}
+
+// Pages start small and double in height as glyphs get used, up to this.
+#define MAX_ATLAS_PAGE_HEIGHT 4096
+#define MIN_ATLAS_PAGE_HEIGHT 64
+
+// Shelf heights are rounded up to this so glyphs of similar heights share shelves.
+#define ATLAS_SHELF_GRANULARITY 4
+
+/* GLYPH CACHE */
+
+// Sits next to .edenconfig. Holds one font's codepoint tables and every atlas size that was set up when it was written,
+// so a cold start maps it and copies out what it needs instead of parsing the cmap and rasterizing again.
+static const char* font_cache_path = ".edenfontcache";
+
+#define FONT_CACHE_MAGIC 0x43464445 // EDFC
+#define FONT_CACHE_VERSION 2
+
+// Only the font's own glyphs are cached, codepoints that fell through to fallbacks are looked up again next run.
+// Followed by s32 codepoints[num_glyphs], u16 bmp_glyph_indices[num_bmp_codepoints],
+// u32 supplementary codepoints[num_supplementary], u16 their glyph indices[num_supplementary], then the atlases.
+struct Font_Cache_Header {
+	u32 magic;
+	u32 version;
+	u64 font_hash;
+	u32 num_glyphs;
+	u32 num_supplementary;
+	u32 num_atlases;
 };
 
-Font* bound_font;
+// Followed by Font_Glyph glyphs[num_glyphs], Atlas_Shelf shelves[num_shelves] and the w by h page.
+struct Font_Cache_Atlas {
+	u32 size;
+	u32 h_oversample;
+	u32 v_oversample;
+	f32 scale;
+	u32 w;
+	u32 h;
+	u32 num_shelves;
+	u32 next_shelf_y;
+	u32 sdf;
+};
 
-bool load_font_from_path(const ch::Path& path, Font* out_font) {
-	ch::File_Data fd;
-	if (!ch::load_file_into_memory(path, &fd)) return false;
+static Mapped_File font_cache;
+static const u8* cached_atlases[Font::num_atlases];
+
+// Nothing in the cache is aligned so everything is copied out.
+struct Cache_Reader {
+	const u8* at;
+	const u8* end;
+
+	const u8* take(usize size) {
+		if ((usize)(end - at) < size) return nullptr;
+		const u8* const result = at;
+		at += size;
+		return result;
+	}
+};
+
+static u64 hash_font_file(const Mapped_File& file) {
+	// FNV-1a. Fonts are a few hundred KB so this is well under a millisecond.
+	u64 hash = 0xCBF29CE484222325ull;
+	for (usize i = 0; i < file.size; i += 1) {
+		hash ^= file.data[i];
+		hash *= 0x100000001B3ull;
+	}
+	return hash;
+}
+
+static void close_font_cache() {
+	unmap_file(&font_cache);
+	ch::mem_zero(cached_atlases, sizeof(cached_atlases));
+}
 
+// Resident glyphs and shelves have to sit inside the page, or a corrupt cache would have us read and write past it.
+static bool is_cached_atlas_valid(const Font_Cache_Atlas& atlas, const u8* glyphs, u32 num_glyphs, const u8* shelves) {
+	if (atlas.next_shelf_y > atlas.h) return false;
+
+	for (u32 i = 0; i < atlas.num_shelves; i += 1) {
+		Atlas_Shelf shelf;
+		memcpy(&shelf, shelves + i * sizeof(Atlas_Shelf), sizeof(shelf));
+		if (shelf.y > atlas.h || shelf.height > atlas.h - shelf.y || shelf.used_width > atlas.w) return false;
+	}
+
+	for (u32 i = 0; i < num_glyphs; i += 1) {
+		Font_Glyph glyph;
+		memcpy(&glyph, glyphs + i * sizeof(Font_Glyph), sizeof(glyph));
+		if (glyph.shelf == glyph_not_resident) continue;
+		if (glyph.shelf >= atlas.num_shelves) return false;
+		if (glyph.x0 > glyph.x1 || glyph.x1 > atlas.w || glyph.y0 > glyph.y1 || glyph.y1 > atlas.h) return false;
+	}
+
+	return true;
+}
+
+/**
+ * Maps the glyph cache and fills in the font's codepoint tables from it if it was written for this font file.
+ * The cache stays mapped so pack_atlas can pick sizes out of it.
+ *
+ * @returns false if there's no usable cache, the tables are left untouched
+ */
+static bool load_font_cache(Font* font) {
+	close_font_cache();
+	if (!map_file(font_cache_path, &font_cache)) return false;
+
+	Cache_Reader reader = { font_cache.data, font_cache.data + font_cache.size };
+
+	Font_Cache_Header header;
+	const u8* const header_data = reader.take(sizeof(header));
+	if (header_data) memcpy(&header, header_data, sizeof(header));
+	if (!header_data || header.magic != FONT_CACHE_MAGIC || header.version != FONT_CACHE_VERSION ||
+		header.font_hash != font->file_hash || header.num_glyphs != font->num_font_glyphs) {
+		close_font_cache();
+		return false;
+	}
+
+	// Walk the whole file before touching the font so a truncated cache is thrown away as a whole.
+	const u8* const codepoints = reader.take(header.num_glyphs * sizeof(s32));
+	const u8* const bmp_glyph_indices = reader.take(Font::num_bmp_codepoints * sizeof(u16));
+	const u8* const supplementary_codepoints = reader.take(header.num_supplementary * sizeof(u32));
+	const u8* const supplementary_glyph_indices = reader.take(header.num_supplementary * sizeof(u16));
+	bool valid = codepoints && bmp_glyph_indices && supplementary_codepoints && supplementary_glyph_indices;
+
+	for (u32 i = 0; valid && i < header.num_atlases; i += 1) {
+		const u8* const atlas_data = reader.take(sizeof(Font_Cache_Atlas));
+		if (!atlas_data) {
+			valid = false;
+			break;
+		}
+
+		Font_Cache_Atlas atlas;
+		memcpy(&atlas, atlas_data, sizeof(atlas));
+		valid = atlas.size < Font::num_atlases && atlas.h <= MAX_ATLAS_PAGE_HEIGHT && atlas.num_shelves <= MAX_ATLAS_PAGE_HEIGHT / ATLAS_SHELF_GRANULARITY;
+		if (!valid) break;
+
+		const u8* const glyphs = reader.take(header.num_glyphs * sizeof(Font_Glyph));
+		const u8* const shelves = reader.take(atlas.num_shelves * sizeof(Atlas_Shelf));
+		valid = glyphs && shelves && reader.take((usize)atlas.w * atlas.h) && is_cached_atlas_valid(atlas, glyphs, header.num_glyphs, shelves);
+		if (valid) cached_atlases[atlas.size] = atlas_data;
+	}
+
+	if (!valid) {
+		close_font_cache();
+		return false;
+	}
+
+	memcpy(font->codepoints, codepoints, header.num_glyphs * sizeof(s32));
+	memcpy(font->bmp_glyph_indices, bmp_glyph_indices, Font::num_bmp_codepoints * sizeof(u16));
+	for (u32 i = 0; i < header.num_supplementary; i += 1) {
+		u32 c;
+		u16 glyph_index;
+		memcpy(&c, supplementary_codepoints + i * sizeof(u32), sizeof(u32));
+		memcpy(&glyph_index, supplementary_glyph_indices + i * sizeof(u16), sizeof(u16));
+		font->add_glyph_index(c, glyph_index);
+	}
+
+	return true;
+}
+
+// @returns the cached atlas for this size if it was rasterized the same way, nullptr otherwise
+static const u8* find_cached_atlas(u16 size, f32 scale, u32 h_oversample, u32 v_oversample, bool sdf, Font_Cache_Atlas* out_atlas) {
+	const u8* const atlas_data = cached_atlases[size];
+	if (!atlas_data) return nullptr;
+
+	memcpy(out_atlas, atlas_data, sizeof(Font_Cache_Atlas));
+	if (out_atlas->scale != scale || out_atlas->h_oversample != h_oversample || out_atlas->v_oversample != v_oversample) return nullptr;
+	if ((out_atlas->sdf != 0) != sdf) return nullptr;
+
+	return atlas_data;
+}
+
+void save_font_cache(const Font& font) {
+	// Windows won't let a mapped file be replaced, and nothing still points into it once sizes are packed.
+	close_font_cache();
+
+	// Sizes still waiting on workers have glyphs that don't live in their page yet.
+	Font_Cache_Header header = {};
+	header.magic = FONT_CACHE_MAGIC;
+	header.version = FONT_CACHE_VERSION;
+	header.font_hash = font.file_hash;
+	header.num_glyphs = font.num_font_glyphs;
+	for (u32 i = 0; i < font.supplementary_capacity; i += 1) {
+		if (font.supplementary_codepoints[i] && font.supplementary_glyph_indices[i] < font.num_font_glyphs) header.num_supplementary += 1;
+	}
+	for (u16 i = 0; i < Font::num_atlases; i += 1) {
+		if (font.atlases[i].w && !font.atlases[i].num_pending_batches) header.num_atlases += 1;
+	}
+
+	// Fallback results are dropped, the glyphs they point at aren't cached.
+	u16* const bmp_glyph_indices = ch_new u16[Font::num_bmp_codepoints];
+	defer(ch_delete[] bmp_glyph_indices);
+	for (u32 i = 0; i < Font::num_bmp_codepoints; i += 1) {
+		const u16 it = font.bmp_glyph_indices[i];
+		bmp_glyph_indices[i] = it < font.num_font_glyphs ? it : 0;
+	}
+
+	u32* const supplementary_codepoints = ch_new u32[header.num_supplementary];
+	u16* const supplementary_glyph_indices = ch_new u16[header.num_supplementary];
+	defer(ch_delete[] supplementary_codepoints);
+	defer(ch_delete[] supplementary_glyph_indices);
+	u32 num_supplementary = 0;
+	for (u32 i = 0; i < font.supplementary_capacity; i += 1) {
+		if (!font.supplementary_codepoints[i] || font.supplementary_glyph_indices[i] >= font.num_font_glyphs) continue;
+		supplementary_codepoints[num_supplementary] = font.supplementary_codepoints[i];
+		supplementary_glyph_indices[num_supplementary] = font.supplementary_glyph_indices[i];
+		num_supplementary += 1;
+	}
+
+	// The tables plus four spans for each atlas.
+	Font_Cache_Atlas* const cached = ch_new Font_Cache_Atlas[Font::num_atlases];
+	Write_Span* const spans = ch_new Write_Span[5 + Font::num_atlases * 4];
+	defer(ch_delete[] cached);
+	defer(ch_delete[] spans);
+	u32 num_spans = 0;
+
+	spans[num_spans++] = { &header, sizeof(header) };
+	spans[num_spans++] = { font.codepoints, font.num_font_glyphs * sizeof(s32) };
+	spans[num_spans++] = { bmp_glyph_indices, Font::num_bmp_codepoints * sizeof(u16) };
+	spans[num_spans++] = { supplementary_codepoints, num_supplementary * sizeof(u32) };
+	spans[num_spans++] = { supplementary_glyph_indices, num_supplementary * sizeof(u16) };
+
+	for (u16 i = 0; i < Font::num_atlases; i += 1) {
+		const Font_Atlas& atlas = font.atlases[i];
+		if (!atlas.w || atlas.num_pending_batches) continue;
+
+		Font_Cache_Atlas& it = cached[i];
+		it = {};
+		it.size = i;
+		it.h_oversample = atlas.h_oversample;
+		it.v_oversample = atlas.v_oversample;
+		it.scale = atlas.scale;
+		it.w = atlas.w;
+		it.h = atlas.h;
+		it.num_shelves = atlas.num_shelves;
+		it.next_shelf_y = atlas.next_shelf_y;
+		it.sdf = atlas.sdf;
+
+		spans[num_spans++] = { &it, sizeof(it) };
+		spans[num_spans++] = { atlas.glyphs, font.num_font_glyphs * sizeof(Font_Glyph) };
+		spans[num_spans++] = { atlas.shelves, atlas.num_shelves * sizeof(Atlas_Shelf) };
+		spans[num_spans++] = { atlas.bitmap, atlas.get_page_size() };
+	}
+
+	// Written to the side and renamed over, so a crash halfway leaves last run's cache rather than a torn one.
+	write_file_atomic(font_cache_path, spans, num_spans);
+}
+
+bool load_font_from_path(const ch::Path& path, Font* out_font) {
 	Font font = {};
-	stbtt_InitFont(&font.info, (const u8*)fd.data, stbtt_GetFontOffsetForIndex((const u8*)fd.data, 0));
+	if (!map_file(path, &font.file)) return false;
 
-	font.num_glyphs = font.info.numGlyphs;// @Temporary: info is opaque, but we are peeking :)
+	stbtt_InitFont(&font.info, font.file.data, stbtt_GetFontOffsetForIndex(font.file.data, 0));
+	font.file_hash = hash_font_file(font.file);
 
-	font.codepoints = ch_new int[font.num_glyphs];
-	ch::mem_zero(font.codepoints, font.num_glyphs * sizeof(s32));
-	{
-		u32 glyphs_found = 0;
-		// Ask STBTT for the glyph indices.
-		// @Temporary: linearly search the codepoint space because STBTT doesn't expose CP->glyph idx;
-		//             later we will parse the ttf file in a similar way to STBTT.
-		//             Linear search is exactly 17 times slower than parsing for 65536 glyphs.
+	font.num_font_glyphs = font.info.numGlyphs;// @Temporary: info is opaque, but we are peeking :)
+	font.num_glyphs = font.num_font_glyphs;
+
+	// Glyph indices have to fit in Imm_Instance::rect next to solid_quad_rect.
+	font.glyph_capacity = font.num_font_glyphs + max_fallback_glyphs;
+	if (font.glyph_capacity > solid_quad_rect) font.glyph_capacity = solid_quad_rect;
+	font.fallback_glyphs = ch_new Fallback_Glyph[font.glyph_capacity - font.num_font_glyphs];
+
+	font.codepoints = ch_new int[font.glyph_capacity];
+	ch::mem_zero(font.codepoints, font.glyph_capacity * sizeof(s32));
+	font.bmp_glyph_indices = ch_new u16[Font::num_bmp_codepoints];
+	ch::mem_zero(font.bmp_glyph_indices, Font::num_bmp_codepoints * sizeof(u16));
+	if (!load_font_cache(&font) && !parse_cmap(&font, font.file.size)) {
+		// Font's cmap isn't a format we parse so ask STBTT for every codepoint. This is slow.
 		for (s32 codepoint = 0; codepoint < 0x110000; codepoint++) {
 			const s32 idx = stbtt_FindGlyphIndex(&font.info, codepoint);
 			if (idx <= 0) continue;
-			glyphs_found += 1;
-			font.codepoints[idx] = codepoint;
+			map_codepoint(&font, codepoint, idx);
 		}
 	}
 
-	f64 atlas_area = 0;
-	{
-		s32 x0 = 0;
-		s32 x1 = 0;
-		s32 y0 = 0;
-		s32 y1 = 0;
+	*out_font = font;
+
+	return true;
+}
 
+void add_font_fallback(Font* font, const ch::Path& path) {
+	if (font->num_fallbacks >= max_font_fallbacks) return;
 
-		for (u32 i = 0; (u32)i < font.num_glyphs; i++) {
-			stbtt_GetGlyphBox(&font.info, i, &x0, &y0, &x1, &y1);
+	Font_Fallback& fallback = font->fallbacks[font->num_fallbacks];
+	fallback = {};
+	fallback.path = path;
+	font->num_fallbacks += 1;
+}
+
+// Fibonacci hashing: multiply by 2^32 / golden ratio and keep the top bits. Supplementary codepoints tend to come in
+// dense runs, which the low bits of the product alone wouldn't spread out.
+static CH_FORCEINLINE u32 hash_codepoint(u32 c, u32 shift) {
+	return (c * 2654435769u) >> shift;
+}
+
+u16 Font::find_supplementary_glyph_index(u32 c) const {
+	if (!supplementary_count) return 0;
+
+	const u32 mask = supplementary_capacity - 1;
+	for (u32 i = hash_codepoint(c, supplementary_shift);; i = (i + 1) & mask) {
+		const u32 key = supplementary_codepoints[i];
+		if (key == c) return supplementary_glyph_indices[i];
+		if (!key) return 0;
+	}
+}
+
+void Font::add_glyph_index(u32 c, u16 glyph_index) {
+	if (c < num_bmp_codepoints) {
+		bmp_glyph_indices[c] = glyph_index;
+		return;
+	}
 
-			f64 w = (x1 - x0);
-			f64 h = (y1 - y0);
+	// Keep the table at most half full so probes stay short.
+	if ((supplementary_count + 1) * 2 > supplementary_capacity) {
+		u32* const old_codepoints = supplementary_codepoints;
+		u16* const old_glyph_indices = supplementary_glyph_indices;
+		const u32 old_capacity = supplementary_capacity;
+
+		supplementary_capacity = old_capacity ? old_capacity * 2 : 256;
+		supplementary_shift = old_capacity ? supplementary_shift - 1 : 24;
+		supplementary_codepoints = ch_new u32[supplementary_capacity];
+		supplementary_glyph_indices = ch_new u16[supplementary_capacity];
+		ch::mem_zero(supplementary_codepoints, supplementary_capacity * sizeof(u32));
+		supplementary_count = 0;
+
+		for (u32 i = 0; i < old_capacity; i += 1) {
+			if (old_codepoints[i]) add_glyph_index(old_codepoints[i], old_glyph_indices[i]);
+		}
 
-			atlas_area += w * h;
+		if (old_codepoints) {
+			ch_delete[] old_codepoints;
+			ch_delete[] old_glyph_indices;
 		}
 	}
-	font.atlas_area = atlas_area;
 
-	glGenTextures(Font::num_atlases, font.atlas_ids);
-	
-	*out_font = font;
+	const u32 mask = supplementary_capacity - 1;
+	u32 i = hash_codepoint(c, supplementary_shift);
+	while (supplementary_codepoints[i] && supplementary_codepoints[i] != c) i = (i + 1) & mask;
 
-	return true;
+	if (!supplementary_codepoints[i]) supplementary_count += 1;
+	supplementary_codepoints[i] = c;
+	supplementary_glyph_indices[i] = glyph_index;
 }
 
-const Font_Glyph* Font::operator[](u32 c) const {
-	const s32 idx = stbtt_FindGlyphIndex(&info, c);
-	if (idx > 0) {
-		assert((u32)idx < num_glyphs);
-		return &atlases[size].glyphs[idx];
-	}
+static usize get_glyph_cache_budget() {
+	return (usize)get_config().glyph_cache_budget_kb * 1024;
+}
 
-	return nullptr;
+static bool is_atlas_busy(Font& font, u16 atlas_size);
+static void start_async_rasterization(Font& font, u16 size);
+
+// The font a glyph is rasterized from and its index there. Scale is relative to the font's own.
+struct Glyph_Source {
+	const stbtt_fontinfo* info;
+	u32 index;
+	f32 scale;
+};
+
+static Glyph_Source get_glyph_source(const Font& font, u32 glyph_index) {
+	if (glyph_index < font.num_font_glyphs) return { &font.info, glyph_index, 1.f };
+
+	const Fallback_Glyph& it = font.fallback_glyphs[glyph_index - font.num_font_glyphs];
+	const Font_Fallback& fallback = font.fallbacks[it.fallback];
+	return { &fallback.info, it.glyph_index, fallback.scale };
 }
 
-void Font::pack_atlas() {
-	if (size < 2) size = 2;
-	if (size > 128) size = 128;
+// Works out a glyph's metrics for a size with a page, the same way stbtt_PackFontRanges would have.
+static void make_glyph_metrics(const Font& font, const Font_Atlas& atlas, u32 glyph_index, Font_Glyph* out_glyph) {
+	const Glyph_Source source = get_glyph_source(font, glyph_index);
+	const f32 scale = atlas.scale * source.scale;
+	const u32 h_oversample = atlas.h_oversample;
+	const u32 v_oversample = atlas.v_oversample;
+
+	s32 advance, lsb;
+	stbtt_GetGlyphHMetrics(source.info, source.index, &advance, &lsb);
+
+	s32 x0, y0, x1, y1;
+	stbtt_GetGlyphBitmapBox(source.info, source.index, scale * h_oversample, scale * v_oversample, &x0, &y0, &x1, &y1);
+
+	u32 bitmap_width = 0;
+	u32 bitmap_height = 0;
+	if (x1 > x0 && y1 > y0) {
+		if (atlas.sdf) {
+			// Same box stbtt_GetGlyphSDF makes, the field reaches sdf_padding past the outline.
+			x0 -= sdf_padding;
+			y0 -= sdf_padding;
+			x1 += sdf_padding;
+			y1 += sdf_padding;
+		}
 
-	s32 _ascent, _descent, _line_gap;
-	stbtt_GetFontVMetrics(&info, &_ascent, &_descent, &_line_gap);
+		// Prefiltering widens the bitmap by oversample - 1.
+		bitmap_width = (u32)(x1 - x0) + h_oversample - 1;
+		bitmap_height = (u32)(y1 - y0) + v_oversample - 1;
+	}
 
-	const f32 font_scale = stbtt_ScaleForPixelHeight(&info, size);
-	ascent = (f32)_ascent * font_scale;
-	descent = (f32)_descent * font_scale;
-	line_gap = (f32)_line_gap * font_scale;
+	const f32 sub_x = h_oversample > 1 ? -(f32)(h_oversample - 1) / (2.f * h_oversample) : 0.f;
+	const f32 sub_y = v_oversample > 1 ? -(f32)(v_oversample - 1) / (2.f * v_oversample) : 0.f;
+
+	out_glyph->x0 = 0;
+	out_glyph->y0 = 0;
+	out_glyph->x1 = bitmap_width;
+	out_glyph->y1 = bitmap_height;
+	out_glyph->shelf = glyph_not_resident;
 
-	if (!atlases[size].w) {
+	out_glyph->width = (f32)bitmap_width / (f32)h_oversample;
+	out_glyph->height = (f32)bitmap_height / (f32)v_oversample;
+	out_glyph->bearing_x = (f32)x0 / (f32)h_oversample + sub_x;
+	out_glyph->bearing_y = (f32)y0 / (f32)v_oversample + sub_y;
+	out_glyph->advance = (f32)advance * scale;
+}
 
-		u32 h_oversample = 1; // @NOTE(Phillip): On a low DPI display this looks almost as good to me.
-		u32 v_oversample = 1; //                 The jump from 1x to 4x is way bigger than 4x to 64x.
+// SDF mode sizes without a page use the SDF page's metrics scaled.
+static void scale_sdf_glyph_metrics(const Font_Glyph& sdf_glyph, f32 scale, Font_Glyph* out_glyph) {
+	*out_glyph = {};
+	out_glyph->shelf = glyph_not_resident;
+	out_glyph->width = sdf_glyph.width * scale;
+	out_glyph->height = sdf_glyph.height * scale;
+	out_glyph->bearing_x = sdf_glyph.bearing_x * scale;
+	out_glyph->bearing_y = sdf_glyph.bearing_y * scale;
+	out_glyph->advance = sdf_glyph.advance * scale;
+}
 
+// Sets up the page and metrics for one size, taking it from the glyph cache if it's there.
+static void set_up_atlas(Font& font, u16 size) {
+	Font_Atlas& atlas = font.atlases[size];
+	if (atlas.w) return;
+
+	const f32 font_scale = stbtt_ScaleForPixelHeight(&font.info, size);
+
+	u32 h_oversample = 1; // @NOTE(Phillip): On a low DPI display this looks almost as good to me.
+	u32 v_oversample = 1; //                 The jump from 1x to 4x is way bigger than 4x to 64x.
+
+	// Distance fields filter fine without oversampling.
+	if (!font.sdf) {
 		if (size <= 36) {
 			h_oversample = 2;
 			v_oversample = 2;
@@ -107,384 +553,765 @@ void Font::pack_atlas() {
 			h_oversample = 8;
 			v_oversample = 8;
 		}
+	}
 
-		Bitmap atlas;
+	atlas.scale = font_scale;
+	atlas.h_oversample = h_oversample;
+	atlas.v_oversample = v_oversample;
+	atlas.sdf = font.sdf;
+
+	// Wide enough for a few dozen glyphs a shelf, the height is what grows.
+	u32 page_width = 256;
+	while (page_width < size * h_oversample * 32 && page_width < 2048) page_width *= 2;
+	u32 page_height = MIN_ATLAS_PAGE_HEIGHT;
+
+	Font_Cache_Atlas cached;
+	const u8* const cached_data = find_cached_atlas(size, font_scale, h_oversample, v_oversample, atlas.sdf, &cached);
+	if (cached_data) {
+		page_width = cached.w;
+		page_height = cached.h;
+	}
 
-		if (size <= 12) {
-			atlas.width = 512 * h_oversample;
-			atlas.height = 512 * v_oversample;
+	const usize page_size = (usize)page_width * page_height;
+	while (font.atlas_bytes + page_size > get_glyph_cache_budget()) {
+		// Make room by dropping whichever other size was drawn least recently.
+		u16 lru_size = 0;
+		for (u16 i = 0; i < Font::num_atlases; i += 1) {
+			if (i == size || !font.atlases[i].w || is_atlas_busy(font, i)) continue;
+			if (!lru_size || font.atlases[i].last_used_frame < font.atlases[lru_size].last_used_frame) lru_size = i;
+		}
+		if (!lru_size) break;
+		font.free_atlas(lru_size);
+	}
+
+	atlas.w = page_width;
+	atlas.h = page_height;
+	atlas.bitmap = ch_new u8[page_size];
+	font.atlas_bytes += page_size;
+
+	atlas.max_shelves = MAX_ATLAS_PAGE_HEIGHT / ATLAS_SHELF_GRANULARITY;
+	atlas.shelves = ch_new Atlas_Shelf[atlas.max_shelves];
+	atlas.num_shelves = 0;
+	atlas.next_shelf_y = 0;
+	atlas.last_used_frame = get_draw_frame_index();
+	atlas.last_used_time = ch::get_time_in_seconds();
+	atlas.glyphs = ch_new Font_Glyph[font.glyph_capacity];
+
+	u32 first_new_glyph = 0;
+	if (cached_data) {
+		// Everything that was resident last run comes straight back. Only this size's part of the cache gets read in.
+		const u8* at = cached_data + sizeof(Font_Cache_Atlas);
+		memcpy(atlas.glyphs, at, font.num_font_glyphs * sizeof(Font_Glyph));
+		at += font.num_font_glyphs * sizeof(Font_Glyph);
+		memcpy(atlas.shelves, at, cached.num_shelves * sizeof(Atlas_Shelf));
+		at += cached.num_shelves * sizeof(Atlas_Shelf);
+		memcpy(atlas.bitmap, at, page_size);
+
+		atlas.num_shelves = cached.num_shelves;
+		atlas.next_shelf_y = cached.next_shelf_y;
+		for (u32 i = 0; i < atlas.num_shelves; i += 1) atlas.shelves[i].last_used_frame = 0;
+
+		first_new_glyph = font.num_font_glyphs;
+	} else {
+		ch::mem_zero(atlas.bitmap, page_size);
+	}
+
+	// Metrics are cheap so do them all now. Borrowed glyphs are never cached.
+	for (u32 i = first_new_glyph; i < font.num_glyphs; i++) {
+		make_glyph_metrics(font, atlas, i, &atlas.glyphs[i]);
+	}
+
+	if (!cached_data && !atlas.sdf) start_async_rasterization(font, size);
+
+	get_draw_backend()->upload_atlas(&font, size);
+}
+
+// SDF mode only. Sizes other than sdf_atlas_size are the SDF page's metrics scaled, there's no page or rasterizing.
+static void scale_sdf_metrics(Font& font, u16 size) {
+	Font_Atlas& atlas = font.atlases[size];
+	if (atlas.glyphs) return;
+
+	const Font_Atlas& page = font.atlases[sdf_atlas_size];
+	const f32 scale = (f32)size / (f32)sdf_atlas_size;
+
+	atlas.scale = page.scale * scale;
+	atlas.h_oversample = 1;
+	atlas.v_oversample = 1;
+	atlas.sdf = true;
+	atlas.last_used_frame = get_draw_frame_index();
+	atlas.last_used_time = ch::get_time_in_seconds();
+	atlas.glyphs = ch_new Font_Glyph[font.glyph_capacity];
+
+	for (u32 i = 0; i < font.num_glyphs; i += 1) {
+		scale_sdf_glyph_metrics(page.glyphs[i], scale, &atlas.glyphs[i]);
+	}
+}
+
+u16 Font::resolve_fallback(u32 c) {
+	u16 result = glyph_index_missing;
+
+	for (u32 i = 0; i < num_fallbacks && result == glyph_index_missing; i += 1) {
+		Font_Fallback& fallback = fallbacks[i];
+		if (!fallback.tried_loading) {
+			fallback.tried_loading = true;
+			if (map_file(fallback.path, &fallback.file)) {
+				if (stbtt_InitFont(&fallback.info, fallback.file.data, stbtt_GetFontOffsetForIndex(fallback.file.data, 0))) {
+					fallback.scale = stbtt_ScaleForPixelHeight(&fallback.info, 1.f) / stbtt_ScaleForPixelHeight(&info, 1.f);
+				} else {
+					unmap_file(&fallback.file);
+				}
+			}
 		}
-		else {
-			f64 area = atlas_area * h_oversample * v_oversample;
-			area *= 1.0 + 1 / (ch::sqrt(size)); // fudge factor for small sizes
+		if (!fallback.file.data) continue;
 
-			area *= font_scale * font_scale;
+		const s32 fallback_index = stbtt_FindGlyphIndex(&fallback.info, c);
+		if (fallback_index <= 0) continue;
 
-			const f32 root = ch::sqrt((f32)area);
+		// Out of slots. Growing would mean reallocating every size's glyphs, so treat it as missing.
+		if (num_glyphs >= glyph_capacity) break;
 
-			u32 atlas_dimension = (u32)root;
-			atlas_dimension = (atlas_dimension + 127) & ~127;
+		result = (u16)num_glyphs;
+		fallback_glyphs[result - num_font_glyphs] = { (u16)i, (u16)fallback_index };
+		codepoints[result] = (s32)c;
+		num_glyphs += 1;
 
-			atlas.width = atlas_dimension;
-			atlas.height = atlas_dimension;
+		// Every size that's already set up needs its metrics. Pages first since SDF sizes scale the SDF page's.
+		for (u16 j = 0; j < num_atlases; j += 1) {
+			Font_Atlas& atlas = atlases[j];
+			if (atlas.w) make_glyph_metrics(*this, atlas, result, &atlas.glyphs[result]);
 		}
-		atlases[size].w = atlas.width;
-		atlases[size].h = atlas.height;
-
-		atlas.data = ch_new u8[atlas.width * atlas.height];
-		defer(ch_delete[] atlas.data);
-
-		stbtt_pack_context pc;
-		stbtt_packedchar* pdata = ch_new stbtt_packedchar[num_glyphs];
-		defer(ch_delete[] pdata);
-		stbtt_pack_range pr;
-
-		stbtt_PackBegin(&pc, atlas.data, atlas.width, atlas.height, 0, 1, NULL);
-		pr.chardata_for_range = pdata;
-		pr.array_of_unicode_codepoints = codepoints;
-		pr.first_unicode_codepoint_in_range = 0;
-		pr.num_chars = num_glyphs;
-		pr.font_size = size;
-
-		stbtt_PackSetSkipMissingCodepoints(&pc, 1);
-		stbtt_PackSetOversampling(&pc, h_oversample, v_oversample);
-		stbtt_PackFontRanges(&pc, info.data, 0, &pr, 1);
-		stbtt_PackEnd(&pc);
-
-		glBindTexture(GL_TEXTURE_2D, atlas_ids[size]);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, atlas.width, atlas.height, 0, GL_RED, GL_UNSIGNED_BYTE, atlas.data);
-
-		atlases[size].glyphs = ch_new Font_Glyph[num_glyphs];
-		for (u32 i = 0; i < num_glyphs; i++) {
-			Font_Glyph* glyph = &atlases[size].glyphs[i];
-
-			glyph->x0 = pdata[i].x0;
-			glyph->x1 = pdata[i].x1;
-			glyph->y0 = pdata[i].y0;
-			glyph->y1 = pdata[i].y1;
-
-			glyph->width = ((f32)pdata[i].x1 - pdata[i].x0) / (f32)h_oversample;
-			glyph->height = ((f32)pdata[i].y1 - pdata[i].y0) / (f32)v_oversample;
-			glyph->bearing_x = pdata[i].xoff;
-			glyph->bearing_y = pdata[i].yoff;
-			glyph->advance = pdata[i].xadvance;
+		for (u16 j = 0; j < num_atlases; j += 1) {
+			Font_Atlas& atlas = atlases[j];
+			if (!atlas.glyphs || atlas.w) continue;
+			scale_sdf_glyph_metrics(atlases[sdf_atlas_size].glyphs[result], (f32)j / (f32)sdf_atlas_size, &atlas.glyphs[result]);
 		}
+	}
+
+	// Misses are remembered too so they're only ever looked up once.
+	add_glyph_index(c, result);
+	return result;
+}
+
+void Font::pack_atlas() {
+	if (size < 2) size = 2;
+	if (size > 128) size = 128;
+
+	s32 _ascent, _descent, _line_gap;
+	stbtt_GetFontVMetrics(&info, &_ascent, &_descent, &_line_gap);
+
+	const f32 font_scale = stbtt_ScaleForPixelHeight(&info, size);
+	ascent = (f32)_ascent * font_scale;
+	descent = (f32)_descent * font_scale;
+	line_gap = (f32)_line_gap * font_scale;
 
-		glBindTexture(GL_TEXTURE_2D, 0);
+	if (sdf) {
+		set_up_atlas(*this, sdf_atlas_size);
+		if (size != sdf_atlas_size) scale_sdf_metrics(*this, size);
+		return;
 	}
+
+	set_up_atlas(*this, size);
 }
 
-struct Vertex {
-	ch::Vector2 position;
-	ch::Color color;
-	ch::Vector2 uv;
-	f32 z_index;
-};
+void Font::free_atlas(u16 atlas_size) {
+	Font_Atlas& atlas = atlases[atlas_size];
+	if (!atlas.glyphs) return;
 
-struct Shader {
-	GLuint program_id;
+	if (atlas.w) get_draw_backend()->free_atlas(this, atlas_size);
 
-	GLint projection_loc;
-	GLint view_loc;
+	atlas_bytes -= atlas.get_page_size();
+	ch_delete[] atlas.bitmap;
+	ch_delete[] atlas.glyphs;
+	ch_delete[] atlas.shelves;
+	atlas = {};
+}
 
-	GLint position_loc;
-	GLint color_loc;
-	GLint uv_loc;
-	GLint z_index_loc;
+void Font::free_idle_atlases() {
+	const u32 timeout = get_config().atlas_idle_timeout_s;
+	if (!timeout) return;
 
-	GLuint texture_loc;
-};
+	const f64 now = ch::get_time_in_seconds();
+	const u16 raster_size = get_raster_size();
+	for (u16 i = 0; i < num_atlases; i += 1) {
+		const Font_Atlas& atlas = atlases[i];
+		if (!atlas.glyphs || i == size || i == raster_size || is_atlas_busy(*this, i)) continue;
+		if (now - atlas.last_used_time > (f64)timeout) free_atlas(i);
+	}
+}
 
-#define MAX_VERTICES (3 * 1024)
-
-GLuint imm_vao;
-GLuint imm_vbo;
-Vertex imm_vertices[MAX_VERTICES];
-u32 imm_vertex_count;
-ch::Matrix4 projection_matrix;
-ch::Matrix4 view_matrix;
-
-Shader global_shader;
-
-const GLchar* global_shader_source = R"foo(
-#ifdef VERTEX
-layout(location = 0) in vec2 position;
-layout(location = 1) in vec4 color;
-layout(location = 2) in vec2 uv;
-layout(location = 3) in float z_index;
-uniform mat4 projection;
-uniform mat4 view;
-out vec4 out_color;
-out vec2 out_uv;
-void main() {
-    gl_Position = projection * view * vec4(position, -z_index, 1.0);
-	out_color = color;
-	out_uv = uv;
-}
-
-#endif
-#ifdef FRAGMENT
-out vec4 frag_color;
-in vec4 out_color;
-in vec2 out_uv;
-uniform sampler2D ftex;
-void main() {
-	if (out_uv.x < 0 && out_uv.y < 0) frag_color = out_color;
-	else {
-		vec4 sample = texture(ftex, out_uv);
-		frag_color = vec4(out_color.xyz, sample.r);
-	}
-}
-#endif
-)foo";
-
-static bool load_shader_from_source(const GLchar* source, Shader* out_shader) {
-	Shader result;
-	GLuint program_id = glCreateProgram();
-
-	GLuint vertex_id = glCreateShader(GL_VERTEX_SHADER);
-	GLuint frag_id = glCreateShader(GL_FRAGMENT_SHADER);
-
-	const GLchar* shader_header = "#version 330 core\n#extension GL_ARB_separate_shader_objects: enable\n";
-
-	const GLchar* vert_shader[3] = { shader_header, "#define VERTEX 1\n", source };
-	const GLchar* frag_shader[3] = { shader_header, "#define FRAGMENT 1\n", source };
-
-	glShaderSource(vertex_id, 3, vert_shader, 0);
-	glShaderSource(frag_id, 3, frag_shader, 0);
-
-	glCompileShader(vertex_id);
-	glCompileShader(frag_id);
-
-	glAttachShader(program_id, vertex_id);
-	glAttachShader(program_id, frag_id);
-
-	glLinkProgram(program_id);
-
-	glValidateProgram(program_id);
-
-	GLint is_linked = false;
-	glGetProgramiv(program_id, GL_LINK_STATUS, &is_linked);
-	if (!is_linked) {
-		GLsizei ignored;
-		char vert_errors[4096];
-		char frag_errors[4096];
-		char program_errors[4096];
-
-		glGetShaderInfoLog(vertex_id, sizeof(vert_errors), &ignored, vert_errors);
-		glGetShaderInfoLog(frag_id, sizeof(frag_errors), &ignored, frag_errors);
-		glGetProgramInfoLog(program_id, sizeof(program_errors), &ignored, program_errors);
-		return false;
+Font_Atlas_Memory Font::get_atlas_memory(u16 atlas_size) const {
+	Font_Atlas_Memory result = {};
+
+	const Font_Atlas& atlas = atlases[atlas_size];
+	if (!atlas.glyphs) return result;
+
+	result.glyph_bytes = (usize)glyph_capacity * sizeof(Font_Glyph);
+	result.page_bytes = atlas.get_page_size();
+	result.shelf_bytes = (usize)atlas.max_shelves * sizeof(Atlas_Shelf);
+	result.texture_bytes = get_draw_backend()->get_atlas_texture_bytes(this, atlas_size);
+	return result;
+}
+
+usize Font::get_table_bytes() const {
+	usize result = 0;
+	result += (usize)glyph_capacity * sizeof(s32); // codepoints
+	result += num_bmp_codepoints * sizeof(u16);
+	result += (usize)supplementary_capacity * (sizeof(u32) + sizeof(u16));
+	result += (usize)(glyph_capacity - num_font_glyphs) * sizeof(Fallback_Glyph);
+	return result;
+}
+
+// Sizes still rasterizing draw their pending glyphs out of their fallback size's page, so their rects have to be
+// worked out again whenever a glyph moves in that page.
+static void update_borrowed_glyph(Font& font, u16 fallback_size, u32 glyph_index) {
+	for (u16 i = 0; i < Font::num_atlases; i += 1) {
+		const Font_Atlas& it = font.atlases[i];
+		if (!it.num_pending_batches || it.fallback_size != fallback_size) continue;
+		if (it.glyphs[glyph_index].shelf == glyph_pending) get_draw_backend()->update_glyph(&font, i, glyph_index);
 	}
+}
 
-	glDeleteShader(vertex_id);
-	glDeleteShader(frag_id);
+// Evicts every glyph on the shelf so it can be reused. Its height stays the same.
+static void evict_shelf(Font& font, u16 size, u32 shelf_index) {
+	Font_Atlas& atlas = font.atlases[size];
+	Atlas_Shelf& shelf = atlas.shelves[shelf_index];
 
-	result.program_id = program_id;
-	result.projection_loc = glGetUniformLocation(program_id, "projection");
-	result.view_loc = glGetUniformLocation(program_id, "view");
-	result.texture_loc = glGetUniformLocation(program_id, "ftex");
-	result.position_loc = 0;
-	result.color_loc = 1;
-	result.uv_loc = 2;
-	result.z_index_loc = 3;
+	for (u32 i = 0; i < font.num_glyphs; i += 1) {
+		Font_Glyph& glyph = atlas.glyphs[i];
+		if (glyph.shelf != shelf_index) continue;
 
-	*out_shader = result;
+		glyph.shelf = glyph_not_resident;
+		get_draw_backend()->update_glyph(&font, size, i);
+		update_borrowed_glyph(font, size, i);
+	}
+
+	for (u32 y = shelf.y; y < shelf.y + shelf.height; y += 1) {
+		ch::mem_zero(atlas.bitmap + (usize)y * atlas.w, atlas.w);
+	}
+	shelf.used_width = 0;
+}
 
+// Doubles the page height if the budget allows it.
+static bool grow_atlas_page(Font& font, u16 size) {
+	Font_Atlas& atlas = font.atlases[size];
+	if (atlas.h >= MAX_ATLAS_PAGE_HEIGHT) return false;
+
+	const usize old_size = atlas.get_page_size();
+	const usize new_size = old_size * 2;
+	if (font.atlas_bytes - old_size + new_size > get_glyph_cache_budget()) return false;
+
+	u8* const new_bitmap = ch_new u8[new_size];
+	for (usize i = 0; i < old_size; i += 1) new_bitmap[i] = atlas.bitmap[i];
+	ch::mem_zero(new_bitmap + old_size, new_size - old_size);
+
+	ch_delete[] atlas.bitmap;
+	atlas.bitmap = new_bitmap;
+	atlas.h *= 2;
+	font.atlas_bytes += new_size - old_size;
+
+	// UVs are normalized so every resident glyph's rect changes along with the page, borrowed ones included.
+	get_draw_backend()->upload_atlas(&font, size);
+	if (is_atlas_busy(font, size)) {
+		for (u32 i = 0; i < font.num_glyphs; i += 1) {
+			if (atlas.glyphs[i].shelf < glyph_pending) update_borrowed_glyph(font, size, i);
+		}
+	}
 	return true;
 }
 
-static void gl_error_callback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* userParam) {
-	if (severity != GL_DEBUG_SEVERITY_NOTIFICATION) {
-		ch::std_out << "GL CALLBACK: " << message << ch::eol;
+// Finds room for a width by height bitmap, growing the page or evicting the least recently used shelf if it's full.
+// @returns the shelf index or glyph_not_resident
+static u32 find_atlas_shelf(Font& font, u16 size, u32 width, u32 height) {
+	Font_Atlas& atlas = font.atlases[size];
+	const u32 shelf_height = (height + ATLAS_SHELF_GRANULARITY - 1) & ~(ATLAS_SHELF_GRANULARITY - 1);
+
+	// Best fit among shelves that aren't too much taller than the glyph.
+	u32 best = glyph_not_resident;
+	for (u32 i = 0; i < atlas.num_shelves; i += 1) {
+		const Atlas_Shelf& it = atlas.shelves[i];
+		if (it.height < shelf_height || it.height > shelf_height + shelf_height / 2) continue;
+		if (it.used_width + width > atlas.w) continue;
+		if (best == glyph_not_resident || it.height < atlas.shelves[best].height) best = i;
+	}
+	if (best != glyph_not_resident) return best;
+
+	for (;;) {
+		if (atlas.next_shelf_y + shelf_height <= atlas.h && atlas.num_shelves < atlas.max_shelves) {
+			Atlas_Shelf& it = atlas.shelves[atlas.num_shelves];
+			it.y = atlas.next_shelf_y;
+			it.height = shelf_height;
+			it.used_width = 0;
+			it.last_used_frame = 0;
+			atlas.next_shelf_y += shelf_height;
+			return atlas.num_shelves++;
+		}
+
+		if (!grow_atlas_page(font, size)) break;
+	}
+
+	// Full and out of budget. Recycle the least recently used shelf that fits, as long as it isn't on screen this frame.
+	const u64 frame = get_draw_frame_index();
+	u32 lru = glyph_not_resident;
+	for (u32 i = 0; i < atlas.num_shelves; i += 1) {
+		const Atlas_Shelf& it = atlas.shelves[i];
+		if (it.height < shelf_height || it.last_used_frame == frame) continue;
+		if (lru == glyph_not_resident || it.last_used_frame < atlas.shelves[lru].last_used_frame) lru = i;
 	}
+	if (lru == glyph_not_resident) return glyph_not_resident;
+
+	evict_shelf(font, size, lru);
+	return lru;
 }
 
-void init_draw() {
-	assert(ch::is_gl_loaded());
+bool Font::rasterize_glyph(u32 glyph_index) {
+	const u16 raster_size = get_raster_size();
+	Font_Atlas& atlas = atlases[raster_size];
+	Font_Glyph& glyph = atlas.glyphs[glyph_index];
+	if (glyph.shelf == glyph_pending) return true;
+
+	// Leave a texel of padding so linear filtering doesn't bleed between neighbours.
+	const u32 width = glyph.x1 - glyph.x0;
+	const u32 height = glyph.y1 - glyph.y0;
+	if (!width || !height) return true;
+
+	const u32 shelf_index = find_atlas_shelf(*this, raster_size, width + 1, height + 1);
+	if (shelf_index == glyph_not_resident) return false;
+
+	Atlas_Shelf& shelf = atlas.shelves[shelf_index];
+	const u32 x = shelf.used_width;
+	const u32 y = shelf.y;
+	shelf.used_width += width + 1;
+	shelf.last_used_frame = get_draw_frame_index();
+	atlas.last_used_frame = shelf.last_used_frame;
+
+	const Glyph_Source source = get_glyph_source(*this, glyph_index);
+	const f32 scale = atlas.scale * source.scale;
+
+	u8* const dest = atlas.bitmap + x + (usize)y * atlas.w;
+	if (atlas.sdf) {
+		s32 sdf_width, sdf_height, x_offset, y_offset;
+		u8* const field = stbtt_GetGlyphSDF(source.info, scale, source.index, sdf_padding, sdf_on_edge, sdf_pixel_dist_scale, &sdf_width, &sdf_height, &x_offset, &y_offset);
+		if (field) {
+			// Should match the box set_up_atlas worked out, clamp in case STBTT rounds differently.
+			const u32 copy_width = (u32)sdf_width < width ? (u32)sdf_width : width;
+			const u32 copy_height = (u32)sdf_height < height ? (u32)sdf_height : height;
+			for (u32 row = 0; row < copy_height; row += 1) {
+				memcpy(dest + (usize)row * atlas.w, field + (usize)row * sdf_width, copy_width);
+			}
+			stbtt_FreeSDF(field, nullptr);
+		}
+	} else {
+		f32 sub_x, sub_y;
+		stbtt_MakeGlyphBitmapSubpixelPrefilter(source.info, dest, width, height, atlas.w, 
+			scale * atlas.h_oversample, scale * atlas.v_oversample, 0.f, 0.f, atlas.h_oversample, atlas.v_oversample, &sub_x, &sub_y, source.index);
+	}
+
+	glyph.x0 = x;
+	glyph.y0 = y;
+	glyph.x1 = x + width;
+	glyph.y1 = y + height;
+	glyph.shelf = (u16)shelf_index;
 
-	glGenVertexArrays(1, &imm_vao);
-	glBindVertexArray(imm_vao);
+	get_draw_backend()->update_atlas(this, raster_size, x, y, x + width, y + height);
+	get_draw_backend()->update_glyph(this, raster_size, glyph_index);
 
-	glGenBuffers(1, &imm_vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, imm_vbo);
+	return true;
+}
+
+struct Batch_Glyph {
+	u32 index;
+	Glyph_Source source;
+	u32 width;
+	u32 height;
+};
 
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+// A slice of the glyphs being rasterized for a new size. Everything a worker needs is copied in here
+// so it never reads the atlas the main thread is drawing with.
+struct Glyph_Raster_Batch {
+	Font* font;
+	u16 size;
+	f32 scale_x;
+	f32 scale_y;
+	u32 h_oversample;
+	u32 v_oversample;
+
+	Batch_Glyph* glyphs;
+	u32 num_glyphs;
+
+	// Glyph bitmaps back to back, each width by height.
+	u8* bitmap;
+};
 
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	glEnable(GL_BLEND);
-	glEnable(GL_MULTISAMPLE);
-	glEnable(GL_DEPTH_TEST);
-	glClearDepth(1.f);
-	glDepthFunc(GL_LEQUAL);
-	glClearColor(ch::black);
+static void rasterize_glyph_batch(void* data) {
+	Glyph_Raster_Batch* const batch = (Glyph_Raster_Batch*)data;
 
-#if BUILD_DEBUG
-	glEnable(GL_DEBUG_OUTPUT);
-	glDebugMessageCallback(gl_error_callback, 0);
-#endif
+	u8* dest = batch->bitmap;
+	for (u32 i = 0; i < batch->num_glyphs; i += 1) {
+		const Batch_Glyph& it = batch->glyphs[i];
 
-#if CH_PLATFORM_WINDOWS
-	wglSwapIntervalEXT(false);
-#endif
+		f32 sub_x, sub_y;
+		stbtt_MakeGlyphBitmapSubpixelPrefilter(it.source.info, dest, it.width, it.height, it.width, 
+			batch->scale_x * it.source.scale, batch->scale_y * it.source.scale, 0.f, 0.f, batch->h_oversample, batch->v_oversample, &sub_x, &sub_y, it.source.index);
+		dest += (usize)it.width * it.height;
+	}
 
-	const bool global_shader_loaded = load_shader_from_source(global_shader_source, &global_shader);
-	assert(global_shader_loaded);
-	glUseProgram(global_shader.program_id);
+	Font_Atlas& atlas = batch->font->atlases[batch->size];
+	if (atomic_add(&atlas.pending_jobs, -1) == 0) post_wake_event(the_window.os_handle);
 }
 
-void frame_begin() {
-	const ch::Vector2 viewport_size = the_window.get_viewport_size();
+// True if freeing the atlas would pull it out from under a worker or a size drawing from it.
+static bool is_atlas_busy(Font& font, u16 atlas_size) {
+	if (font.atlases[atlas_size].num_pending_batches) return true;
 
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	glViewport(0, 0, viewport_size.ux, viewport_size.uy);
-	the_font.bind();
-	render_right_handed();
-	imm_begin();
+	for (u16 i = 0; i < Font::num_atlases; i += 1) {
+		const Font_Atlas& it = font.atlases[i];
+		if (it.num_pending_batches && it.fallback_size == atlas_size) return true;
+	}
+
+	return false;
 }
 
-void frame_end() {
-	imm_flush();
+// Hands the glyphs that are on screen at the nearest ready size to the workers, so a zoom draws them scaled
+// for a frame or two instead of stalling while they're rasterized.
+static void start_async_rasterization(Font& font, u16 size) {
+	const u32 num_workers = get_num_workers();
+	if (!num_workers) return;
 
-	ch::swap_buffers(the_window);
+	u16 fallback_size = 0;
+	for (u16 i = 2; i < Font::num_atlases; i += 1) {
+		const Font_Atlas& it = font.atlases[i];
+		if (i == size || !it.w || it.num_pending_batches) continue;
+
+		const s32 distance = (s32)i - (s32)size;
+		const s32 best_distance = (s32)fallback_size - (s32)size;
+		if (!fallback_size || (distance < 0 ? -distance : distance) < (best_distance < 0 ? -best_distance : best_distance)) fallback_size = i;
+	}
+	if (!fallback_size) return;
+
+	const Font_Atlas& fallback = font.atlases[fallback_size];
+	Font_Atlas& atlas = font.atlases[size];
+
+	u32 num_warm = 0;
+	for (u32 i = 0; i < font.num_glyphs; i += 1) {
+		const Font_Glyph& it = atlas.glyphs[i];
+		if (fallback.glyphs[i].shelf < glyph_pending && it.x1 > it.x0 && it.y1 > it.y0) num_warm += 1;
+	}
+	if (!num_warm) return;
+
+	const u32 num_batches = num_warm < num_workers ? num_warm : num_workers;
+	const u32 per_batch = (num_warm + num_batches - 1) / num_batches;
+
+	atlas.fallback_size = fallback_size;
+	atlas.pending_batches = ch_new Glyph_Raster_Batch[num_batches];
+	atlas.num_pending_batches = num_batches;
+	atlas.pending_jobs = (s32)num_batches;
+
+	u32 glyph_index = 0;
+	for (u32 b = 0; b < num_batches; b += 1) {
+		Glyph_Raster_Batch& batch = atlas.pending_batches[b];
+		batch.font = &font;
+		batch.size = size;
+		batch.scale_x = atlas.scale * atlas.h_oversample;
+		batch.scale_y = atlas.scale * atlas.v_oversample;
+		batch.h_oversample = atlas.h_oversample;
+		batch.v_oversample = atlas.v_oversample;
+		batch.glyphs = ch_new Batch_Glyph[per_batch];
+		batch.num_glyphs = 0;
+
+		usize bitmap_size = 0;
+		for (; glyph_index < font.num_glyphs && batch.num_glyphs < per_batch; glyph_index += 1) {
+			Font_Glyph& it = atlas.glyphs[glyph_index];
+			if (fallback.glyphs[glyph_index].shelf >= glyph_pending || it.x1 <= it.x0 || it.y1 <= it.y0) continue;
+
+			Batch_Glyph& bg = batch.glyphs[batch.num_glyphs++];
+			bg.index = glyph_index;
+			bg.source = get_glyph_source(font, glyph_index);
+			bg.width = it.x1 - it.x0;
+			bg.height = it.y1 - it.y0;
+			bitmap_size += (usize)bg.width * bg.height;
+
+			it.shelf = glyph_pending;
+		}
+
+		batch.bitmap = ch_new u8[bitmap_size];
+		ch::mem_zero(batch.bitmap, bitmap_size);
+	}
+
+	// Only queue once every batch is filled out, the glyph entries above aren't touched after this.
+	for (u32 b = 0; b < num_batches; b += 1) {
+		push_job(rasterize_glyph_batch, &atlas.pending_batches[b]);
+	}
 }
 
-void refresh_shader_transform() {
-	glUniformMatrix4fv(global_shader.view_loc, 1, GL_FALSE, view_matrix.elems);
-	glUniformMatrix4fv(global_shader.projection_loc, 1, GL_FALSE, projection_matrix.elems);
+void Font::finish_pending_atlases() {
+	for (u16 i = 0; i < num_atlases; i += 1) {
+		Font_Atlas& atlas = atlases[i];
+		if (!atlas.num_pending_batches || atomic_load(&atlas.pending_jobs) > 0) continue;
+
+		for (u32 b = 0; b < atlas.num_pending_batches; b += 1) {
+			Glyph_Raster_Batch& batch = atlas.pending_batches[b];
+
+			const u8* src = batch.bitmap;
+			for (u32 j = 0; j < batch.num_glyphs; j += 1) {
+				const Batch_Glyph& bg = batch.glyphs[j];
+				Font_Glyph& glyph = atlas.glyphs[bg.index];
+				const u8* const glyph_src = src;
+				src += (usize)bg.width * bg.height;
+
+				glyph.shelf = glyph_not_resident;
+				glyph.x0 = 0;
+				glyph.y0 = 0;
+				glyph.x1 = bg.width;
+				glyph.y1 = bg.height;
+
+				const u32 shelf_index = find_atlas_shelf(*this, i, bg.width + 1, bg.height + 1);
+				if (shelf_index == glyph_not_resident) continue;
+
+				Atlas_Shelf& shelf = atlas.shelves[shelf_index];
+				const u32 x = shelf.used_width;
+				const u32 y = shelf.y;
+				shelf.used_width += bg.width + 1;
+				shelf.last_used_frame = get_draw_frame_index();
+
+				for (u32 row = 0; row < bg.height; row += 1) {
+					u8* const dest = atlas.bitmap + x + (usize)(y + row) * atlas.w;
+					const u8* const src_row = glyph_src + (usize)row * bg.width;
+					for (u32 col = 0; col < bg.width; col += 1) dest[col] = src_row[col];
+				}
+
+				glyph.x0 = x;
+				glyph.y0 = y;
+				glyph.x1 = x + bg.width;
+				glyph.y1 = y + bg.height;
+				glyph.shelf = (u16)shelf_index;
+			}
+
+			ch_delete[] batch.glyphs;
+			ch_delete[] batch.bitmap;
+		}
+
+		ch_delete[] atlas.pending_batches;
+		atlas.pending_batches = nullptr;
+		atlas.num_pending_batches = 0;
+		atlas.fallback_size = 0;
+
+		// One upload for the whole lot.
+		get_draw_backend()->upload_atlas(this, i);
+		atlas_version += 1;
+	}
 }
 
-void render_right_handed() {
-	const ch::Vector2 viewport_size = the_window.get_viewport_size();
+// The immediate layer only batches instances, where they end up is the backend's business.
+static const Draw_Backend* draw_backend = &gl_draw_backend;
 
-	const f32 width = (f32)viewport_size.ux;
-	const f32 height = (f32)viewport_size.uy;
+static Imm_Instance* imm_instance_data;
+static u32 imm_instance_count;
+static u32 imm_first_unflushed;
 
-	const f32 aspect_ratio = width / height;
+static Draw_Stats draw_stats;
+static u64 draw_frame_index = 0;
 
-	const f32 f = 10.f;
-	const f32 n = 1.f;
+static u32 headless_viewport_width = 0;
+static u32 headless_viewport_height = 0;
 
-	const f32 ortho_size = height / 2.f;
+void set_draw_backend(const Draw_Backend* backend) {
+	assert(backend);
+	draw_backend = backend;
+}
 
-	projection_matrix = ch::ortho(ortho_size, aspect_ratio, f, n);
-	view_matrix       = ch::translate(ch::Vector2(-width / 2.f, ortho_size));
+const Draw_Backend* get_draw_backend() {
+	return draw_backend;
+}
 
-	refresh_shader_transform();
+void set_headless_viewport(u32 width, u32 height) {
+	headless_viewport_width = width;
+	headless_viewport_height = height;
 }
 
-void imm_begin() {
-	imm_vertex_count = 0;
+ch::Vector2 get_viewport_size() {
+	if (headless_viewport_width && headless_viewport_height) {
+		ch::Vector2 result;
+		result.ux = headless_viewport_width;
+		result.uy = headless_viewport_height;
+		return result;
+	}
+
+	return the_window.get_viewport_size();
 }
 
-void imm_flush() {
-	if (imm_vertex_count == 0) return;
+u64 get_draw_frame_index() {
+	return draw_frame_index;
+}
 
-	glBindVertexArray(imm_vao);
-	glBindBuffer(GL_ARRAY_BUFFER, imm_vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(imm_vertices[0]) * imm_vertex_count, imm_vertices, GL_STREAM_DRAW);
+const Draw_Stats& get_draw_stats() {
+	return draw_stats;
+}
 
-	const GLuint position_loc = global_shader.position_loc;
-	const GLuint color_loc = global_shader.color_loc;
-	const GLuint uv_loc = global_shader.uv_loc;
-	const GLuint z_index_loc = global_shader.z_index_loc;
+void reset_draw_stats() {
+	draw_stats = {};
+}
 
-	glVertexAttribPointer(position_loc, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), 0);
-	glEnableVertexAttribArray(position_loc);
+void init_draw() {
+	draw_backend->init();
 
-	glVertexAttribPointer(color_loc, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)sizeof(ch::Vector2));
-	glEnableVertexAttribArray(color_loc);
+	imm_instance_data = draw_backend->next_region();
+	imm_instance_count = 0;
+	imm_first_unflushed = 0;
+}
 
-	glVertexAttribPointer(uv_loc, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(sizeof(ch::Vector2) + sizeof(ch::Vector4)));
-	glEnableVertexAttribArray(uv_loc);
+static void imm_next_region() {
+	imm_instance_data = draw_backend->next_region();
+	imm_instance_count = 0;
+	imm_first_unflushed = 0;
+}
 
-	glVertexAttribPointer(z_index_loc, 1, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(sizeof(ch::Vector2) + sizeof(ch::Vector4) + sizeof(ch::Vector2)));
-	glEnableVertexAttribArray(z_index_loc);
+bool frame_begin() {
+	const ch::Vector2 viewport_size = get_viewport_size();
 
-	glDrawArrays(GL_TRIANGLES, 0, imm_vertex_count);
+	draw_frame_index += 1;
+	draw_stats.frames += 1;
 
-	glDisableVertexAttribArray(position_loc);
-	glDisableVertexAttribArray(color_loc);
-	glDisableVertexAttribArray(uv_loc);
-	glDisableVertexAttribArray(z_index_loc);
+	const bool lost_backbuffer = draw_backend->frame_begin(viewport_size.ux, viewport_size.uy);
+	the_font.bind();
+	imm_begin();
 
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return lost_backbuffer;
 }
 
-static Vertex* get_next_vertex_ptr() {
-	return (Vertex*)&imm_vertices + imm_vertex_count;
+void begin_dirty_rect(f32 x0, f32 y0, f32 x1, f32 y1) {
+	// Whatever was queued belongs to the previous rect's clip.
+	imm_flush();
+
+	draw_backend->clear_rect((s32)x0, (s32)y0, (s32)(x1 + 0.5f), (s32)(y1 + 0.5f));
 }
 
-void imm_vertex(f32 x, f32 y, const ch::Color& color, ch::Vector2 uv, f32 z_index) {
-	if (imm_vertex_count >= MAX_VERTICES) {
+void frame_end() {
+	imm_flush();
+	imm_next_region();
+
+	draw_backend->frame_end();
+}
+
+static CH_FORCEINLINE s16 to_pixel(f32 v) {
+	return (s16)(v < 0.f ? v - 0.5f : v + 0.5f);
+}
+
+static CH_FORCEINLINE s16 to_subpixel(f32 v) {
+	// Anything further out would wrap around and land somewhere else on screen. Callers clip to the view first
+	assert(v * (f32)imm_subpixels > -32768.f && v * (f32)imm_subpixels < 32767.f);
+	return to_pixel(v * (f32)imm_subpixels);
+}
+
+void imm_begin() {
+	imm_first_unflushed = imm_instance_count;
+}
+
+void imm_flush() {
+	const u32 count = imm_instance_count - imm_first_unflushed;
+	if (count == 0) return;
+
+	draw_backend->draw(imm_instance_data + imm_first_unflushed, count);
+
+	draw_stats.draw_calls += 1;
+	draw_stats.instances += count;
+	draw_stats.bytes += count * sizeof(Imm_Instance);
+
+	imm_first_unflushed = imm_instance_count;
+}
+
+static Imm_Instance* get_next_instance_ptr() {
+	if (imm_instance_count >= imm_region_size) {
 		imm_flush();
-		imm_begin();
+		imm_next_region();
 	}
 
-	Vertex* vertex = get_next_vertex_ptr();
+	extern int num_vertices_total;
+	num_vertices_total += 6;
 
-	vertex->position.x = x;
-	vertex->position.y = -y;
-	vertex->color = color;
-	vertex->uv = uv;
-	vertex->z_index = z_index;
+	return &imm_instance_data[imm_instance_count++];
+}
+
+void imm_instances(const Imm_Instance* instances, usize count, f32 x, f32 y) {
+	const s16 dx = to_subpixel(x);
+	const s16 dy = to_subpixel(y);
+
+	while (count) {
+		if (imm_instance_count >= imm_region_size) {
+			imm_flush();
+			imm_next_region();
+		}
+
+		usize to_copy = imm_region_size - imm_instance_count;
+		if (to_copy > count) to_copy = count;
+
+		Imm_Instance* dest = &imm_instance_data[imm_instance_count];
+		for (usize i = 0; i < to_copy; i += 1) {
+			dest[i] = instances[i];
+			assert(dest[i].x + dx >= -32768 && dest[i].x + dx <= 32767 && dest[i].y + dy >= -32768 && dest[i].y + dy <= 32767);
+			dest[i].x += dx;
+			dest[i].y += dy;
+
+			// Cached glyphs may have been evicted since they were built.
+			if (dest[i].rect != solid_quad_rect) bound_font->use_glyph(dest[i].rect);
+		}
 
-    extern int num_vertices_total;
-    num_vertices_total += 1;
-	imm_vertex_count += 1;
+		extern int num_vertices_total;
+		num_vertices_total += (int)to_copy * 6;
+		imm_instance_count += (u32)to_copy;
+
+		instances += to_copy;
+		count -= to_copy;
+	}
 }
 
 void imm_quad(f32 x0, f32 y0, f32 x1, f32 y1, const ch::Color& color, f32 z_index) {
-	imm_vertex(x0, y0, color, ch::Vector2(-1.f, -1.f), z_index);
-	imm_vertex(x0, y1, color, ch::Vector2(-1.f, -1.f), z_index);
-	imm_vertex(x1, y0, color, ch::Vector2(-1.f, -1.f), z_index);
-
-	imm_vertex(x0, y1, color, ch::Vector2(-1.f, -1.f), z_index);
-	imm_vertex(x1, y1, color, ch::Vector2(-1.f, -1.f), z_index);
-	imm_vertex(x1, y0, color, ch::Vector2(-1.f, -1.f), z_index);
+	const s16 ix0 = to_pixel(x0);
+	const s16 iy0 = to_pixel(y0);
+	const s16 ix1 = to_pixel(x1);
+	const s16 iy1 = to_pixel(y1);
+
+	// Edges land on whole pixels so neighbouring quads never overlap or leave a gap
+	Imm_Instance* instance = get_next_instance_ptr();
+	instance->x = (s16)(ix0 * imm_subpixels);
+	instance->y = (s16)(iy0 * imm_subpixels);
+	instance->width = ix1 > ix0 ? (u16)(ix1 - ix0) : 0;
+	instance->height = iy1 > iy0 ? (u16)(iy1 - iy0) : 0;
+	instance->rect = solid_quad_rect;
+	instance->z_index = (u16)z_index;
+	instance->color = pack_color(color);
 }
 
-void Font::bind() const {
-	refresh_shader_transform();
-	glUniform1i(global_shader.texture_loc, 0);
+void Font::bind() {
+	bound_font = this;
+
+	const f64 now = ch::get_time_in_seconds();
+	atlases[size].last_used_time = now;
+	atlases[get_raster_size()].last_used_time = now;
 
-	glBindTexture(GL_TEXTURE_2D, atlas_ids[size]);
-	glActiveTexture(GL_TEXTURE0);
+	draw_backend->bind_font(*this);
 }
 
 
-void imm_glyph(const Font_Glyph* glyph, const Font& font, f32 x, f32 y, const ch::Color& color, f32 z_index /*= 9.f*/) {
+void make_glyph_instance(Imm_Instance* out, const Font_Glyph* glyph, Font& font, f32 x, f32 y, const ch::Color& color, f32 z_index /*= 9.f*/) {
 	// @NOTE(CHall): draw glyphs top down
 	y += font.size;
 	y -= font.line_gap;
-	
-	const f32 x0 = x + glyph->bearing_x;
-	const f32 y0 = y + glyph->bearing_y;
-	const f32 x1 = x0 + glyph->width;
-	const f32 y1 = y0 + glyph->height;
 
-	const f32 atlas_w = (f32)font.atlases[font.size].w;
-	const f32 atlas_h = (f32)font.atlases[font.size].h;
-
-	const ch::Vector2 bottom_right = ch::Vector2(glyph->x1 / atlas_w, glyph->y1 / atlas_h);
-	const ch::Vector2 bottom_left = ch::Vector2(glyph->x1 / atlas_w, glyph->y0 / atlas_h);
-	const ch::Vector2 top_right = ch::Vector2(glyph->x0 / atlas_w, glyph->y1 / atlas_h);
-	const ch::Vector2 top_left = ch::Vector2(glyph->x0 / atlas_w, glyph->y0 / atlas_h);
-
-	imm_vertex(x0, y0, color, top_left, z_index);
-	imm_vertex(x0, y1, color, top_right, z_index);
-	imm_vertex(x1, y0, color, bottom_left, z_index);
+	out->x = to_subpixel(x);
+	out->y = to_subpixel(y);
+	out->width = 0;
+	out->height = 0;
+	out->rect = (u16)(glyph - font.atlases[font.size].glyphs);
+	font.use_glyph(out->rect);
+	out->z_index = (u16)z_index;
+	out->color = pack_color(color);
+}
 
-	imm_vertex(x0, y1, color, top_right, z_index);
-	imm_vertex(x1, y1, color, bottom_right, z_index);
-	imm_vertex(x1, y0, color, bottom_left, z_index);
+void imm_glyph(const Font_Glyph* glyph, Font& font, f32 x, f32 y, const ch::Color& color, f32 z_index /*= 9.f*/) {
+	make_glyph_instance(get_next_instance_ptr(), glyph, font, x, y, color, z_index);
 }
 
-const Font_Glyph* imm_char(const u32 c, const Font& font, f32 x, f32 y, const ch::Color& color, f32 z_index /*= 9.f*/) {
+const Font_Glyph* imm_char(const u32 c, Font& font, f32 x, f32 y, const ch::Color& color, f32 z_index /*= 9.f*/) {
 	const Font_Glyph* g = font[c];
 	if (!g) {
 		g = font['?'];
@@ -497,7 +1324,7 @@ const Font_Glyph* imm_char(const u32 c, const Font& font, f32 x, f32 y, const ch
 	return g;
 }
 
-ch::Vector2 imm_string(const ch::String& s, const Font& font, f32 x, f32 y, const ch::Color& color, f32 z_index /*= 9.f*/) {
+ch::Vector2 imm_string(const ch::String& s, Font& font, f32 x, f32 y, const ch::Color& color, f32 z_index /*= 9.f*/) {
 	const f32 font_height = font.size;
 
 	const f32 original_x = x;
@@ -535,7 +1362,7 @@ ch::Vector2 imm_string(const ch::String& s, const Font& font, f32 x, f32 y, cons
 	return ch::Vector2(largest_x, largest_y);
 }
 
-ch::Vector2 get_string_draw_size(const ch::String& s, const Font& font) {
+ch::Vector2 get_string_draw_size(const ch::String& s, Font& font) {
 	const f32 font_height = font.size;
 
 	const f32 starting_x = 0.f;
@@ -1,30 +1,156 @@
 #pragma once
 
-#include <ch_stl/opengl.h>
+#include <ch_stl/filesystem.h>
 #include <ch_stl/math.h>
+#include <ch_stl/string.h>
 
 #include <stb/stb_truetype.h>
 
+#include "os.h"
+
+/** @returns the number of frames begun so far. */
+u64 get_draw_frame_index();
+
+const u16 glyph_not_resident = 0xFFFF;
+
+/** Being rasterized on a worker. Drawn from the atlas's fallback_size until it's done. */
+const u16 glyph_pending = 0xFFFE;
+
+/** In SDF mode every size is drawn from one distance field page rasterized at this size. */
+const u16 sdf_atlas_size = 48;
+
+/** Texels of field around each SDF glyph. Bigger reaches further but wastes more of the page. */
+const u32 sdf_padding = 6;
+
+/** Distance field value on a glyph's outline. */
+const u8 sdf_on_edge = 128;
+
+/** How much the distance field value changes per texel away from the outline. */
+const f32 sdf_pixel_dist_scale = (f32)sdf_on_edge / (f32)sdf_padding;
+
 struct Font_Glyph {
 	f32 width, height;
 	f32 bearing_x, bearing_y;
 	f32 advance;
 
+	// Where the bitmap sits in the atlas page, only valid while shelf is a real shelf index.
 	u32 x0, y0, x1, y1;
+	u16 shelf;
+};
+
+/** Most fonts a Font falls back on. */
+const u32 max_font_fallbacks = 8;
+
+/** Glyph slots kept after a font's own glyphs for glyphs borrowed from its fallbacks. */
+const u32 max_fallback_glyphs = 4096;
+
+/** Codepoint table entry for a codepoint nothing in the fallback chain has. */
+const u16 glyph_index_missing = 0xFFFF;
+
+/**
+ * A font glyphs are borrowed from when the main font doesn't have a codepoint. Not loaded until a
+ * codepoint falls through to it.
+ */
+struct Font_Fallback {
+	ch::Path path;
+	bool tried_loading;
+
+	Mapped_File file;
+	stbtt_fontinfo info;
+
+	// Ratio of this font's scale for a pixel height to the main font's, so borrowed glyphs come out the same size.
+	f32 scale;
+};
+
+/** Where a glyph past the font's own glyphs came from. */
+struct Fallback_Glyph {
+	u16 fallback;
+	u16 glyph_index;
 };
 
+/** A row of the atlas page. Glyphs are placed left to right and a whole shelf is evicted at once. */
+struct Atlas_Shelf {
+	u32 y;
+	u32 height;
+	u32 used_width;
+	u64 last_used_frame;
+};
+
+/**
+ * Glyph cache for one size. Metrics for every glyph are computed up front since they're cheap,
+ * bitmaps are only rasterized into the page the first time a glyph is drawn.
+ *
+ * @see Font::use_glyph
+ */
 struct Font_Atlas {
+	// Size of the page, 0 if this size hasn't been set up or only has metrics because it's drawn from the SDF page.
 	u32 w;
 	u32 h;
 	Font_Glyph* glyphs;
+
+	// The page holds distance fields instead of coverage, see Font::sdf.
+	bool sdf;
+
+	// CPU copy of the page. Backends upload from here.
+	u8* bitmap;
+
+	f32 scale;
+	u32 h_oversample;
+	u32 v_oversample;
+
+	Atlas_Shelf* shelves;
+	u32 num_shelves;
+	u32 max_shelves;
+	u32 next_shelf_y;
+
+	u64 last_used_frame;
+
+	// Last time the size was bound, sizes that go unused for atlas_idle_timeout_s are freed.
+	f64 last_used_time;
+
+	/**
+	 * Set while workers rasterize the glyphs that were on screen at fallback_size. Those glyphs are drawn
+	 * from fallback_size's page, scaled to this size, until Font::finish_pending_atlases picks the work up.
+	 */
+	volatile s32 pending_jobs;
+	u16 fallback_size;
+	struct Glyph_Raster_Batch* pending_batches;
+	u32 num_pending_batches;
+
+	/** @returns bytes used by the page, this is what the glyph cache budget limits. */
+	CH_FORCEINLINE usize get_page_size() const {
+		return (usize)w * h;
+	}
+};
+
+/** Memory held for one size. */
+struct Font_Atlas_Memory {
+	usize glyph_bytes;   // metrics for every glyph slot
+	usize page_bytes;    // CPU copy of the page
+	usize shelf_bytes;
+	usize texture_bytes; // what the draw backend holds for the page and rect table
+
+	CH_FORCEINLINE usize get_cpu_bytes() const {
+		return glyph_bytes + page_bytes + shelf_bytes;
+	}
 };
 
 struct Font {
 	stbtt_fontinfo info;
 
+	// The font file stays mapped for as long as the font is loaded, STBTT reads straight out of it.
+	Mapped_File file;
+
+	/** Hash of the font file's bytes. Keys the on disk glyph cache. */
+	u64 file_hash;
+
 	u16 size;
 
-	f64 atlas_area;
+	/**
+	 * Draw every size out of one distance field page at sdf_atlas_size, scaled on the GPU. Other sizes only get
+	 * metrics, so zooming never rasterizes anything. Set before the first pack_atlas, it can't change afterwards.
+	 */
+	bool sdf;
 
 	f32 ascent;
 	f32 descent;
@@ -32,37 +158,266 @@ struct Font {
 
 	static const usize num_atlases = 129;
 
+	// The glyph cache is filled in as glyphs are looked up and drawn, so both need a non-const Font.
 	Font_Atlas atlases[num_atlases];
-	GLuint atlas_ids[num_atlases];
+
+	/** Bytes used by every size's atlas page, kept under the glyph_cache_budget_kb config var. */
+	usize atlas_bytes;
+
+	/** Bumped whenever glyphs that may already be on screen change how they look. */
+	u32 atlas_version;
 
 	s32* codepoints;
+
+	/**
+	 * Glyph indices are shared by the font and its fallbacks. The font's own glyphs come first, glyphs borrowed from
+	 * fallbacks are appended as codepoints resolve to them, so every size's glyph array is glyph_capacity long.
+	 */
+	u32 num_font_glyphs;
 	u32 num_glyphs;
+	u32 glyph_capacity;
+
+	Font_Fallback fallbacks[max_font_fallbacks];
+	u32 num_fallbacks;
+	Fallback_Glyph* fallback_glyphs;
+
+	/**
+	 * Codepoint to glyph index for the whole BMP, shared by every size. Built from the cmap when the font is loaded,
+	 * 0 means the font doesn't have it and the fallbacks haven't been asked yet, glyph_index_missing that none of them have it.
+	 */
+	static const u32 num_bmp_codepoints = 0x10000;
+	u16* bmp_glyph_indices;
+
+	/** Open addressed codepoint to glyph index table for everything above the BMP. A key of 0 is an empty slot. */
+	u32* supplementary_codepoints;
+	u16* supplementary_glyph_indices;
+	u32 supplementary_capacity;
+	u32 supplementary_count;
+	/** 32 minus log2 of the capacity, the hash keeps the bits above it. */
+	u32 supplementary_shift;
 
 	CH_FORCEINLINE void free() {
-		ch_delete codepoints;
+		for (u16 i = 0; i < num_atlases; i += 1) free_atlas(i);
+		ch_delete[] codepoints;
+		ch_delete[] bmp_glyph_indices;
+		ch_delete[] supplementary_codepoints;
+		ch_delete[] supplementary_glyph_indices;
+		ch_delete[] fallback_glyphs;
+		unmap_file(&file);
+		for (u32 i = 0; i < num_fallbacks; i += 1) unmap_file(&fallbacks[i].file);
+	}
+
+	u16 find_supplementary_glyph_index(u32 c) const;
+	void add_glyph_index(u32 c, u16 glyph_index);
+
+	/**
+	 * Looks c up in each fallback in order, loading them as it goes, and remembers the answer in the codepoint tables.
+	 *
+	 * @returns the borrowed glyph's index or glyph_index_missing
+	 */
+	u16 resolve_fallback(u32 c);
+
+	/** @returns the size whose atlas page the current size is drawn from. */
+	CH_FORCEINLINE u16 get_raster_size() const {
+		return sdf ? sdf_atlas_size : size;
 	}
 
-	const Font_Glyph* operator[](u32 c) const;
+	/** @returns the glyph for c at the current size or nullptr if the font doesn't have it. */
+	CH_FORCEINLINE const Font_Glyph* operator[](u32 c) {
+		u16 idx = c < num_bmp_codepoints ? bmp_glyph_indices[c] : find_supplementary_glyph_index(c);
+		if (!idx) idx = resolve_fallback(c);
+		if (idx == glyph_index_missing) return nullptr;
+		return &atlases[size].glyphs[idx];
+	}
 
+	/** Sets up the current size. Only metrics are computed here, bitmaps are rasterized by use_glyph. */
 	void pack_atlas();
-	void bind() const;
+	void bind();
+
+	/**
+	 * Makes sure a glyph of the current size is in the atlas page it's drawn from and marks it as used this frame.
+	 * Called for every glyph that's drawn.
+	 *
+	 * @returns false if it couldn't be made resident, it'll draw as nothing
+	 */
+	CH_FORCEINLINE bool use_glyph(u32 glyph_index) {
+		Font_Atlas& atlas = atlases[get_raster_size()];
+		const u16 shelf = atlas.glyphs[glyph_index].shelf;
+		if (shelf >= glyph_pending) return rasterize_glyph(glyph_index);
+
+		atlas.shelves[shelf].last_used_frame = get_draw_frame_index();
+		return true;
+	}
+
+	bool rasterize_glyph(u32 glyph_index);
+
+	/** Moves glyphs finished by workers into their atlas pages. Called once a frame on the main thread. */
+	void finish_pending_atlases();
+	void free_atlas(u16 atlas_size);
+
+	/**
+	 * Frees sizes that haven't been bound for atlas_idle_timeout_s. The current size and the page it's drawn
+	 * from are always kept. Called once a tick, so nothing is freed while the editor sleeps on input.
+	 */
+	void free_idle_atlases();
+
+	/** @returns what one size costs, all zero if it isn't set up. */
+	Font_Atlas_Memory get_atlas_memory(u16 atlas_size) const;
+
+	/** @returns bytes of codepoint tables shared by every size. The mapped font files aren't counted since the OS pages them. */
+	usize get_table_bytes() const;
 };
 
 bool load_font_from_path(const ch::Path& path, Font* out_font);
 
+/** Appends a font to try for codepoints out_font doesn't have. It isn't opened until one does. */
+void add_font_fallback(Font* font, const ch::Path& path);
+
+/**
+ * Writes every finished atlas size, its glyph metrics and the codepoint tables to the glyph cache file.
+ * The next load_font_from_path and pack_atlas for the same font file read them back instead of redoing the work.
+ */
+void save_font_cache(const Font& font);
+
+/**
+ * One screen aligned quad. Glyphs and solid quads share this so they stay in submission order,
+ * the vertex shader expands each instance into two triangles.
+ */
+struct Imm_Instance {
+	s16 x, y;          // glyph pen position or quad top left, in imm_subpixels of a pixel
+	u16 width, height; // quad size, unused by glyphs since the rect table has it
+	u16 rect;          // glyph index into the font's rect table or solid_quad_rect
+	u16 z_index;
+	u32 color;         // RGBA8, red in the lowest byte
+};
+
+const u16 solid_quad_rect = 0xFFFF;
+
+/**
+ * Positions keep this many steps per pixel so advances add up without losing their fractions, only where a glyph
+ * finally lands is rounded to a pixel. Still leaves s16 room for +-8192 pixels, so anything far off screen
+ * has to be clipped before it's turned into an instance.
+ */
+const s32 imm_subpixels = 4;
+
+CH_FORCEINLINE u32 pack_color_channel(f32 v) {
+	if (v < 0.f) v = 0.f;
+	if (v > 1.f) v = 1.f;
+	return (u32)(v * 255.f + 0.5f);
+}
+
+CH_FORCEINLINE u32 pack_color(const ch::Color& color) {
+	return pack_color_channel(color.r) | (pack_color_channel(color.g) << 8) | (pack_color_channel(color.b) << 16) | (pack_color_channel(color.a) << 24);
+}
+
+/** How many instances fit in one region handed out by a backend. */
+const u32 imm_region_size = 64 * 1024;
+
+/**
+ * Where immediate mode drawing ends up. The immediate layer batches instances into regions the backend
+ * hands out and asks it to draw them on flush, so nothing outside of a backend touches a graphics api.
+ * Rects given to a backend are in whole pixels with a top left origin.
+ *
+ * @see gl_draw_backend, null_draw_backend, cpu_draw_backend
+ */
+struct Draw_Backend {
+	const char* name;
+
+	void (*init)();
+
+	/** Uploads a size's whole atlas page and every glyph's rect. Called when the page is created or resized. */
+	void (*upload_atlas)(const Font* font, u16 size);
+
+	/** Uploads part of the page after a glyph was rasterized into it. */
+	void (*update_atlas)(const Font* font, u16 size, u32 x0, u32 y0, u32 x1, u32 y1);
+
+	/** A glyph became resident or was evicted. */
+	void (*update_glyph)(const Font* font, u16 size, u32 glyph_index);
+
+	void (*free_atlas)(const Font* font, u16 size);
+
+	/** @returns bytes of GPU memory held for a size's page and rect table. */
+	usize (*get_atlas_texture_bytes)(const Font* font, u16 size);
+
+	void (*bind_font)(const Font& font);
+
+	/** @returns true if what was drawn on earlier frames is gone and everything must be redrawn. */
+	bool (*frame_begin)(u32 width, u32 height);
+
+	/** Clears the rect and clips all drawing to it until the next one. */
+	void (*clear_rect)(s32 x0, s32 y0, s32 x1, s32 y1);
+
+	/** @returns space for imm_region_size instances. Anything drawn from the previous region has been submitted. */
+	Imm_Instance* (*next_region)();
+	void (*draw)(const Imm_Instance* first, u32 count);
+
+	void (*frame_end)();
+};
+
+/** Draws through OpenGL into the window. The default. */
+extern const Draw_Backend gl_draw_backend;
+
+/** Draws nothing. Used to measure what building a frame costs the CPU. */
+extern const Draw_Backend null_draw_backend;
+
+/** Rasterizes into an in memory image. Slow, but needs no window or gpu. */
+extern const Draw_Backend cpu_draw_backend;
+
+/** The cpu_draw_backend's image. RGBA8 with red in the lowest byte, same as pack_color. */
+struct Draw_Image {
+	u32 width = 0;
+	u32 height = 0;
+	u32* pixels = nullptr;
+};
+
+const Draw_Image& get_cpu_draw_image();
+
+/** Must be called before init_draw. */
+void set_draw_backend(const Draw_Backend* backend);
+const Draw_Backend* get_draw_backend();
+
+/** Totals for everything flushed through the immediate layer since the last reset. */
+struct Draw_Stats {
+	u64 frames = 0;
+	u64 draw_calls = 0;
+	u64 instances = 0;
+	u64 bytes = 0;
+};
+
+const Draw_Stats& get_draw_stats();
+void reset_draw_stats();
+
+/**
+ * Overrides the size we draw at when there's no window to ask.
+ * Passing 0s goes back to using the window.
+ */
+void set_headless_viewport(u32 width, u32 height);
+
+/** @returns the size of what's being drawn to, the window's viewport unless set_headless_viewport was used. */
+ch::Vector2 get_viewport_size();
+
 void init_draw();
 
 void refresh_shader_transform();
 void render_right_handed();
 
-void frame_begin();
+/**
+ * Starts drawing into the retained backbuffer. Only what's covered by begin_dirty_rect is cleared,
+ * everything else keeps what was drawn on earlier frames.
+ *
+ * @returns true if the backbuffer was lost (first frame or resize) and everything must be redrawn
+ */
+bool frame_begin();
+
+/** Flushes pending draws, then clears and clips all further drawing to the given rect. */
+void begin_dirty_rect(f32 x0, f32 y0, f32 x1, f32 y1);
+
+/** Copies the backbuffer to the window and presents it. */
 void frame_end();
 
 void imm_begin();
 void imm_flush();
 
-void imm_vertex(f32 x, f32 y, const ch::Color& color, ch::Vector2 uv = 0.f, f32 z_index = 9.f);
-
 void imm_quad(f32 x0, f32 y0, f32 x1, f32 y1, const ch::Color& color, f32 z_index = 9.f);
 CH_FORCEINLINE void draw_quad(f32 x0, f32 y0, f32 x1, f32 y1, const ch::Color& color, f32 z_index = 9.f) {
 	imm_begin();
@@ -70,22 +425,31 @@ CH_FORCEINLINE void draw_quad(f32 x0, f32 y0, f32 x1, f32 y1, const ch::Color& c
 	imm_flush();
 }
 
-void imm_glyph(const Font_Glyph* glyph, const Font& font, f32 x, f32 y, const ch::Color& color, f32 z_index = 9.f);
-CH_FORCEINLINE void draw_glyph(const Font_Glyph* glyph, const Font& font, f32 x, f32 y, const ch::Color& color, f32 z_index = 9.f) {
+/**
+ * Appends prebuilt instances to the immediate buffer, offset by x and y.
+ * Used to replay cached geometry without rebuilding it. The offset positions must still fit in an s16.
+ */
+void imm_instances(const Imm_Instance* instances, usize count, f32 x, f32 y);
+
+/** Fills out the instance for a glyph. This is what imm_glyph emits. */
+void make_glyph_instance(Imm_Instance* out, const Font_Glyph* glyph, Font& font, f32 x, f32 y, const ch::Color& color, f32 z_index = 9.f);
+
+void imm_glyph(const Font_Glyph* glyph, Font& font, f32 x, f32 y, const ch::Color& color, f32 z_index = 9.f);
+CH_FORCEINLINE void draw_glyph(const Font_Glyph* glyph, Font& font, f32 x, f32 y, const ch::Color& color, f32 z_index = 9.f) {
 	imm_begin();
 	imm_glyph(glyph, font, x, y, color, z_index);
 	imm_flush();
 }
 
-const Font_Glyph* imm_char(const u32 c, const Font& font, f32 x, f32 y, const ch::Color& color, f32 z_index = 9.f);
-CH_FORCEINLINE void draw_char(const u32 c, const Font& font, f32 x, f32 y, const ch::Color& color, f32 z_index = 9.f) {
+const Font_Glyph* imm_char(const u32 c, Font& font, f32 x, f32 y, const ch::Color& color, f32 z_index = 9.f);
+CH_FORCEINLINE void draw_char(const u32 c, Font& font, f32 x, f32 y, const ch::Color& color, f32 z_index = 9.f) {
 	imm_begin();
 	imm_char(c, font, x, y, color, z_index);
 	imm_flush();
 }
 
-ch::Vector2 imm_string(const ch::String& s, const Font& font, f32 x, f32 y, const ch::Color& color, f32 z_index = 9.f);
-CH_FORCEINLINE ch::Vector2 draw_string(const ch::String& s, const Font& font, f32 x, f32 y, const ch::Color& color, f32 z_index = 9.f) {
+ch::Vector2 imm_string(const ch::String& s, Font& font, f32 x, f32 y, const ch::Color& color, f32 z_index = 9.f);
+CH_FORCEINLINE ch::Vector2 draw_string(const ch::String& s, Font& font, f32 x, f32 y, const ch::Color& color, f32 z_index = 9.f) {
 	font.bind();
 	imm_begin();
 	const ch::Vector2 result = imm_string(s, font, x, y, color, z_index);
@@ -93,10 +457,10 @@ CH_FORCEINLINE ch::Vector2 draw_string(const ch::String& s, const Font& font, f3
 	return result;
 }
 
-CH_FORCEINLINE ch::Vector2 imm_string(const char* s, const Font& font, f32 x, f32 y, const ch::Color& color, f32 z_index = 9.f) {
+CH_FORCEINLINE ch::Vector2 imm_string(const char* s, Font& font, f32 x, f32 y, const ch::Color& color, f32 z_index = 9.f) {
 	return imm_string(ch::make_stack_string(s), font, x, y, color, z_index);
 }
-CH_FORCEINLINE ch::Vector2 draw_string(const char* s, const Font& font, f32 x, f32 y, const ch::Color& color, f32 z_index = 9.f) {
+CH_FORCEINLINE ch::Vector2 draw_string(const char* s, Font& font, f32 x, f32 y, const ch::Color& color, f32 z_index = 9.f) {
 	font.bind();
 	imm_begin();
 	const ch::Vector2 result = imm_string(s, font, x, y, color, z_index);
@@ -104,8 +468,8 @@ CH_FORCEINLINE ch::Vector2 draw_string(const char* s, const Font& font, f32 x, f
 	return result;
 }
 
-ch::Vector2 get_string_draw_size(const ch::String& s, const Font& font);
-CH_FORCEINLINE ch::Vector2 get_string_draw_size(const char* s, const Font& font) {
+ch::Vector2 get_string_draw_size(const ch::String& s, Font& font);
+CH_FORCEINLINE ch::Vector2 get_string_draw_size(const char* s, Font& font) {
 	return get_string_draw_size(ch::make_stack_string(s), font);
 }
 
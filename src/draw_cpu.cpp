@@ -0,0 +1,234 @@
+#include "draw.h"
+
+#include <math.h>
+
+/* NULL BACKEND */
+
+// Everything the null backend does is counted by the immediate layer on flush, so it only needs somewhere to write.
+static Imm_Instance null_region[imm_region_size];
+
+static void null_init() {}
+static void null_upload_atlas(const Font* font, u16 size) {}
+static void null_update_atlas(const Font* font, u16 size, u32 x0, u32 y0, u32 x1, u32 y1) {}
+static void null_update_glyph(const Font* font, u16 size, u32 glyph_index) {}
+static void null_free_atlas(const Font* font, u16 size) {}
+static usize null_get_atlas_texture_bytes(const Font* font, u16 size) { return 0; }
+static void null_bind_font(const Font& font) {}
+static bool null_frame_begin(u32 width, u32 height) { return true; }
+static void null_clear_rect(s32 x0, s32 y0, s32 x1, s32 y1) {}
+static Imm_Instance* null_next_region() { return null_region; }
+static void null_draw(const Imm_Instance* first, u32 count) {}
+static void null_frame_end() {}
+
+const Draw_Backend null_draw_backend = {
+	"null",
+	null_init,
+	null_upload_atlas,
+	null_update_atlas,
+	null_update_glyph,
+	null_free_atlas,
+	null_get_atlas_texture_bytes,
+	null_bind_font,
+	null_frame_begin,
+	null_clear_rect,
+	null_next_region,
+	null_draw,
+	null_frame_end,
+};
+
+/* CPU BACKEND */
+
+// Same job as the shader: solid quads are filled, glyphs are copied out of the atlas with nearest sampling
+// and everything is alpha blended in submission order. There's no depth buffer, z_index is ignored.
+// Glyphs are read straight out of the font's CPU side atlas page so there's nothing to upload.
+
+static const Font* cpu_font;
+static Draw_Image cpu_image;
+static Imm_Instance cpu_region[imm_region_size];
+
+static s32 clip_x0, clip_y0, clip_x1, clip_y1;
+
+const u32 cpu_clear_color = 0xFF000000;
+
+const Draw_Image& get_cpu_draw_image() {
+	return cpu_image;
+}
+
+static CH_FORCEINLINE u32 blend_channel(u32 src, u32 dst, u32 alpha) {
+	return (src * alpha + dst * (255 - alpha) + 127) / 255;
+}
+
+static CH_FORCEINLINE void blend_pixel(u32* dst, u32 color, u32 alpha) {
+	if (!alpha) return;
+
+	const u32 d = *dst;
+	const u32 r = blend_channel(color & 0xFF, d & 0xFF, alpha);
+	const u32 g = blend_channel((color >> 8) & 0xFF, (d >> 8) & 0xFF, alpha);
+	const u32 b = blend_channel((color >> 16) & 0xFF, (d >> 16) & 0xFF, alpha);
+	*dst = r | (g << 8) | (b << 16) | (d & 0xFF000000);
+}
+
+static void cpu_init() {}
+
+static void cpu_upload_atlas(const Font* font, u16 size) {}
+static void cpu_update_atlas(const Font* font, u16 size, u32 x0, u32 y0, u32 x1, u32 y1) {}
+static void cpu_update_glyph(const Font* font, u16 size, u32 glyph_index) {}
+static void cpu_free_atlas(const Font* font, u16 size) {}
+
+// Glyphs are read straight out of the font's CPU pages.
+static usize cpu_get_atlas_texture_bytes(const Font* font, u16 size) {
+	return 0;
+}
+
+static void cpu_bind_font(const Font& font) {
+	cpu_font = &font;
+}
+
+static bool cpu_frame_begin(u32 width, u32 height) {
+	clip_x0 = 0;
+	clip_y0 = 0;
+	clip_x1 = (s32)width;
+	clip_y1 = (s32)height;
+
+	if (cpu_image.pixels && cpu_image.width == width && cpu_image.height == height) return false;
+
+	if (cpu_image.pixels) ch_delete[] cpu_image.pixels;
+	cpu_image.width = width;
+	cpu_image.height = height;
+	cpu_image.pixels = ch_new u32[width * height];
+	for (usize i = 0; i < (usize)width * height; i += 1) {
+		cpu_image.pixels[i] = cpu_clear_color;
+	}
+
+	return true;
+}
+
+static void cpu_clear_rect(s32 x0, s32 y0, s32 x1, s32 y1) {
+	clip_x0 = x0 < 0 ? 0 : x0;
+	clip_y0 = y0 < 0 ? 0 : y0;
+	clip_x1 = x1 > (s32)cpu_image.width ? (s32)cpu_image.width : x1;
+	clip_y1 = y1 > (s32)cpu_image.height ? (s32)cpu_image.height : y1;
+
+	for (s32 y = clip_y0; y < clip_y1; y += 1) {
+		u32* row = cpu_image.pixels + (usize)y * cpu_image.width;
+		for (s32 x = clip_x0; x < clip_x1; x += 1) {
+			row[x] = cpu_clear_color;
+		}
+	}
+}
+
+static Imm_Instance* cpu_next_region() {
+	return cpu_region;
+}
+
+static void cpu_draw_quad(const Imm_Instance& it) {
+	// Quads are always on whole pixels
+	s32 x0 = it.x / imm_subpixels;
+	s32 y0 = it.y / imm_subpixels;
+	s32 x1 = x0 + it.width;
+	s32 y1 = y0 + it.height;
+	if (x0 < clip_x0) x0 = clip_x0;
+	if (y0 < clip_y0) y0 = clip_y0;
+	if (x1 > clip_x1) x1 = clip_x1;
+	if (y1 > clip_y1) y1 = clip_y1;
+
+	const u32 alpha = it.color >> 24;
+	for (s32 y = y0; y < y1; y += 1) {
+		u32* row = cpu_image.pixels + (usize)y * cpu_image.width;
+		for (s32 x = x0; x < x1; x += 1) {
+			blend_pixel(&row[x], it.color, alpha);
+		}
+	}
+}
+
+static void cpu_draw_glyph(const Imm_Instance& it) {
+	if (!cpu_font) return;
+
+	const Font_Atlas& atlas = cpu_font->atlases[cpu_font->get_raster_size()];
+	if (!atlas.bitmap) return;
+
+	// Metrics at the current size. Only differs from the page's in SDF mode.
+	const Font_Glyph& glyph = cpu_font->atlases[cpu_font->size].glyphs[it.rect];
+	if (glyph.width <= 0.f || glyph.height <= 0.f) return;
+
+	// Pending glyphs sample the fallback size's texels, stretched to this size's metrics.
+	const Font_Atlas* page = &atlas;
+	const Font_Glyph* texels = &atlas.glyphs[it.rect];
+	if (texels->shelf == glyph_pending) {
+		page = &cpu_font->atlases[atlas.fallback_size];
+		texels = &page->glyphs[it.rect];
+	}
+	if (texels->shelf >= glyph_pending || !page->bitmap) return;
+
+	// Rounded once here, like the GL backend does, so the texels line up with pixels
+	const f32 gx0 = floorf((f32)it.x / (f32)imm_subpixels + glyph.bearing_x + 0.5f);
+	const f32 gy0 = floorf((f32)it.y / (f32)imm_subpixels + glyph.bearing_y + 0.5f);
+
+	s32 x0 = (s32)gx0;
+	s32 y0 = (s32)gy0;
+	s32 x1 = (s32)(gx0 + glyph.width + 0.5f);
+	s32 y1 = (s32)(gy0 + glyph.height + 0.5f);
+	if (x0 < clip_x0) x0 = clip_x0;
+	if (y0 < clip_y0) y0 = clip_y0;
+	if (x1 > clip_x1) x1 = clip_x1;
+	if (y1 > clip_y1) y1 = clip_y1;
+
+	// Texels per pixel, more than 1 when the atlas is oversampled.
+	const f32 u_scale = (f32)(texels->x1 - texels->x0) / glyph.width;
+	const f32 v_scale = (f32)(texels->y1 - texels->y0) / glyph.height;
+
+	// Distance field change across one pixel, the outline is smoothed over that.
+	const f32 sdf_pixel_range = sdf_pixel_dist_scale * u_scale;
+
+	const u32 color_alpha = it.color >> 24;
+	for (s32 y = y0; y < y1; y += 1) {
+		u32 v = texels->y0 + (u32)(((f32)y + 0.5f - gy0) * v_scale);
+		if (v >= texels->y1) v = texels->y1 - 1;
+
+		const u8* src = page->bitmap + (usize)v * page->w;
+		u32* row = cpu_image.pixels + (usize)y * cpu_image.width;
+		for (s32 x = x0; x < x1; x += 1) {
+			u32 u = texels->x0 + (u32)(((f32)x + 0.5f - gx0) * u_scale);
+			if (u >= texels->x1) u = texels->x1 - 1;
+
+			u32 coverage = src[u];
+			if (page->sdf) {
+				f32 t = ((f32)src[u] - (f32)sdf_on_edge) / sdf_pixel_range + 0.5f;
+				if (t < 0.f) t = 0.f;
+				if (t > 1.f) t = 1.f;
+				coverage = (u32)(t * 255.f + 0.5f);
+			}
+
+			blend_pixel(&row[x], it.color, (coverage * color_alpha + 127) / 255);
+		}
+	}
+}
+
+static void cpu_draw(const Imm_Instance* first, u32 count) {
+	for (u32 i = 0; i < count; i += 1) {
+		const Imm_Instance& it = first[i];
+		if (it.rect == solid_quad_rect) {
+			cpu_draw_quad(it);
+		} else {
+			cpu_draw_glyph(it);
+		}
+	}
+}
+
+static void cpu_frame_end() {}
+
+const Draw_Backend cpu_draw_backend = {
+	"cpu",
+	cpu_init,
+	cpu_upload_atlas,
+	cpu_update_atlas,
+	cpu_update_glyph,
+	cpu_free_atlas,
+	cpu_get_atlas_texture_bytes,
+	cpu_bind_font,
+	cpu_frame_begin,
+	cpu_clear_rect,
+	cpu_next_region,
+	cpu_draw,
+	cpu_frame_end,
+};
@@ -0,0 +1,570 @@
+#include "draw.h"
+#include "editor.h"
+
+#include <ch_stl/array.h>
+#include <ch_stl/filesystem.h>
+#include <ch_stl/memory.h>
+#include <ch_stl/opengl.h>
+
+#include <stddef.h>
+#include <string.h>
+
+// Layout of one entry in the rect table, two RGBA32F texels.
+struct Glyph_Rect {
+	f32 u0, v0, u1, v1;
+	f32 bearing_x, bearing_y;
+	f32 width, height;
+};
+
+struct Shader {
+	GLuint program_id;
+
+	GLint projection_loc;
+	GLint view_loc;
+
+	GLuint texture_loc;
+	GLuint rects_loc;
+	GLuint fallback_loc;
+	GLuint glyph_scale_loc;
+	GLuint sdf_loc;
+	GLuint subpixels_loc;
+};
+
+// Instances are written straight into a persistently mapped buffer which is split into regions,
+// one per frame in flight. A region is fenced once its frame is submitted and waited on before
+// it gets written to again, so the CPU never stomps on data the GPU is still reading.
+#define IMM_RING_REGIONS 3
+
+static GLuint imm_vao;
+static GLuint imm_vbo;
+static Imm_Instance* imm_ring;
+static GLsync imm_ring_fences[IMM_RING_REGIONS];
+static u32 imm_ring_region;
+
+// Without buffer storage and base instance draws (GL 4.4) the ring is plain memory with a single region,
+// and each draw uploads its instances to the start of a buffer the size of one region.
+static bool imm_ring_persistent;
+
+ch::Matrix4 projection_matrix;
+ch::Matrix4 view_matrix;
+
+Shader global_shader;
+
+// Atlas updates happen mid frame so they put this back when they're done.
+static GLuint bound_atlas_id;
+
+// Every instance is a screen aligned quad which gets expanded here from gl_VertexID.
+// Glyphs look their uv rect and metrics up in the rect table, solid quads carry their own size.
+const GLchar* global_shader_source = R"foo(
+#ifdef VERTEX
+layout(location = 0) in ivec2 position;
+layout(location = 1) in uvec2 size;
+layout(location = 2) in uvec2 rect_z;
+layout(location = 3) in vec4 color;
+uniform mat4 projection;
+uniform mat4 view;
+uniform samplerBuffer rects;
+uniform float glyph_scale;
+uniform float subpixels;
+out vec4 out_color;
+out vec2 out_uv;
+flat out uint out_page;
+const vec2 corners[6] = vec2[6](vec2(0, 0), vec2(0, 1), vec2(1, 0), vec2(0, 1), vec2(1, 1), vec2(1, 0));
+void main() {
+	vec2 corner = corners[gl_VertexID];
+	vec2 pen = vec2(position) / subpixels;
+	vec2 p;
+	if (rect_z.x == 0xFFFFu) {
+		p = floor(pen + 0.5) + corner * vec2(size);
+		out_uv = vec2(0.0, 0.0);
+		out_page = 0u;
+	} else {
+		vec4 uv_rect = texelFetch(rects, int(rect_z.x) * 2);
+		vec4 metrics = texelFetch(rects, int(rect_z.x) * 2 + 1);
+		// Only where the glyph lands is rounded, so texels stay lined up with pixels
+		p = floor(pen + metrics.xy * glyph_scale + 0.5) + corner * abs(metrics.zw) * glyph_scale;
+		out_uv = mix(uv_rect.xy, uv_rect.zw, corner);
+		out_page = metrics.z < 0.0 ? 2u : 1u;
+	}
+    gl_Position = projection * view * vec4(p.x, -p.y, -float(rect_z.y), 1.0);
+	out_color = color;
+}
+
+#endif
+#ifdef FRAGMENT
+out vec4 frag_color;
+in vec4 out_color;
+in vec2 out_uv;
+flat in uint out_page;
+uniform sampler2D ftex;
+uniform sampler2D fallback_tex;
+uniform int sdf;
+void main() {
+	if (out_page == 0u) frag_color = out_color;
+	else {
+		vec4 texel = out_page == 1u ? texture(ftex, out_uv) : texture(fallback_tex, out_uv);
+		float coverage = texel.r;
+		if (sdf != 0) {
+			// The outline sits at 0.5, smooth across about a pixel whatever the scale.
+			float width = fwidth(coverage) * 0.75;
+			coverage = smoothstep(0.5 - width, 0.5 + width, coverage);
+		}
+		frag_color = vec4(out_color.xyz, coverage);
+	}
+}
+#endif
+)foo";
+
+static bool load_shader_from_source(const GLchar* source, Shader* out_shader) {
+	Shader result;
+	GLuint program_id = glCreateProgram();
+
+	GLuint vertex_id = glCreateShader(GL_VERTEX_SHADER);
+	GLuint frag_id = glCreateShader(GL_FRAGMENT_SHADER);
+
+	const GLchar* shader_header = "#version 330 core\n#extension GL_ARB_separate_shader_objects: enable\n";
+
+	const GLchar* vert_shader[3] = { shader_header, "#define VERTEX 1\n", source };
+	const GLchar* frag_shader[3] = { shader_header, "#define FRAGMENT 1\n", source };
+
+	glShaderSource(vertex_id, 3, vert_shader, 0);
+	glShaderSource(frag_id, 3, frag_shader, 0);
+
+	glCompileShader(vertex_id);
+	glCompileShader(frag_id);
+
+	glAttachShader(program_id, vertex_id);
+	glAttachShader(program_id, frag_id);
+
+	glLinkProgram(program_id);
+
+	glValidateProgram(program_id);
+
+	GLint is_linked = false;
+	glGetProgramiv(program_id, GL_LINK_STATUS, &is_linked);
+	if (!is_linked) {
+		GLsizei ignored;
+		char vert_errors[4096];
+		char frag_errors[4096];
+		char program_errors[4096];
+
+		glGetShaderInfoLog(vertex_id, sizeof(vert_errors), &ignored, vert_errors);
+		glGetShaderInfoLog(frag_id, sizeof(frag_errors), &ignored, frag_errors);
+		glGetProgramInfoLog(program_id, sizeof(program_errors), &ignored, program_errors);
+		return false;
+	}
+
+	glDeleteShader(vertex_id);
+	glDeleteShader(frag_id);
+
+	result.program_id = program_id;
+	result.projection_loc = glGetUniformLocation(program_id, "projection");
+	result.view_loc = glGetUniformLocation(program_id, "view");
+	result.texture_loc = glGetUniformLocation(program_id, "ftex");
+	result.rects_loc = glGetUniformLocation(program_id, "rects");
+	result.fallback_loc = glGetUniformLocation(program_id, "fallback_tex");
+	result.glyph_scale_loc = glGetUniformLocation(program_id, "glyph_scale");
+	result.sdf_loc = glGetUniformLocation(program_id, "sdf");
+	result.subpixels_loc = glGetUniformLocation(program_id, "subpixels");
+
+	*out_shader = result;
+
+	return true;
+}
+
+static void gl_error_callback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* userParam) {
+	if (severity != GL_DEBUG_SEVERITY_NOTIFICATION) {
+		ch::std_out << "GL CALLBACK: " << message << ch::eol;
+	}
+}
+
+static bool has_gl_extension(const char* name) {
+	GLint num_extensions = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+	for (GLint i = 0; i < num_extensions; i++) {
+		const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+		if (extension && strcmp(extension, name) == 0) return true;
+	}
+	return false;
+}
+
+static bool can_persistently_map() {
+	GLint major = 0;
+	GLint minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	if (major > 4 || (major == 4 && minor >= 4)) return true;
+
+	return has_gl_extension("GL_ARB_buffer_storage") && has_gl_extension("GL_ARB_base_instance");
+}
+
+/** GL objects for every size of one font. Only the backend knows about them, fonts are found by address. */
+struct Gl_Font_Textures {
+	const Font* font;
+	GLuint atlas_ids[Font::num_atlases];
+
+	// Per glyph uv rect and metrics, read by the shader through a texture buffer.
+	GLuint rect_buffer_ids[Font::num_atlases];
+	GLuint rect_texture_ids[Font::num_atlases];
+};
+
+// Hardly ever more than one, so a linear search is plenty
+static ch::Array<Gl_Font_Textures> gl_fonts;
+
+/** @returns the font's GL objects, all 0 for sizes that haven't been uploaded. Only valid until the next call. */
+static Gl_Font_Textures* get_gl_font_textures(const Font* font) {
+	for (usize i = 0; i < gl_fonts.count; i += 1) {
+		if (gl_fonts[i].font == font) return &gl_fonts[i];
+	}
+
+	Gl_Font_Textures textures;
+	ch::mem_zero(&textures, sizeof(textures));
+	textures.font = font;
+	gl_fonts.push(textures);
+	return &gl_fonts[gl_fonts.count - 1];
+}
+
+static void gl_init() {
+	assert(ch::is_gl_loaded());
+
+	gl_fonts.allocator = ch::get_heap_allocator();
+
+	glGenVertexArrays(1, &imm_vao);
+	glBindVertexArray(imm_vao);
+
+	glGenBuffers(1, &imm_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, imm_vbo);
+
+	imm_ring_persistent = can_persistently_map();
+	if (imm_ring_persistent) {
+		const GLbitfield ring_flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		const GLsizeiptr ring_size = sizeof(Imm_Instance) * imm_region_size * IMM_RING_REGIONS;
+		glBufferStorage(GL_ARRAY_BUFFER, ring_size, nullptr, ring_flags);
+		imm_ring = (Imm_Instance*)glMapBufferRange(GL_ARRAY_BUFFER, 0, ring_size, ring_flags);
+		assert(imm_ring);
+		// Start on the last region so the first call to gl_next_region hands out the first one.
+		imm_ring_region = IMM_RING_REGIONS - 1;
+	} else {
+		glBufferData(GL_ARRAY_BUFFER, sizeof(Imm_Instance) * imm_region_size, nullptr, GL_STREAM_DRAW);
+		imm_ring = ch_new Imm_Instance[imm_region_size];
+		imm_ring_region = 0;
+	}
+
+	// The layout never changes, draws pick their slice of the ring through the base instance.
+	glVertexAttribIPointer(0, 2, GL_SHORT, sizeof(Imm_Instance), (void*)offsetof(Imm_Instance, x));
+	glVertexAttribDivisor(0, 1);
+	glEnableVertexAttribArray(0);
+
+	glVertexAttribIPointer(1, 2, GL_UNSIGNED_SHORT, sizeof(Imm_Instance), (void*)offsetof(Imm_Instance, width));
+	glVertexAttribDivisor(1, 1);
+	glEnableVertexAttribArray(1);
+
+	glVertexAttribIPointer(2, 2, GL_UNSIGNED_SHORT, sizeof(Imm_Instance), (void*)offsetof(Imm_Instance, rect));
+	glVertexAttribDivisor(2, 1);
+	glEnableVertexAttribArray(2);
+
+	glVertexAttribPointer(3, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Imm_Instance), (void*)offsetof(Imm_Instance, color));
+	glVertexAttribDivisor(3, 1);
+	glEnableVertexAttribArray(3);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glEnable(GL_BLEND);
+	glEnable(GL_MULTISAMPLE);
+	glEnable(GL_DEPTH_TEST);
+	glClearDepth(1.f);
+	glDepthFunc(GL_LEQUAL);
+	glClearColor(ch::black);
+
+#if BUILD_DEBUG
+	glEnable(GL_DEBUG_OUTPUT);
+	glDebugMessageCallback(gl_error_callback, 0);
+#endif
+
+#if CH_PLATFORM_WINDOWS
+	wglSwapIntervalEXT(false);
+#endif
+
+	const bool global_shader_loaded = load_shader_from_source(global_shader_source, &global_shader);
+	assert(global_shader_loaded);
+	glUseProgram(global_shader.program_id);
+}
+
+
+void refresh_shader_transform() {
+	glUniformMatrix4fv(global_shader.view_loc, 1, GL_FALSE, view_matrix.elems);
+	glUniformMatrix4fv(global_shader.projection_loc, 1, GL_FALSE, projection_matrix.elems);
+}
+
+void render_right_handed() {
+	const ch::Vector2 viewport_size = get_viewport_size();
+
+	const f32 width = (f32)viewport_size.ux;
+	const f32 height = (f32)viewport_size.uy;
+
+	const f32 aspect_ratio = width / height;
+
+	const f32 f = 10.f;
+	const f32 n = 1.f;
+
+	const f32 ortho_size = height / 2.f;
+
+	projection_matrix = ch::ortho(ortho_size, aspect_ratio, f, n);
+	view_matrix       = ch::translate(ch::Vector2(-width / 2.f, ortho_size));
+
+	refresh_shader_transform();
+}
+
+// Fences the region we were writing and moves on to the next one, waiting for the GPU if it's still reading it.
+static Imm_Instance* gl_next_region() {
+	// Draws upload what they use straight away, so the one region can be written again as soon as they're issued
+	if (!imm_ring_persistent) return imm_ring;
+
+	imm_ring_fences[imm_ring_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	imm_ring_region = (imm_ring_region + 1) % IMM_RING_REGIONS;
+
+	GLsync fence = imm_ring_fences[imm_ring_region];
+	if (fence) {
+		for (;;) {
+			const GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000 * 1000);
+			if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED || result == GL_WAIT_FAILED) break;
+		}
+		glDeleteSync(fence);
+		imm_ring_fences[imm_ring_region] = 0;
+	}
+
+	return imm_ring + imm_ring_region * imm_region_size;
+}
+
+static void make_glyph_rect(Glyph_Rect* rect, const Font& font, u16 size, u32 glyph_index) {
+	const Font_Atlas& atlas = font.atlases[size];
+	const Font_Glyph& glyph = atlas.glyphs[glyph_index];
+
+	// Pending glyphs borrow the fallback size's bitmap, stretched to this size's metrics.
+	const Font_Atlas* page = &atlas;
+	const Font_Glyph* texels = &glyph;
+	if (glyph.shelf == glyph_pending) {
+		page = &font.atlases[atlas.fallback_size];
+		texels = &page->glyphs[glyph_index];
+	}
+
+	// Glyphs that aren't in a page get an empty rect so they draw nothing.
+	if (texels->shelf >= glyph_pending) {
+		*rect = {};
+		return;
+	}
+
+	rect->u0 = texels->x0 / (f32)page->w;
+	rect->v0 = texels->y0 / (f32)page->h;
+	rect->u1 = texels->x1 / (f32)page->w;
+	rect->v1 = texels->y1 / (f32)page->h;
+	rect->bearing_x = glyph.bearing_x;
+	rect->bearing_y = glyph.bearing_y;
+	rect->height = glyph.height;
+
+	// The shader reads a negative width as "sample the fallback page".
+	rect->width = page == &atlas ? glyph.width : -glyph.width;
+}
+
+static void gl_upload_atlas(const Font* font, u16 size) {
+	const Font_Atlas& atlas = font->atlases[size];
+	Gl_Font_Textures* const textures = get_gl_font_textures(font);
+
+	if (!textures->atlas_ids[size]) {
+		glGenTextures(1, &textures->atlas_ids[size]);
+		glGenTextures(1, &textures->rect_texture_ids[size]);
+		glGenBuffers(1, &textures->rect_buffer_ids[size]);
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glBindTexture(GL_TEXTURE_2D, textures->atlas_ids[size]);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, atlas.w, atlas.h, 0, GL_RED, GL_UNSIGNED_BYTE, atlas.bitmap);
+	glBindTexture(GL_TEXTURE_2D, bound_atlas_id);
+
+	// The glyph instances only carry an index, the shader looks the rest up here.
+	// Two texels per glyph: the uv rect and then bearing plus size.
+	// Sized for glyph_capacity so glyphs borrowed from fallbacks later only need their own rect updated.
+	Glyph_Rect* rects = ch_new Glyph_Rect[font->glyph_capacity];
+	defer(ch_delete[] rects);
+	for (u32 i = 0; i < font->glyph_capacity; i++) {
+		if (i < font->num_glyphs) make_glyph_rect(&rects[i], *font, size, i);
+		else rects[i] = {};
+	}
+
+	glBindBuffer(GL_TEXTURE_BUFFER, textures->rect_buffer_ids[size]);
+	glBufferData(GL_TEXTURE_BUFFER, sizeof(Glyph_Rect) * font->glyph_capacity, rects, GL_DYNAMIC_DRAW);
+	glBindTexture(GL_TEXTURE_BUFFER, textures->rect_texture_ids[size]);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, textures->rect_buffer_ids[size]);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+static void gl_update_atlas(const Font* font, u16 size, u32 x0, u32 y0, u32 x1, u32 y1) {
+	const Font_Atlas& atlas = font->atlases[size];
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, atlas.w);
+	glBindTexture(GL_TEXTURE_2D, get_gl_font_textures(font)->atlas_ids[size]);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, x0, y0, x1 - x0, y1 - y0, GL_RED, GL_UNSIGNED_BYTE, atlas.bitmap + x0 + (usize)y0 * atlas.w);
+	glBindTexture(GL_TEXTURE_2D, bound_atlas_id);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+}
+
+static void gl_update_glyph(const Font* font, u16 size, u32 glyph_index) {
+	Glyph_Rect rect;
+	make_glyph_rect(&rect, *font, size, glyph_index);
+
+	glBindBuffer(GL_TEXTURE_BUFFER, get_gl_font_textures(font)->rect_buffer_ids[size]);
+	glBufferSubData(GL_TEXTURE_BUFFER, sizeof(Glyph_Rect) * glyph_index, sizeof(Glyph_Rect), &rect);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+static void gl_free_atlas(const Font* font, u16 size) {
+	Gl_Font_Textures* const textures = get_gl_font_textures(font);
+	if (!textures->atlas_ids[size]) return;
+
+	glDeleteTextures(1, &textures->atlas_ids[size]);
+	glDeleteTextures(1, &textures->rect_texture_ids[size]);
+	glDeleteBuffers(1, &textures->rect_buffer_ids[size]);
+	textures->atlas_ids[size] = 0;
+	textures->rect_texture_ids[size] = 0;
+	textures->rect_buffer_ids[size] = 0;
+}
+
+static usize gl_get_atlas_texture_bytes(const Font* font, u16 size) {
+	if (!get_gl_font_textures(font)->atlas_ids[size]) return 0;
+
+	// One byte a texel for the page, the rect table is sized for every glyph slot.
+	return font->atlases[size].get_page_size() + (usize)font->glyph_capacity * sizeof(Glyph_Rect);
+}
+
+static void gl_bind_font(const Font& font) {
+	refresh_shader_transform();
+	glUniform1i(global_shader.texture_loc, 0);
+	glUniform1i(global_shader.rects_loc, 1);
+	glUniform1i(global_shader.fallback_loc, 2);
+
+	// In SDF mode the rect table is the SDF page's, so zooming only changes the scale.
+	const u16 raster_size = font.get_raster_size();
+	const Font_Atlas& atlas = font.atlases[raster_size];
+	const Gl_Font_Textures* const textures = get_gl_font_textures(&font);
+	glUniform1f(global_shader.glyph_scale_loc, (f32)font.size / (f32)raster_size);
+	glUniform1i(global_shader.sdf_loc, atlas.sdf ? 1 : 0);
+	glUniform1f(global_shader.subpixels_loc, (f32)imm_subpixels);
+
+	// While a size is still rasterizing its glyphs are drawn out of the fallback size's page.
+	if (atlas.fallback_size) {
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_2D, textures->atlas_ids[atlas.fallback_size]);
+	}
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_BUFFER, textures->rect_texture_ids[raster_size]);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, textures->atlas_ids[raster_size]);
+	bound_atlas_id = textures->atlas_ids[raster_size];
+}
+
+// Views only redraw what changed, so we draw into our own framebuffer that survives swaps and blit it out every frame.
+static GLuint backbuffer_fbo = 0;
+static GLuint backbuffer_color = 0;
+static GLuint backbuffer_depth = 0;
+static u32 backbuffer_width = 0;
+static u32 backbuffer_height = 0;
+
+// @returns true if the backbuffer was (re)created and its contents are garbage.
+static bool ensure_backbuffer(u32 width, u32 height) {
+	if (backbuffer_fbo && backbuffer_width == width && backbuffer_height == height) return false;
+
+	if (!backbuffer_fbo) {
+		glGenFramebuffers(1, &backbuffer_fbo);
+		glGenTextures(1, &backbuffer_color);
+		glGenRenderbuffers(1, &backbuffer_depth);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, backbuffer_color);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glBindRenderbuffer(GL_RENDERBUFFER, backbuffer_depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, backbuffer_fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, backbuffer_color, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, backbuffer_depth);
+	assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+
+	backbuffer_width = width;
+	backbuffer_height = height;
+
+	return true;
+}
+
+static bool gl_frame_begin(u32 width, u32 height) {
+	const bool lost_backbuffer = ensure_backbuffer(width, height);
+	glBindFramebuffer(GL_FRAMEBUFFER, backbuffer_fbo);
+
+	glViewport(0, 0, width, height);
+	glDisable(GL_SCISSOR_TEST);
+	if (lost_backbuffer) glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(0, 0, width, height);
+
+	render_right_handed();
+
+	return lost_backbuffer;
+}
+
+static void gl_clear_rect(s32 x0, s32 y0, s32 x1, s32 y1) {
+	// GL's origin is bottom left while ours is top left.
+	glScissor(x0, (s32)backbuffer_height - y1, x1 - x0, y1 - y0);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+static void gl_draw(const Imm_Instance* first, u32 count) {
+	glBindVertexArray(imm_vao);
+	if (imm_ring_persistent) {
+		const u32 base_instance = (u32)(first - imm_ring);
+		glDrawArraysInstancedBaseInstance(GL_TRIANGLES, 0, 6, count, base_instance);
+	} else {
+		glBindBuffer(GL_ARRAY_BUFFER, imm_vbo);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Imm_Instance) * count, first);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glDrawArraysInstanced(GL_TRIANGLES, 0, 6, count);
+	}
+	glBindVertexArray(0);
+}
+
+static void gl_frame_end() {
+	glDisable(GL_SCISSOR_TEST);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, backbuffer_fbo);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glBlitFramebuffer(0, 0, backbuffer_width, backbuffer_height, 0, 0, backbuffer_width, backbuffer_height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	ch::swap_buffers(the_window);
+}
+
+const Draw_Backend gl_draw_backend = {
+	"gl",
+	gl_init,
+	gl_upload_atlas,
+	gl_update_atlas,
+	gl_update_glyph,
+	gl_free_atlas,
+	gl_get_atlas_texture_bytes,
+	gl_bind_font,
+	gl_frame_begin,
+	gl_clear_rect,
+	gl_next_region,
+	gl_draw,
+	gl_frame_end,
+};
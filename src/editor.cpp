@@ -5,14 +5,21 @@
 #include "input.h"
 #include "buffer_view.h"
 #include "config.h"
+#include "os.h"
+#include "journal.h"
 #include "buffer.h"
+#include "file_picker.h"
+#include "search.h"
 
 #include <ch_stl/opengl.h>
 #include <ch_stl/time.h>
 #include <ch_stl/hash_table.h>
 
+#include <string.h>
+
 #if CH_PLATFORM_WINDOWS
 #include "win32/icon_win32.h"
+#include <stdlib.h>
 #endif
 
 ch::Window the_window;
@@ -27,11 +34,25 @@ int num_vertices_total;
 #define DEBUG_AVERAGE_FILE 0
 
 void tick_editor(f32 dt) {
-	frame_begin();
-	
-	tick_gui();
+	// Pick up any font sizes the workers finished rasterizing. Bumps the atlas version so everything redraws.
+	the_font.finish_pending_atlases();
+	the_font.free_idle_atlases();
+	tick_buffers();
+	tick_file_picker();
+	tick_search();
+
 	tick_views(dt);
 
+	// Nothing on screen would change so don't touch the gpu at all
+	const bool gui_dirty = gui_needs_redraw();
+	if (!gui_dirty && !views_need_redraw()) return;
+
+	const bool lost_backbuffer = frame_begin();
+	const bool full_redraw = lost_backbuffer || gui_dirty;
+	
+	tick_gui(full_redraw);
+	draw_views(full_redraw);
+
 	frame_end();
 }
 
@@ -58,10 +79,114 @@ extern "C" {
 }
 #endif
 
+static bool load_default_font() {
+	// @TEMP(CHall): Load font and get size
+	ch::Path p = ch::get_os_font_path();
+	p.append("consola.ttf");
+	if (!load_font_from_path(p, &the_font)) return false;
+
+	// Symbols and box drawing, then CJK, then emoji. Only opened once a codepoint falls through to them.
+	const char* fallback_names[] = { "seguisym.ttf", "msgothic.ttc", "malgun.ttf", "seguiemj.ttf" };
+	for (usize i = 0; i < sizeof(fallback_names) / sizeof(fallback_names[0]); i += 1) {
+		ch::Path fallback_path = ch::get_os_font_path();
+		fallback_path.append(fallback_names[i]);
+		add_font_fallback(&the_font, fallback_path);
+	}
+
+	the_font.size = get_config().font_size;
+	the_font.sdf = get_config().font_sdf;
+	the_font.pack_atlas();
+	return true;
+}
+
+/**
+ * Draws a file headlessly a page per frame from top to bottom, so every frame lays out lines it hasn't seen,
+ * and reports what the CPU side of a frame costs. Nothing is presented.
+ *
+ * @param backend is null_draw_backend to time just building frames or cpu_draw_backend to include rasterizing them
+ */
+static int run_benchmark(const char* path, const Draw_Backend* backend) {
+	const u32 width = 1920;
+	const u32 height = 1080;
+	const usize max_frames = 2000;
+
+	set_draw_backend(backend);
+	set_headless_viewport(width, height);
+	init_draw();
+
+	if (!load_default_font()) {
+		ch::std_out << "bench: failed to load font" << ch::eol;
+		return 1;
+	}
+
+	Buffer_ID buffer = create_buffer();
+	push_view(buffer);
+	Buffer* const b = find_buffer(buffer);
+	if (!b->load_file_into_buffer(path)) {
+		ch::std_out << "bench: failed to load " << path << ch::eol;
+		return 1;
+	}
+
+	ch::Allocator temp_arena = ch::make_arena_allocator(1024 * 1024 * 32);
+	ch::context_allocator = temp_arena;
+
+	const f32 line_height = (f32)the_font.size + the_font.line_gap;
+	const f32 total_height = (f32)b->eol_table.count * line_height;
+
+	// Parsing isn't what we're measuring, so get it out of the way first.
+	tick_views(0.f);
+	reset_draw_stats();
+
+	Buffer_View* const view = get_view(0);
+	usize frames = 0;
+	const f64 start_time = ch::get_time_in_seconds();
+	for (f32 scroll_y = 0.f; scroll_y < total_height && frames < max_frames; scroll_y += (f32)height) {
+		ch::reset_arena_allocator(&temp_arena);
+
+		view->target_scroll_y = scroll_y;
+		view->current_scroll_y = scroll_y;
+		tick_views(0.f);
+
+		frame_begin();
+		tick_gui(true);
+		draw_views(true);
+		frame_end();
+
+		frames += 1;
+	}
+	const f64 elapsed = ch::get_time_in_seconds() - start_time;
+
+	const Draw_Stats& stats = get_draw_stats();
+	const f64 ns_per_instance = stats.instances ? (elapsed * 1000000000.0) / (f64)stats.instances : 0.0;
+	const f64 instances_per_frame = frames ? (f64)stats.instances / (f64)frames : 0.0;
+	const f64 ms_per_frame = frames ? (elapsed * 1000.0) / (f64)frames : 0.0;
+
+	char report[512];
+	ch::sprintf(report, "bench [%s]: %llu frames, %.3f ms/frame, %.1f ns/instance, %.0f instances/frame, %.0f vertices/frame, %.1f KB/frame, %.1f draws/frame", 
+		backend->name, (u64)frames, ms_per_frame, ns_per_instance, instances_per_frame, instances_per_frame * 6.0, 
+		frames ? (f64)stats.bytes / (f64)frames / 1024.0 : 0.0, frames ? (f64)stats.draw_calls / (f64)frames : 0.0);
+	ch::std_out << report << ch::eol;
+
+	for (u16 i = 0; i < Font::num_atlases; i += 1) {
+		const Font_Atlas_Memory memory = the_font.get_atlas_memory(i);
+		if (!memory.get_cpu_bytes()) continue;
+
+		ch::sprintf(report, "bench: size %u, %.1f KB cpu (%.1f KB page), %.1f KB texture", 
+			(u32)i, (f64)memory.get_cpu_bytes() / 1024.0, (f64)memory.page_bytes / 1024.0, (f64)memory.texture_bytes / 1024.0);
+		ch::std_out << report << ch::eol;
+	}
+	ch::sprintf(report, "bench: %.1f KB codepoint tables", (f64)the_font.get_table_bytes() / 1024.0);
+	ch::std_out << report << ch::eol;
+
+	return 0;
+}
+
 #if CH_PLATFORM_WINDOWS
 int WinMain(HINSTANCE, HINSTANCE, LPSTR, int) {
+	const int argc = __argc;
+	char** const argv = __argv;
 #else
-int main() {
+int main(int argc, char** argv) {
 #endif
 
 #if CH_PLATFORM_WINDOWS
@@ -79,6 +204,12 @@ int main() {
 	init_config();
 	const Config& config = get_config();
 
+	// --bench <file> times building frames, --bench-cpu <file> also rasterizes them. Neither opens a window.
+	for (int i = 1; i + 1 < argc; i += 1) {
+		if (strcmp(argv[i], "--bench") == 0) return run_benchmark(argv[i + 1], &null_draw_backend);
+		if (strcmp(argv[i], "--bench-cpu") == 0) return run_benchmark(argv[i + 1], &cpu_draw_backend);
+	}
+
 	const bool gl_loaded = ch::load_gl();
 	assert(gl_loaded);
 	{
@@ -101,14 +232,24 @@ int main() {
         tick_editor(1.0f);
     };
 
+	init_jobs();
+	init_file_watcher(the_window.os_handle);
+	init_project(ch::get_current_path(), the_window.os_handle);
+	init_journals();
 	init_draw();
 	init_input();
 
 	Buffer_ID buffer = create_buffer();
 	push_view(buffer);
 
+	// Everything else on the command line is a file, a wildcard pattern or an @list of them. They load on workers while we start up
+	usize num_files_opened = 0;
+	for (int i = 1; i < argc; i += 1) {
+		num_files_opened += open_files(argv[i]);
+	}
+
 #if DEBUG_UTF8_FILE || DEBUG_LARGE_FILE || DEBUG_AVERAGE_FILE
-    {
+    if (!num_files_opened) {
         Buffer* const b = find_buffer(buffer);
 #if DEBUG_UTF8_FILE
 		const ch::Path path = "../test_files/utf8_test_file.txt";
@@ -125,15 +266,8 @@ int main() {
 #endif
 
 
-	// @TEMP(CHall): Load font and get size
-	{
-		ch::Path p = ch::get_os_font_path();
-		p.append("consola.ttf");
-		const bool loaded_font = load_font_from_path(p, &the_font);
-		assert(loaded_font);
-		the_font.size = get_config().font_size;
-		the_font.pack_atlas();
-	}
+	const bool loaded_font = load_default_font();
+	assert(loaded_font);
 
 	ch::Allocator temp_arena = ch::make_arena_allocator(1024 * 1024 * 32);
 	ch::context_allocator = temp_arena;
@@ -158,5 +292,8 @@ int main() {
 		}
 	}
 
+	flush_journals();
+	save_font_cache(the_font);
+	the_font.free();
 	shutdown_config();
 }
\ No newline at end of file
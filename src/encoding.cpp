@@ -0,0 +1,308 @@
+#include "encoding.h"
+
+#include <string.h>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define ENCODING_SSE2 1
+#include <emmintrin.h>
+#else
+#define ENCODING_SSE2 0
+#endif
+
+const u32 replacement_char = 0xFFFD;
+
+/** How much of a file without a bom is looked at when guessing if it's utf16. */
+const usize utf16_sample_size = 4096;
+
+static CH_FORCEINLINE u8* write_utf8(u32 c, u8* dest) {
+	if (c < 0x80) {
+		*dest++ = (u8)c;
+	} else if (c < 0x800) {
+		*dest++ = (u8)(0xC0 | (c >> 6));
+		*dest++ = (u8)(0x80 | (c & 0x3F));
+	} else if (c < 0x10000) {
+		*dest++ = (u8)(0xE0 | (c >> 12));
+		*dest++ = (u8)(0x80 | ((c >> 6) & 0x3F));
+		*dest++ = (u8)(0x80 | (c & 0x3F));
+	} else {
+		*dest++ = (u8)(0xF0 | (c >> 18));
+		*dest++ = (u8)(0x80 | ((c >> 12) & 0x3F));
+		*dest++ = (u8)(0x80 | ((c >> 6) & 0x3F));
+		*dest++ = (u8)(0x80 | (c & 0x3F));
+	}
+	return dest;
+}
+
+static CH_FORCEINLINE u32 read_utf16_unit(const u8* src, bool big_endian) {
+	if (big_endian) return ((u32)src[0] << 8) | src[1];
+	return ((u32)src[1] << 8) | src[0];
+}
+
+static CH_FORCEINLINE u8* write_utf16_unit(u32 unit, u8* dest, bool big_endian) {
+	if (big_endian) {
+		*dest++ = (u8)(unit >> 8);
+		*dest++ = (u8)unit;
+	} else {
+		*dest++ = (u8)unit;
+		*dest++ = (u8)(unit >> 8);
+	}
+	return dest;
+}
+
+static u8* write_encoded(Buffer_Encoding encoding, u32 c, u8* dest) {
+	switch (encoding) {
+		case BE_ANSI:
+			*dest++ = c <= 0xFF ? (u8)c : '?';
+			return dest;
+		case BE_UTF8:
+			return write_utf8(c, dest);
+		case BE_UTF16LE:
+		case BE_UTF16BE: {
+			const bool big_endian = encoding == BE_UTF16BE;
+			if (c < 0x10000) return write_utf16_unit(c, dest, big_endian);
+
+			c -= 0x10000;
+			dest = write_utf16_unit(0xD800 + (c >> 10), dest, big_endian);
+			return write_utf16_unit(0xDC00 + (c & 0x3FF), dest, big_endian);
+		}
+	}
+	return dest;
+}
+
+#if ENCODING_SSE2
+/** Writes 16 ascii bytes out in encoding. */
+static CH_FORCEINLINE u8* write_ascii_16(Buffer_Encoding encoding, __m128i v, u8* dest) {
+	const __m128i zero = _mm_setzero_si128();
+	switch (encoding) {
+		case BE_ANSI:
+		case BE_UTF8:
+			_mm_storeu_si128((__m128i*)dest, v);
+			return dest + 16;
+		case BE_UTF16LE:
+			_mm_storeu_si128((__m128i*)dest, _mm_unpacklo_epi8(v, zero));
+			_mm_storeu_si128((__m128i*)(dest + 16), _mm_unpackhi_epi8(v, zero));
+			return dest + 32;
+		case BE_UTF16BE:
+			_mm_storeu_si128((__m128i*)dest, _mm_unpacklo_epi8(zero, v));
+			_mm_storeu_si128((__m128i*)(dest + 16), _mm_unpackhi_epi8(zero, v));
+			return dest + 32;
+	}
+	return dest;
+}
+#endif
+
+bool is_valid_utf8(const u8* data, usize size) {
+	u32 state = ch::utf8_accept;
+	u32 codepoint = 0;
+
+	usize i = 0;
+	while (i < size) {
+#if ENCODING_SSE2
+		// Only skip between codepoints, ascii can't finish a sequence that's already started
+		if (state == ch::utf8_accept) {
+			while (i + 16 <= size && !_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(data + i)))) i += 16;
+		}
+#endif
+
+		const usize end = i + 16 < size ? i + 16 : size;
+		for (; i < end; i += 1) {
+			ch::utf8_decode(&state, &codepoint, data[i]);
+			if (state == ch::utf8_reject) return false;
+		}
+	}
+
+	return state == ch::utf8_accept;
+}
+
+Buffer_Encoding detect_encoding(const u8* data, usize size, usize* out_bom_size) {
+	*out_bom_size = 0;
+
+	if (size >= 3 && data[0] == 0xEF && data[1] == 0xBB && data[2] == 0xBF) return BE_UTF8;
+	if (size >= 2 && data[0] == 0xFF && data[1] == 0xFE) {
+		*out_bom_size = 2;
+		return BE_UTF16LE;
+	}
+	if (size >= 2 && data[0] == 0xFE && data[1] == 0xFF) {
+		*out_bom_size = 2;
+		return BE_UTF16BE;
+	}
+
+	// utf16 text is mostly ascii so every other byte is zero. Text in an 8 bit encoding has next to no zeros at all
+	const usize num_units = (size < utf16_sample_size ? size : utf16_sample_size) / 2;
+	usize even_zeros = 0;
+	usize odd_zeros = 0;
+	for (usize i = 0; i < num_units; i += 1) {
+		if (!data[i * 2]) even_zeros += 1;
+		if (!data[i * 2 + 1]) odd_zeros += 1;
+	}
+	if (odd_zeros > num_units / 2 && even_zeros <= num_units / 16) return BE_UTF16LE;
+	if (even_zeros > num_units / 2 && odd_zeros <= num_units / 16) return BE_UTF16BE;
+
+	if (is_valid_utf8(data, size)) return BE_UTF8;
+
+	return BE_ANSI;
+}
+
+usize get_decoded_size_bound(Buffer_Encoding encoding, usize size) {
+	switch (encoding) {
+		case BE_ANSI:
+			return size * 2;
+		case BE_UTF8:
+			return size;
+		case BE_UTF16LE:
+		case BE_UTF16BE:
+			// A trailing odd byte becomes a replacement char
+			return (size / 2 + 1) * 3;
+	}
+	return 0;
+}
+
+static usize decode_latin1(const u8* data, usize size, u8* out) {
+	u8* dest = out;
+
+	usize i = 0;
+	while (i < size) {
+#if ENCODING_SSE2
+		while (i + 16 <= size) {
+			const __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+			if (_mm_movemask_epi8(v)) break;
+
+			_mm_storeu_si128((__m128i*)dest, v);
+			i += 16;
+			dest += 16;
+		}
+#endif
+
+		const usize end = i + 16 < size ? i + 16 : size;
+		for (; i < end; i += 1) {
+			dest = write_utf8(data[i], dest);
+		}
+	}
+
+	return (usize)(dest - out);
+}
+
+static usize decode_utf16(const u8* data, usize size, u8* out, bool big_endian) {
+	u8* dest = out;
+	const usize num_units = size / 2;
+
+	usize i = 0;
+	while (i < num_units) {
+#if ENCODING_SSE2
+		const __m128i non_ascii = _mm_set1_epi16((s16)0xFF80);
+		while (i + 8 <= num_units) {
+			__m128i v = _mm_loadu_si128((const __m128i*)(data + i * 2));
+			if (big_endian) v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+
+			const __m128i is_ascii = _mm_cmpeq_epi16(_mm_and_si128(v, non_ascii), _mm_setzero_si128());
+			if (_mm_movemask_epi8(is_ascii) != 0xFFFF) break;
+
+			// Every unit fits in a byte so packing can't saturate
+			_mm_storel_epi64((__m128i*)dest, _mm_packus_epi16(v, v));
+			i += 8;
+			dest += 8;
+		}
+#endif
+
+		const usize end = i + 8 < num_units ? i + 8 : num_units;
+		for (; i < end; i += 1) {
+			u32 c = read_utf16_unit(data + i * 2, big_endian);
+
+			if (c >= 0xD800 && c < 0xDC00) {
+				const u32 low = i + 1 < num_units ? read_utf16_unit(data + (i + 1) * 2, big_endian) : 0;
+				if (low >= 0xDC00 && low < 0xE000) {
+					c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+					i += 1;
+				} else {
+					c = replacement_char;
+				}
+			} else if (c >= 0xDC00 && c < 0xE000) {
+				c = replacement_char;
+			}
+
+			dest = write_utf8(c, dest);
+		}
+	}
+
+	if (size & 1) dest = write_utf8(replacement_char, dest);
+
+	return (usize)(dest - out);
+}
+
+usize decode_to_utf8(Buffer_Encoding encoding, const u8* data, usize size, u8* out) {
+	switch (encoding) {
+		case BE_ANSI:
+			return decode_latin1(data, size, out);
+		case BE_UTF8:
+			memcpy(out, data, size);
+			return size;
+		case BE_UTF16LE:
+			return decode_utf16(data, size, out, false);
+		case BE_UTF16BE:
+			return decode_utf16(data, size, out, true);
+	}
+	return 0;
+}
+
+usize get_encoded_size_bound(Buffer_Encoding encoding, usize size) {
+	switch (encoding) {
+		case BE_ANSI:
+		case BE_UTF8:
+			return size;
+		case BE_UTF16LE:
+		case BE_UTF16BE:
+			// No utf8 sequence is shorter than half its utf16
+			return size * 2;
+	}
+	return 0;
+}
+
+usize encode_from_utf8(Buffer_Encoding encoding, const u8* data, usize size, u8* out, Utf8_Encode_State* state) {
+	u8* dest = out;
+
+	usize i = 0;
+	while (i < size) {
+#if ENCODING_SSE2
+		if (state->state == ch::utf8_accept) {
+			while (i + 16 <= size) {
+				const __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+				if (_mm_movemask_epi8(v)) break;
+
+				dest = write_ascii_16(encoding, v, dest);
+				i += 16;
+			}
+		}
+#endif
+
+		const usize end = i + 16 < size ? i + 16 : size;
+		for (; i < end; i += 1) {
+			ch::utf8_decode(&state->state, &state->codepoint, data[i]);
+
+			if (state->state == ch::utf8_reject) {
+				state->state = ch::utf8_accept;
+				dest = write_encoded(encoding, replacement_char, dest);
+				continue;
+			}
+
+			if (state->state != ch::utf8_accept) continue;
+
+			dest = write_encoded(encoding, state->codepoint, dest);
+		}
+	}
+
+	return (usize)(dest - out);
+}
+
+Write_Span get_bom(Buffer_Encoding encoding) {
+	static const u8 utf16le_bom[] = { 0xFF, 0xFE };
+	static const u8 utf16be_bom[] = { 0xFE, 0xFF };
+
+	switch (encoding) {
+		case BE_UTF16LE:
+			return { utf16le_bom, sizeof(utf16le_bom) };
+		case BE_UTF16BE:
+			return { utf16be_bom, sizeof(utf16be_bom) };
+		default:
+			return { nullptr, 0 };
+	}
+}
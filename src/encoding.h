@@ -0,0 +1,51 @@
+#pragma once
+
+#include "buffer.h"
+#include "os.h"
+
+/**
+ * Buffers are always utf8 in memory. Files in any other encoding are decoded on load and encoded
+ * back on save so nothing past load and save has to care.
+ */
+
+/** @returns true if all of data is well formed utf8. Runs of ascii are skipped 16 bytes at a time. */
+bool is_valid_utf8(const u8* data, usize size);
+
+/**
+ * Works out what encoding data is in from its byte order mark, or failing that from where its zero bytes are
+ * and whether it's valid utf8. Anything that isn't utf8 or utf16 is treated as latin-1.
+ *
+ * @param out_bom_size is set to the size of the utf16 byte order mark to skip. A utf8 bom is left in the contents.
+ */
+Buffer_Encoding detect_encoding(const u8* data, usize size, usize* out_bom_size);
+
+/** @returns the most bytes decode_to_utf8 can write for size bytes in encoding. */
+usize get_decoded_size_bound(Buffer_Encoding encoding, usize size);
+
+/**
+ * Converts data from encoding to utf8. Malformed utf16 becomes U+FFFD.
+ *
+ * @param out must have room for get_decoded_size_bound bytes
+ * @returns the number of bytes written to out
+ */
+usize decode_to_utf8(Buffer_Encoding encoding, const u8* data, usize size, u8* out);
+
+/** Decoder state carried between calls to encode_from_utf8, so a codepoint can be split between calls. */
+struct Utf8_Encode_State {
+	u32 state = ch::utf8_accept;
+	u32 codepoint = 0;
+};
+
+/** @returns the most bytes encode_from_utf8 can write for size bytes of utf8. */
+usize get_encoded_size_bound(Buffer_Encoding encoding, usize size);
+
+/**
+ * Converts utf8 back to encoding. Codepoints latin-1 can't hold become '?'.
+ *
+ * @param out must have room for get_encoded_size_bound bytes
+ * @returns the number of bytes written to out
+ */
+usize encode_from_utf8(Buffer_Encoding encoding, const u8* data, usize size, u8* out, Utf8_Encode_State* state);
+
+/** @returns the byte order mark to write in front of a file saved in encoding. */
+Write_Span get_bom(Buffer_Encoding encoding);
@@ -0,0 +1,86 @@
+#include "file_picker.h"
+
+#include "buffer.h"
+#include "prompt.h"
+
+#include <ch_stl/input.h>
+#include <stdio.h>
+#include <string.h>
+
+static Project_Match picker_matches[max_project_matches];
+static usize num_picker_matches = 0;
+static usize picker_selection = 0;
+static u32 picker_version = 0;
+
+static char picker_query[256] = {};
+
+/** What the index looked like when the matches were found. */
+static u32 queried_project_version = 0;
+
+static void run_picker_query() {
+	queried_project_version = get_project_version();
+	num_picker_matches = find_project_files(picker_query, picker_matches, max_project_matches);
+	if (picker_selection >= num_picker_matches) picker_selection = num_picker_matches ? num_picker_matches - 1 : 0;
+	picker_version += 1;
+}
+
+static void on_picker_changed(const char* text) {
+	const usize len = strlen(text);
+	if (len >= sizeof(picker_query)) return;
+	memcpy(picker_query, text, len + 1);
+
+	picker_selection = 0;
+	run_picker_query();
+}
+
+static bool on_picker_key(u32 key) {
+	switch (key) {
+		case CH_KEY_UP:
+			if (picker_selection > 0) picker_selection -= 1;
+			picker_version += 1;
+			return true;
+		case CH_KEY_DOWN:
+			if (picker_selection + 1 < num_picker_matches) picker_selection += 1;
+			picker_version += 1;
+			return true;
+	}
+	return false;
+}
+
+static void on_picker_confirmed(const char* text) {
+	if (picker_selection >= num_picker_matches) return;
+
+	char path[2048];
+	snprintf(path, sizeof(path), "%s/%s", get_project_root(), picker_matches[picker_selection].path);
+	open_file(path);
+}
+
+void open_file_picker() {
+	picker_query[0] = 0;
+	picker_selection = 0;
+	begin_prompt("Find file: ", on_picker_confirmed, on_picker_changed, on_picker_key);
+	run_picker_query();
+}
+
+bool is_file_picker_active() {
+	return is_prompt_active_for(on_picker_confirmed);
+}
+
+void tick_file_picker() {
+	if (!is_file_picker_active() || get_project_version() == queried_project_version) return;
+
+	run_picker_query();
+}
+
+usize get_file_picker_matches(const Project_Match** out_matches) {
+	*out_matches = picker_matches;
+	return num_picker_matches;
+}
+
+usize get_file_picker_selection() {
+	return picker_selection;
+}
+
+u32 get_file_picker_version() {
+	return picker_version;
+}
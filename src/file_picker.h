@@ -0,0 +1,18 @@
+#pragma once
+
+#include "project.h"
+
+/** Opens a prompt for finding a file in the project by fuzzy matching its path. Up and down pick between the matches. */
+void open_file_picker();
+
+bool is_file_picker_active();
+
+/** Runs the query again if the project index changed under it. Called once a frame. */
+void tick_file_picker();
+
+/** @returns the number of matches, best first */
+usize get_file_picker_matches(const Project_Match** out_matches);
+usize get_file_picker_selection();
+
+/** Bumped whenever the matches or the selection change, so views know to draw them again. */
+u32 get_file_picker_version();
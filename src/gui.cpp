@@ -20,6 +20,39 @@ struct UI_Context {
 
 static UI_Context ui_context;
 
+/** Where a widget that reacts to hovering was last drawn and how. Lets us skip frames where the mouse changed nothing. */
+struct Hot_Rect {
+	UI_ID id;
+	f32 x0, y0, x1, y1;
+	bool was_hovered;
+};
+
+#define MAX_HOT_RECTS 64
+static Hot_Rect hot_rects[MAX_HOT_RECTS];
+static usize num_hot_rects = 0;
+
+static void push_hot_rect(UI_ID id, f32 x0, f32 y0, f32 x1, f32 y1, bool was_hovered) {
+	Hot_Rect* rect = nullptr;
+	for (usize i = 0; i < num_hot_rects; i += 1) {
+		if (hot_rects[i].id == id) {
+			rect = &hot_rects[i];
+			break;
+		}
+	}
+
+	if (!rect) {
+		if (num_hot_rects >= MAX_HOT_RECTS) return;
+		rect = &hot_rects[num_hot_rects++];
+		rect->id = id;
+	}
+
+	rect->x0 = x0;
+	rect->y0 = y0;
+	rect->x1 = x1;
+	rect->y1 = y1;
+	rect->was_hovered = was_hovered;
+}
+
 /* STYLE */
 
 const f32 border_width = 5.f;
@@ -73,6 +106,7 @@ bool gui_button(UI_ID id, f32 x0, f32 y0, f32 x1, f32 y1) {
 	} else {
 		imm_quad(x0, y0, x1, y1, get_config().foreground_color);
 	}
+	push_hot_rect(id, x0, y0, x1, y1, is_hovered);
 
 	return result;
 }
@@ -91,6 +125,18 @@ bool gui_button_label(UI_ID id, const ch::String& s, f32 x0, f32 y0, f32 x1, f32
 	return result;
 }
 
-void tick_gui() {
+void tick_gui(bool full_redraw) {
 	ui_context.hovered_id = {};
+
+	// Everything is about to be drawn again so anything that isn't anymore shouldn't linger.
+	if (full_redraw) num_hot_rects = 0;
+}
+
+bool gui_needs_redraw() {
+	for (usize i = 0; i < num_hot_rects; i += 1) {
+		const Hot_Rect& it = hot_rects[i];
+		if (is_point_in_rect(current_mouse_position, it.x0, it.y0, it.x1, it.y1) != it.was_hovered) return true;
+	}
+
+	return false;
 }
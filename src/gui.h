@@ -58,4 +58,8 @@ CH_FORCEINLINE bool gui_button_label(UI_ID id, const char* s, f32 x0, f32 y0, f3
 	return gui_button_label(id, real, x0, y0, x1, y1);
 }
 
-void tick_gui();
\ No newline at end of file
+/** @param full_redraw is true when every widget will be drawn this frame */
+void tick_gui(bool full_redraw);
+
+/** @returns true if the mouse moved on or off a widget since it was last drawn. */
+bool gui_needs_redraw();
@@ -2,6 +2,7 @@
 #include "editor.h"
 #include "buffer_view.h"
 #include "actions.h"
+#include "prompt.h"
 
 #include <ch_stl/hash_table.h>
 
@@ -18,8 +19,44 @@ static bool mb_released[MAX_MB];
 
 static u8 current_key_modifiers = KBM_None;
 
+// ch_stl doesn't name these, so they're the platform's own key codes
+#if CH_PLATFORM_WINDOWS
+// VK_OEM_PLUS, VK_OEM_MINUS and VK_F3
+const u32 key_plus = 0xBB;
+const u32 key_minus = 0xBD;
+const u32 key_f3 = 0x72;
+#else
+// XK_equal, XK_minus and XK_F3. Keys come through as a u8, so F3 arrives as the low byte of its keysym.
+const u32 key_plus = 0x3D;
+const u32 key_minus = 0x2D;
+const u32 key_f3 = 0xC2;
+#endif
+
 static ch::Hash_Table<Key_Bind, Action_Func> action_table;
 
+// Actions that leave the buffer's text alone. Keys the prompt doesn't use only reach these while it's up.
+static const Action_Func prompt_safe_actions[] = {
+	save_buffer,
+	goto_line,
+	toggle_follow,
+	open_dialog,
+	find_file,
+	find_in_buffer,
+	find_next,
+	find_previous,
+	clear_search,
+	next_buffer,
+	zoom_in,
+	zoom_out,
+};
+
+static bool is_prompt_safe_action(Action_Func action) {
+	for (usize i = 0; i < sizeof(prompt_safe_actions) / sizeof(prompt_safe_actions[0]); i += 1) {
+		if (prompt_safe_actions[i] == action) return true;
+	}
+	return false;
+}
+
 bool bind_action(const Key_Bind binding, Action_Func action) {
 	assert(action);
 
@@ -77,10 +114,15 @@ void init_input() {
 			current_key_modifiers |= KBM_Alt;
 			break;
 		default:
+			// The prompt goes first so typing into it never edits the buffer underneath
+			const bool prompt_active = is_prompt_active();
+			if (prompt_active && prompt_on_key_pressed(key)) break;
+
 			const Key_Bind current_binding(current_key_modifiers, key);
 
 			Action_Func* const action = action_table.find(current_binding);
 			if (action && *action) {
+				if (prompt_active && !is_prompt_safe_action(*action)) break;
 				(*action)();
 			}
 			break;
@@ -102,6 +144,11 @@ void init_input() {
 	};
 
 	the_window.on_char_entered = [](const ch::Window& window, u32 c) {
+		if (is_prompt_active()) {
+			prompt_on_char_entered(c);
+			return;
+		}
+
 		Buffer_View* const focused_view = get_focused_view();
 		if (focused_view) {
 			focused_view->on_char_entered(c);
@@ -141,8 +188,20 @@ void setup_default_bindings() {
 	bind_action(Key_Bind(KBM_Shift, CH_KEY_DOWN), []() { move_cursor_down(false); });
 
 	bind_action(Key_Bind(KBM_Ctrl, CH_KEY_S), save_buffer);
+	bind_action(Key_Bind(KBM_Ctrl, CH_KEY_T), toggle_follow);
+	bind_action(Key_Bind(KBM_Ctrl, CH_KEY_G), goto_line);
 
     bind_action(Key_Bind(KBM_Ctrl, CH_KEY_O), open_dialog);
+	bind_action(Key_Bind(KBM_Ctrl, CH_KEY_P), find_file);
+	bind_action(Key_Bind(KBM_Ctrl, CH_KEY_TAB), next_buffer);
+
+	bind_action(Key_Bind(KBM_Ctrl, CH_KEY_F), find_in_buffer);
+	bind_action(Key_Bind(KBM_None, CH_KEY_ESCAPE), clear_search);
+
+	bind_action(Key_Bind(KBM_Ctrl, key_plus), zoom_in);
+	bind_action(Key_Bind(KBM_Ctrl, key_minus), zoom_out);
+	bind_action(Key_Bind(KBM_None, key_f3), find_next);
+	bind_action(Key_Bind(KBM_Shift, key_f3), find_previous);
 }
 
 void process_input() {
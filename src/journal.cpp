@@ -0,0 +1,384 @@
+#include "journal.h"
+#include "buffer.h"
+
+#include <ch_stl/time.h>
+#include <string.h>
+
+const u32 journal_magic = 0x4A4E4445; // "EDNJ"
+const u32 journal_version = 1;
+
+/** How long edits sit in memory before they're written out. Also about the most a crash can lose. */
+const u32 journal_write_interval_ms = 250;
+
+enum Journal_Record_Type : u8 {
+	JR_Edit = 1,        // u64 offset, u64 removed, u64 inserted_size, inserted bytes
+	JR_Save_Started,    // u64 version
+	JR_Save_Finished,   // u64 version, u64 modified, u64 size
+};
+
+struct Journal_Bytes {
+	u8* data = nullptr;
+	usize size = 0;
+	usize capacity = 0;
+};
+
+static void push_bytes(Journal_Bytes* bytes, const void* data, usize size) {
+	if (bytes->size + size > bytes->capacity) {
+		usize new_capacity = bytes->capacity ? bytes->capacity * 2 : 4096;
+		while (new_capacity < bytes->size + size) new_capacity *= 2;
+
+		u8* const new_data = ch_new u8[new_capacity];
+		if (bytes->size) memcpy(new_data, bytes->data, bytes->size);
+		ch_delete[] bytes->data;
+
+		bytes->data = new_data;
+		bytes->capacity = new_capacity;
+	}
+
+	memcpy(bytes->data + bytes->size, data, size);
+	bytes->size += size;
+}
+
+static void push_u64(Journal_Bytes* bytes, u64 value) {
+	push_bytes(bytes, &value, sizeof(value));
+}
+
+struct Buffer_Journal {
+	char path[1024];
+	Mutex lock;
+
+	// Guarded by lock, the main thread fills these in
+	Journal_Bytes pending;
+	File_Stamp base;
+	bool needs_header = true;
+	bool delete_pending = false; // What's on disk is stale, delete it before writing pending
+	bool broken = false; // A write failed, nothing more is journaled until the next reset
+	bool closed = false;
+	bool keep_file = false;
+
+	// Only touched while writing out, under journals_lock
+	Journal_Bytes writing;
+	Buffer_Journal* next = nullptr;
+};
+
+static Buffer_Journal* open_journals = nullptr;
+static Mutex journals_lock;
+
+/** Expects journal->lock to be held. */
+static void push_header(Buffer_Journal* journal) {
+	push_bytes(&journal->pending, &journal_magic, sizeof(journal_magic));
+	push_bytes(&journal->pending, &journal_version, sizeof(journal_version));
+	push_u64(&journal->pending, journal->base.modified);
+	push_u64(&journal->pending, journal->base.size);
+	journal->needs_header = false;
+}
+
+/** Expects journals_lock to be held so only one thread is ever writing a journal. */
+static void write_journal(Buffer_Journal* journal) {
+	journal->lock.lock();
+	const Journal_Bytes swap = journal->writing;
+	journal->writing = journal->pending;
+	journal->pending = swap;
+	const bool delete_first = journal->delete_pending;
+	journal->delete_pending = false;
+	journal->lock.unlock();
+
+	bool ok = true;
+	if (delete_first) ok = delete_file(journal->path);
+	if (ok && journal->writing.size) ok = append_to_file(journal->path, journal->writing.data, journal->writing.size);
+	journal->writing.size = 0;
+
+	// A journal with a hole in it would replay garbage. Better to have none until the next save
+	if (!ok) {
+		journal->lock.lock();
+		journal->broken = true;
+		journal->delete_pending = true;
+		journal->pending.size = 0;
+		journal->lock.unlock();
+	}
+}
+
+static void free_journal(Buffer_Journal* journal) {
+	ch_delete[] journal->pending.data;
+	ch_delete[] journal->writing.data;
+	ch_delete journal;
+}
+
+void flush_journals() {
+	journals_lock.lock();
+
+	Buffer_Journal** link = &open_journals;
+	while (*link) {
+		Buffer_Journal* const journal = *link;
+		write_journal(journal);
+
+		journal->lock.lock();
+		const bool closed = journal->closed;
+		journal->lock.unlock();
+
+		if (!closed) {
+			link = &journal->next;
+			continue;
+		}
+
+		// Nothing can be added after closing, so one more write gets whatever came in since the swap
+		write_journal(journal);
+		if (!journal->keep_file) delete_file(journal->path);
+
+		*link = journal->next;
+		free_journal(journal);
+	}
+
+	journals_lock.unlock();
+}
+
+static void journal_write_proc(void* param) {
+	for (;;) {
+		ch::sleep(journal_write_interval_ms);
+		flush_journals();
+	}
+}
+
+void init_journals() {
+	Thread thread;
+	create_thread(journal_write_proc, nullptr, &thread);
+}
+
+Buffer_Journal* open_journal(const char* path, const File_Stamp& base) {
+	const char suffix[] = ".eden-journal";
+	const usize path_len = strlen(path);
+
+	Buffer_Journal* const journal = ch_new Buffer_Journal;
+	if (path_len + sizeof(suffix) > sizeof(journal->path)) {
+		// Nowhere to put it. Stays usable, edits just never get anywhere
+		journal->broken = true;
+		journal->path[0] = 0;
+	} else {
+		memcpy(journal->path, path, path_len);
+		memcpy(journal->path + path_len, suffix, sizeof(suffix));
+	}
+	journal->base = base;
+
+	journals_lock.lock();
+	journal->next = open_journals;
+	open_journals = journal;
+	journals_lock.unlock();
+
+	return journal;
+}
+
+void close_journal(Buffer_Journal* journal, bool keep_file) {
+	journal->lock.lock();
+	journal->closed = true;
+	journal->keep_file = keep_file && !journal->broken;
+	if (!journal->keep_file) journal->pending.size = 0;
+	journal->lock.unlock();
+}
+
+void journal_edit(Buffer_Journal* journal, usize offset, usize removed, const u8* inserted, usize inserted_size) {
+	journal->lock.lock();
+	if (!journal->broken) {
+		if (journal->needs_header) push_header(journal);
+
+		const u8 type = JR_Edit;
+		push_bytes(&journal->pending, &type, sizeof(type));
+		push_u64(&journal->pending, offset);
+		push_u64(&journal->pending, removed);
+		push_u64(&journal->pending, inserted_size);
+		if (inserted_size) push_bytes(&journal->pending, inserted, inserted_size);
+	}
+	journal->lock.unlock();
+}
+
+void journal_save_started(Buffer_Journal* journal, u64 version) {
+	journal->lock.lock();
+	if (!journal->broken) {
+		if (journal->needs_header) push_header(journal);
+
+		const u8 type = JR_Save_Started;
+		push_bytes(&journal->pending, &type, sizeof(type));
+		push_u64(&journal->pending, version);
+	}
+	journal->lock.unlock();
+}
+
+void journal_save_finished(Buffer_Journal* journal, u64 version, const File_Stamp& stamp) {
+	journal->lock.lock();
+	if (!journal->broken) {
+		if (journal->needs_header) push_header(journal);
+
+		const u8 type = JR_Save_Finished;
+		push_bytes(&journal->pending, &type, sizeof(type));
+		push_u64(&journal->pending, version);
+		push_u64(&journal->pending, stamp.modified);
+		push_u64(&journal->pending, stamp.size);
+	}
+	journal->lock.unlock();
+}
+
+void reset_journal(Buffer_Journal* journal, const File_Stamp& base) {
+	journal->lock.lock();
+	journal->pending.size = 0;
+	journal->delete_pending = true;
+	journal->needs_header = true;
+	journal->broken = !journal->path[0];
+	journal->base = base;
+	journal->lock.unlock();
+}
+
+struct Journal_Reader {
+	const u8* data;
+	usize size;
+	usize offset;
+
+	bool read(void* out, usize count) {
+		if (size - offset < count) return false;
+		memcpy(out, data + offset, count);
+		offset += count;
+		return true;
+	}
+
+	bool skip(u64 count) {
+		if (size - offset < count) return false;
+		offset += (usize)count;
+		return true;
+	}
+};
+
+/**
+ * Walks the edit records in [reader->offset, end). If buffer is null they're only checked against content_size,
+ * otherwise they're applied to it.
+ *
+ * @returns false if an edit doesn't fit the contents it applies to
+ */
+static bool walk_journal_edits(Journal_Reader reader, usize end, usize content_size, Buffer* buffer) {
+	while (reader.offset < end) {
+		u8 type;
+		reader.read(&type, sizeof(type));
+
+		if (type == JR_Save_Started) {
+			reader.skip(8);
+			continue;
+		}
+		if (type == JR_Save_Finished) {
+			reader.skip(24);
+			continue;
+		}
+
+		u64 offset, removed, inserted_size;
+		reader.read(&offset, sizeof(offset));
+		reader.read(&removed, sizeof(removed));
+		reader.read(&inserted_size, sizeof(inserted_size));
+		const u8* const inserted = reader.data + reader.offset;
+		reader.skip(inserted_size);
+
+		if (offset > content_size || removed > content_size - offset) return false;
+		content_size = content_size - (usize)removed + (usize)inserted_size;
+
+		if (!buffer) continue;
+
+		for (u64 i = 0; i < removed; i += 1) {
+			buffer->gap_buffer.remove_at_index((usize)offset);
+		}
+		for (u64 i = 0; i < inserted_size; i += 1) {
+			buffer->gap_buffer.insert(inserted[i], (usize)(offset + i));
+		}
+	}
+
+	return true;
+}
+
+bool replay_journal(Buffer_Journal* journal, Buffer* buffer) {
+	if (!journal->path[0]) return false;
+
+	Mapped_File file;
+	if (!map_file(journal->path, &file)) return false;
+	defer(unmap_file(&file));
+
+	Journal_Reader reader = { file.data, file.size, 0 };
+
+	u32 magic = 0;
+	u32 version = 0;
+	File_Stamp base;
+	const bool has_header = reader.read(&magic, sizeof(magic)) && reader.read(&version, sizeof(version)) &&
+		reader.read(&base.modified, sizeof(base.modified)) && reader.read(&base.size, sizeof(base.size));
+
+	usize replay_from = (usize)-1;
+	usize end = reader.offset;
+	if (has_header && magic == journal_magic && version == journal_version) {
+		if (base == journal->base) replay_from = reader.offset;
+
+		// Where recent saves were snapshotted. A finished save that matches the file on disk moves replay_from up to its mark
+		struct Save_Mark {
+			u64 version;
+			usize offset;
+		};
+		const u32 max_save_marks = 32;
+		Save_Mark save_marks[max_save_marks];
+		u32 num_save_marks = 0;
+
+		// A crash can leave the last record half written, everything before it is still good
+		for (;;) {
+			u8 type;
+			if (!reader.read(&type, sizeof(type))) break;
+
+			if (type == JR_Edit) {
+				u64 header[3];
+				if (!reader.read(header, sizeof(header)) || !reader.skip(header[2])) break;
+			} else if (type == JR_Save_Started) {
+				u64 save_version;
+				if (!reader.read(&save_version, sizeof(save_version))) break;
+
+				save_marks[num_save_marks % max_save_marks] = { save_version, reader.offset };
+				num_save_marks += 1;
+			} else if (type == JR_Save_Finished) {
+				u64 save_version;
+				File_Stamp stamp;
+				if (!reader.read(&save_version, sizeof(save_version)) || !reader.read(&stamp.modified, sizeof(stamp.modified)) ||
+					!reader.read(&stamp.size, sizeof(stamp.size))) break;
+
+				if (stamp == journal->base) {
+					const u32 first = num_save_marks > max_save_marks ? num_save_marks - max_save_marks : 0;
+					for (u32 i = num_save_marks; i > first; i -= 1) {
+						const Save_Mark& mark = save_marks[(i - 1) % max_save_marks];
+						if (mark.version == save_version) {
+							replay_from = mark.offset;
+							break;
+						}
+					}
+				}
+			} else {
+				break;
+			}
+
+			end = reader.offset;
+		}
+	}
+
+	// Belongs to some other version of the file, or isn't a journal at all
+	const usize content_size = buffer->gap_buffer.count();
+	reader.offset = replay_from;
+	if (replay_from == (usize)-1 || !walk_journal_edits(reader, end, content_size, nullptr)) {
+		journal->lock.lock();
+		journal->delete_pending = true;
+		journal->lock.unlock();
+		return false;
+	}
+
+	// Keep appending to it, the edits in it are still what's needed to get from base to the buffer.
+	// If it ends in a half written record that has to go first or it would hide everything after it
+	journal->lock.lock();
+	journal->needs_header = false;
+	if (end < file.size) {
+		journal->delete_pending = true;
+		push_bytes(&journal->pending, file.data, end);
+	}
+	journal->lock.unlock();
+
+	if (replay_from == end) return false;
+
+	walk_journal_edits(reader, end, content_size, buffer);
+	buffer->refresh_line_tables();
+	buffer->is_dirty = true;
+	return true;
+}
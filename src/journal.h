@@ -0,0 +1,53 @@
+#pragma once
+
+#include "os.h"
+
+struct Buffer;
+
+/**
+ * Append only log of the edits made to a file buffer since it last matched the file on disk.
+ * Lives next to the file as <path>.eden-journal and is replayed on load if we crashed before saving.
+ *
+ * Edits are only copied into memory on the main thread. A background thread batches them out to disk.
+ */
+struct Buffer_Journal;
+
+/** Starts the thread that writes journals out. */
+void init_journals();
+
+/** Writes out everything still waiting. Called on shutdown so nothing since the last batch is lost. */
+void flush_journals();
+
+/**
+ * @param base is the stamp of the file the buffer was loaded from, edits are replayed on top of it
+ * @returns a journal for the file at path
+ */
+Buffer_Journal* open_journal(const char* path, const File_Stamp& base);
+
+/**
+ * Hands the journal over to the write thread to finish up and free.
+ *
+ * @param keep_file leaves the journal on disk, otherwise it's deleted
+ */
+void close_journal(Buffer_Journal* journal, bool keep_file);
+
+/** Records that removed bytes at offset were replaced by inserted. */
+void journal_edit(Buffer_Journal* journal, usize offset, usize removed, const u8* inserted, usize inserted_size);
+
+/**
+ * Marks where a save of version was snapshotted. Once journal_save_finished records where it ended up on disk,
+ * only edits after this mark need replaying.
+ */
+void journal_save_started(Buffer_Journal* journal, u64 version);
+void journal_save_finished(Buffer_Journal* journal, u64 version, const File_Stamp& stamp);
+
+/** The buffer matches the file again, everything journaled so far can go. */
+void reset_journal(Buffer_Journal* journal, const File_Stamp& base);
+
+/**
+ * Applies the edits a previous run journaled on top of what was just loaded into buffer.
+ * A journal that doesn't belong to the file on disk anymore is thrown away.
+ *
+ * @returns true if any edits were replayed
+ */
+bool replay_journal(Buffer_Journal* journal, Buffer* buffer);
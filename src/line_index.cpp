@@ -0,0 +1,329 @@
+#include "line_index.h"
+
+#include <string.h>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define LINE_INDEX_SSE2 1
+#include <emmintrin.h>
+#else
+#define LINE_INDEX_SSE2 0
+#endif
+
+/** How many blocks are read at once while scanning. */
+const u64 line_index_blocks_per_read = 8;
+
+const u32 line_index_cache_magic = 0x4C4E4445; // "EDNL"
+const u32 line_index_cache_version = 1;
+
+/** Followed by block_lines. Every field is 8 byte aligned so block_lines can be used straight out of the mapping. */
+struct Line_Index_Cache_Header {
+	u32 magic;
+	u32 version;
+	u64 block_size;
+	u64 file_size;
+	u64 modified;
+	u64 sample_hash;
+	u64 num_blocks;
+};
+
+/** How many bytes of the file are hashed, and how many places they're spread across. */
+const usize line_index_sample_size = 4096;
+const u32 line_index_num_samples = 16;
+
+static u64 count_newlines(const u8* data, usize size) {
+	u64 result = 0;
+	usize i = 0;
+
+#if LINE_INDEX_SSE2
+	const __m128i newline = _mm_set1_epi8('\n');
+	const __m128i zero = _mm_setzero_si128();
+	while (i + 16 <= size) {
+		// Each byte lane counts down by one per match, so flush to the total before any of them can wrap
+		__m128i counts = zero;
+		for (u32 j = 0; j < 255 && i + 16 <= size; j += 1) {
+			const __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+			counts = _mm_sub_epi8(counts, _mm_cmpeq_epi8(v, newline));
+			i += 16;
+		}
+
+		const __m128i sums = _mm_sad_epu8(counts, zero);
+		result += (u64)_mm_cvtsi128_si32(sums) + (u64)_mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+	}
+#endif
+
+	for (; i < size; i += 1) {
+		if (data[i] == '\n') result += 1;
+	}
+
+	return result;
+}
+
+/**
+ * Hashes samples from the start, end and evenly in between. A file rewritten with the same size inside
+ * the stamp's resolution would have to match in all of them to be mistaken for the cached one.
+ */
+static u64 get_sample_hash(const char* path, u64 file_size) {
+	u8 sample[line_index_sample_size];
+
+	u64 hash = 0xCBF29CE484222325ull;
+	for (u32 i = 0; i < line_index_num_samples; i += 1) {
+		const u64 last_offset = file_size > line_index_sample_size ? file_size - line_index_sample_size : 0;
+		const u64 offset = last_offset / (line_index_num_samples - 1) * i;
+
+		const usize num_read = read_file_at(path, offset, sample, line_index_sample_size);
+		for (usize j = 0; j < num_read; j += 1) {
+			hash ^= sample[j];
+			hash *= 0x100000001B3ull;
+		}
+	}
+	return hash;
+}
+
+/**
+ * Caches live in the per-user cache directory, named after a hash of the file's absolute path, so
+ * nothing is written next to the files being edited. The header still decides if a cache is usable.
+ *
+ * @returns false if there's no cache directory to put it in
+ */
+static bool get_cache_path(const Line_Index* index, char* out_path, usize out_size) {
+	if (!get_cache_directory(out_path, out_size)) return false;
+
+	u64 hash = 0xCBF29CE484222325ull;
+	for (const char* c = index->path; *c; c += 1) {
+		hash ^= (u8)*c;
+		hash *= 0x100000001B3ull;
+	}
+
+	// Separator, 16 hex digits, the extension and the terminator
+	const char extension[] = ".eden-lines";
+	const usize dir_len = strlen(out_path);
+	if (dir_len + 1 + 16 + sizeof(extension) > out_size) return false;
+
+#if CH_PLATFORM_WINDOWS
+	out_path[dir_len] = '\\';
+#else
+	out_path[dir_len] = '/';
+#endif
+	for (u32 i = 0; i < 16; i += 1) {
+		out_path[dir_len + 1 + i] = "0123456789abcdef"[(hash >> ((15 - i) * 4)) & 0xF];
+	}
+	memcpy(out_path + dir_len + 1 + 16, extension, sizeof(extension));
+	return true;
+}
+
+/** Points block_lines into the cache file if it was made from this exact file. */
+static bool load_line_index_cache(Line_Index* index) {
+	char cache_path[1024];
+	if (!get_cache_path(index, cache_path, sizeof(cache_path))) return false;
+
+	Mapped_File cache;
+	if (!map_file(cache_path, &cache)) return false;
+
+	const Line_Index_Cache_Header* const header = (const Line_Index_Cache_Header*)cache.data;
+	const bool matches = cache.size == sizeof(Line_Index_Cache_Header) + (index->num_blocks + 1) * sizeof(u64) &&
+		header->magic == line_index_cache_magic && header->version == line_index_cache_version &&
+		header->block_size == line_index_block_size && header->file_size == index->file_size &&
+		header->modified == index->stamp.modified && header->sample_hash == index->sample_hash &&
+		header->num_blocks == index->num_blocks;
+	if (!matches) {
+		unmap_file(&cache);
+		return false;
+	}
+
+	index->cache = cache;
+	index->block_lines = (u64*)(cache.data + sizeof(Line_Index_Cache_Header));
+	index->num_scanned = (s32)index->num_blocks;
+	return true;
+}
+
+static void write_line_index_cache(const Line_Index* index) {
+	// The file changed while it was being scanned, what we have doesn't describe any version of it
+	File_Stamp stamp;
+	if (!get_file_stamp(index->path, &stamp) || stamp != index->stamp) return;
+
+	Line_Index_Cache_Header header;
+	header.magic = line_index_cache_magic;
+	header.version = line_index_cache_version;
+	header.block_size = line_index_block_size;
+	header.file_size = index->file_size;
+	header.modified = index->stamp.modified;
+	header.sample_hash = index->sample_hash;
+	header.num_blocks = index->num_blocks;
+
+	const Write_Span spans[] = {
+		{ &header, sizeof(header) },
+		{ index->block_lines, (usize)((index->num_blocks + 1) * sizeof(u64)) },
+	};
+
+	// Nothing to do if it can't be written, it'll just be scanned again next time
+	char cache_path[1024];
+	if (!get_cache_path(index, cache_path, sizeof(cache_path))) return;
+	write_file_atomic(cache_path, spans, 2);
+}
+
+static void free_line_index(Line_Index* index) {
+	if (index->cache.data) {
+		unmap_file(&index->cache);
+	} else {
+		ch_delete[] index->block_lines;
+	}
+	ch_delete index;
+}
+
+static void unref_line_index(Line_Index* index) {
+	if (!atomic_add(&index->ref_count, -1)) free_line_index(index);
+}
+
+struct Line_Index_Scan {
+	Line_Index* index;
+	void* window;
+};
+
+static void scan_line_index(void* param) {
+	Line_Index_Scan* const scan = (Line_Index_Scan*)param;
+	Line_Index* const index = scan->index;
+	void* const window = scan->window;
+	ch_delete scan;
+
+	const usize read_size = (usize)(line_index_block_size * line_index_blocks_per_read);
+	u8* const data = ch_new u8[read_size];
+
+	u64 lines = 0;
+	u64 block = 0;
+	while (block < index->num_blocks && !atomic_load(&index->cancelled)) {
+		const u64 offset = block * line_index_block_size;
+		const usize num_read = read_file_at(index->path, offset, data, read_size);
+
+		// If the file got shorter under us the missing blocks just count as empty
+		for (u64 i = 0; i < line_index_blocks_per_read && block < index->num_blocks; i += 1) {
+			const usize start = (usize)(i * line_index_block_size);
+			const usize end = start + (usize)line_index_block_size < num_read ? start + (usize)line_index_block_size : num_read;
+			if (start < end) lines += count_newlines(data + start, end - start);
+
+			index->block_lines[block + 1] = lines;
+			block += 1;
+			atomic_store(&index->num_scanned, (s32)block);
+		}
+	}
+
+	ch_delete[] data;
+
+	if (!atomic_load(&index->cancelled)) {
+		write_line_index_cache(index);
+		post_wake_event(window);
+	}
+	unref_line_index(index);
+}
+
+Line_Index* start_line_index(const char* path, const File_Stamp& stamp, void* window) {
+	const u64 num_blocks = (stamp.size + line_index_block_size - 1) / line_index_block_size;
+	if (num_blocks > 0x7FFFFFFF) return nullptr;
+
+	const usize path_len = strlen(path);
+
+	Line_Index* const index = ch_new Line_Index;
+	if (path_len >= sizeof(index->path)) {
+		ch_delete index;
+		return nullptr;
+	}
+	memcpy(index->path, path, path_len + 1);
+
+	index->file_size = stamp.size;
+	index->num_blocks = num_blocks;
+	index->stamp = stamp;
+	index->sample_hash = get_sample_hash(path, stamp.size);
+
+	if (load_line_index_cache(index)) {
+		index->ref_count = 1;
+		return index;
+	}
+
+	index->block_lines = ch_new u64[num_blocks + 1];
+	index->block_lines[0] = 0;
+	index->ref_count = 2; // Ours and the scan thread's
+
+	Line_Index_Scan* const scan = ch_new Line_Index_Scan;
+	scan->index = index;
+	scan->window = window;
+
+	Thread thread;
+	if (!create_thread(scan_line_index, scan, &thread)) {
+		ch_delete scan;
+		free_line_index(index);
+		return nullptr;
+	}
+
+	return index;
+}
+
+void release_line_index(Line_Index* index) {
+	atomic_store(&index->cancelled, 1);
+	unref_line_index(index);
+}
+
+u64 get_lines_before_block(const Line_Index* index, u64 block, f64 lines_per_byte, bool* out_exact) {
+	const u64 num_scanned = (u64)atomic_load(&index->num_scanned);
+	if (block <= num_scanned) {
+		*out_exact = true;
+		return index->block_lines[block];
+	}
+
+	// Carry on at the density of what's been scanned so far
+	*out_exact = false;
+	if (num_scanned) {
+		lines_per_byte = (f64)index->block_lines[num_scanned] / (f64)(num_scanned * line_index_block_size);
+	}
+	return index->block_lines[num_scanned] + (u64)((f64)((block - num_scanned) * line_index_block_size) * lines_per_byte);
+}
+
+u64 get_total_lines(const Line_Index* index, f64 lines_per_byte, bool* out_exact) {
+	if (is_line_index_done(index)) {
+		*out_exact = true;
+		return index->block_lines[index->num_blocks] + 1;
+	}
+
+	const u64 num_scanned = (u64)atomic_load(&index->num_scanned);
+	*out_exact = false;
+	if (num_scanned) {
+		lines_per_byte = (f64)index->block_lines[num_scanned] / (f64)(num_scanned * line_index_block_size);
+	}
+	const u64 scanned_size = num_scanned * line_index_block_size;
+	return index->block_lines[num_scanned] + (u64)((f64)(index->file_size - scanned_size) * lines_per_byte) + 1;
+}
+
+u64 find_line_block(const Line_Index* index, u64 line, f64 lines_per_byte, bool* out_exact) {
+	const u64 num_scanned = (u64)atomic_load(&index->num_scanned);
+	if (!line || !index->num_blocks) {
+		*out_exact = true;
+		return 0;
+	}
+
+	// Past what's been scanned, carry on at the density seen so far
+	if (index->block_lines[num_scanned] < line) {
+		if (num_scanned) {
+			lines_per_byte = (f64)index->block_lines[num_scanned] / (f64)(num_scanned * line_index_block_size);
+		}
+
+		*out_exact = num_scanned == index->num_blocks;
+		if (*out_exact || lines_per_byte <= 0.0) return index->num_blocks - 1;
+
+		const f64 lines_per_block = lines_per_byte * (f64)line_index_block_size;
+		const u64 result = num_scanned + (u64)((f64)(line - index->block_lines[num_scanned]) / lines_per_block);
+		return result < index->num_blocks ? result : index->num_blocks - 1;
+	}
+
+	// First block whose end has at least line '\n' before it
+	u64 lo = 0;
+	u64 hi = num_scanned - 1;
+	while (lo < hi) {
+		const u64 mid = lo + (hi - lo) / 2;
+		if (index->block_lines[mid + 1] >= line) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+
+	*out_exact = true;
+	return lo;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "os.h"
+
+/** Files are indexed in blocks this big, line numbers are only known exactly at block boundaries. */
+const u64 line_index_block_size = 1024 * 1024;
+
+/**
+ * Sparse line index of a file too big to load, built by counting newlines on a background thread.
+ * Until the scan gets somewhere line counts are estimated from what it has seen so far.
+ *
+ * A finished index is cached in the per-user cache directory, keyed by the file's absolute path.
+ * Reopening the same file maps the cache instead of scanning again.
+ *
+ * Only '\n' is counted, a lone '\r' doesn't start a line here.
+ */
+struct Line_Index {
+	char path[1024];
+	u64 file_size = 0;
+	u64 num_blocks = 0;
+
+	/** What the cache is keyed on besides the path. The hash is of a few blocks sampled across the file. */
+	File_Stamp stamp;
+	u64 sample_hash = 0;
+
+	/** block_lines[i] is the number of '\n' before block i. Has num_blocks + 1 entries, only the first num_scanned + 1 are filled in. */
+	u64* block_lines = nullptr;
+
+	/** If the index came from the cache block_lines points straight into it. */
+	Mapped_File cache;
+
+	/** Written by the scan thread after the block's entry, read on the main thread. */
+	volatile s32 num_scanned = 0;
+	volatile s32 cancelled = 0;
+	volatile s32 ref_count = 0;
+};
+
+/**
+ * Maps the cached index of the file at path if it's still good, otherwise starts scanning it on its own thread.
+ * The window is woken when the scan finishes.
+ *
+ * @param stamp is the file as it was opened
+ * @returns the index, or nullptr if the file is too big for the block count to fit
+ */
+Line_Index* start_line_index(const char* path, const File_Stamp& stamp, void* window);
+
+/** Stops the scan if it's still going. The index is freed once the scan thread lets go of it too. */
+void release_line_index(Line_Index* index);
+
+CH_FORCEINLINE bool is_line_index_done(const Line_Index* index) {
+	return (u64)atomic_load(&index->num_scanned) == index->num_blocks;
+}
+
+/**
+ * @param lines_per_byte is used for estimating if nothing has been scanned yet
+ * @param out_exact is set to false if the count is an estimate
+ * @returns the number of '\n' before block
+ */
+u64 get_lines_before_block(const Line_Index* index, u64 block, f64 lines_per_byte, bool* out_exact);
+
+/** @returns the number of lines in the file, counting the one after the last '\n'. */
+u64 get_total_lines(const Line_Index* index, f64 lines_per_byte, bool* out_exact);
+
+/**
+ * @param lines_per_byte is used for estimating if nothing has been scanned yet
+ * @param out_exact is set to false if the block is estimated
+ * @returns the block the '\n' ending the line before line is in, which is where line starts or just before
+ */
+u64 find_line_block(const Line_Index* index, u64 line, f64 lines_per_byte, bool* out_exact);
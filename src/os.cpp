@@ -0,0 +1,1242 @@
+#include "os.h"
+
+#include <ch_stl/array.h>
+#include <ch_stl/memory.h>
+#include <ch_stl/time.h>
+
+#if CH_PLATFORM_WINDOWS
+struct Win32_SRW_Lock {
+	void* ptr;
+};
+
+using Win32_Thread_Start = DWORD(__stdcall*)(void* param);
+
+#define WIN32_INFINITE 0xFFFFFFFF
+#define WIN32_ALL_PROCESSOR_GROUPS 0xFFFF
+#define WIN32_WM_NULL 0x0000
+
+#define WIN32_GENERIC_READ 0x80000000
+#define WIN32_FILE_SHARE_READ 0x00000001
+#define WIN32_FILE_SHARE_WRITE 0x00000002
+#define WIN32_FILE_SHARE_DELETE 0x00000004
+#define WIN32_OPEN_EXISTING 3
+#define WIN32_FILE_ATTRIBUTE_NORMAL 0x00000080
+#define WIN32_INVALID_HANDLE_VALUE ((HANDLE)(s64)-1)
+#define WIN32_PAGE_READONLY 0x02
+#define WIN32_FILE_MAP_READ 0x0004
+#define WIN32_GENERIC_WRITE 0x40000000
+#define WIN32_CREATE_ALWAYS 2
+#define WIN32_OPEN_ALWAYS 4
+#define WIN32_FILE_APPEND_DATA 0x0004
+#define WIN32_ERROR_FILE_NOT_FOUND 2
+#define WIN32_ERROR_ALREADY_EXISTS 183
+#define WIN32_MOVEFILE_REPLACE_EXISTING 0x00000001
+#define WIN32_MOVEFILE_WRITE_THROUGH 0x00000008
+#define WIN32_WAIT_OBJECT_0 0x00000000
+#define WIN32_FILE_NOTIFY_CHANGE_FILE_NAME 0x00000001
+#define WIN32_FILE_NOTIFY_CHANGE_SIZE 0x00000008
+#define WIN32_FILE_NOTIFY_CHANGE_LAST_WRITE 0x00000010
+#define WIN32_GET_FILE_EX_INFO_STANDARD 0
+#define WIN32_FILE_ATTRIBUTE_DIRECTORY 0x00000010
+#define WIN32_FILE_ATTRIBUTE_REPARSE_POINT 0x00000400
+#define WIN32_FILE_NOTIFY_CHANGE_DIR_NAME 0x00000002
+#define WIN32_WAIT_TIMEOUT 0x00000102
+#define WIN32_FILE_LIST_DIRECTORY 0x0001
+#define WIN32_FILE_FLAG_BACKUP_SEMANTICS 0x02000000
+#define WIN32_FILE_FLAG_OVERLAPPED 0x40000000
+
+struct Win32_File_Time {
+	DWORD low_date_time;
+	DWORD high_date_time;
+};
+
+struct Win32_File_Attribute_Data {
+	DWORD file_attributes;
+	Win32_File_Time creation_time;
+	Win32_File_Time last_access_time;
+	Win32_File_Time last_write_time;
+	DWORD file_size_high;
+	DWORD file_size_low;
+};
+
+struct Win32_Overlapped {
+	usize internal;
+	usize internal_high;
+	DWORD offset;
+	DWORD offset_high;
+	HANDLE event;
+};
+
+struct Win32_File_Notify_Information {
+	DWORD next_entry_offset;
+	DWORD action;
+	DWORD file_name_length;
+	wchar_t file_name[1];
+};
+
+struct Win32_Find_Data {
+	DWORD file_attributes;
+	Win32_File_Time creation_time;
+	Win32_File_Time last_access_time;
+	Win32_File_Time last_write_time;
+	DWORD file_size_high;
+	DWORD file_size_low;
+	DWORD reserved0;
+	DWORD reserved1;
+	char file_name[260];
+	char alternate_file_name[14];
+};
+
+extern "C" {
+	DLL_IMPORT HANDLE WINAPI CreateThread(void* thread_attributes, usize stack_size, Win32_Thread_Start start_address, void* parameter, DWORD creation_flags, DWORD* thread_id);
+	DLL_IMPORT BOOL WINAPI CloseHandle(HANDLE object);
+	DLL_IMPORT DWORD WINAPI GetActiveProcessorCount(WORD group_number);
+
+	DLL_IMPORT void WINAPI InitializeSRWLock(Win32_SRW_Lock* lock);
+	DLL_IMPORT void WINAPI AcquireSRWLockExclusive(Win32_SRW_Lock* lock);
+	DLL_IMPORT void WINAPI ReleaseSRWLockExclusive(Win32_SRW_Lock* lock);
+
+	DLL_IMPORT HANDLE WINAPI CreateSemaphoreA(void* semaphore_attributes, LONG initial_count, LONG maximum_count, LPCSTR name);
+	DLL_IMPORT BOOL WINAPI ReleaseSemaphore(HANDLE semaphore, LONG release_count, LONG* previous_count);
+	DLL_IMPORT DWORD WINAPI WaitForSingleObject(HANDLE handle, DWORD milliseconds);
+
+	DLL_IMPORT BOOL WINAPI PostMessageA(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam);
+
+	DLL_IMPORT HANDLE WINAPI CreateFileA(LPCSTR file_name, DWORD desired_access, DWORD share_mode, void* security_attributes, DWORD creation_disposition, DWORD flags_and_attributes, HANDLE template_file);
+	DLL_IMPORT BOOL WINAPI GetFileSizeEx(HANDLE file, s64* file_size);
+	DLL_IMPORT HANDLE WINAPI CreateFileMappingA(HANDLE file, void* attributes, DWORD protect, DWORD maximum_size_high, DWORD maximum_size_low, LPCSTR name);
+	DLL_IMPORT void* WINAPI MapViewOfFile(HANDLE mapping, DWORD desired_access, DWORD offset_high, DWORD offset_low, usize bytes_to_map);
+	DLL_IMPORT BOOL WINAPI UnmapViewOfFile(const void* base_address);
+
+	DLL_IMPORT BOOL WINAPI WriteFile(HANDLE file, const void* buffer, DWORD bytes_to_write, DWORD* bytes_written, void* overlapped);
+	DLL_IMPORT BOOL WINAPI FlushFileBuffers(HANDLE file);
+	DLL_IMPORT BOOL WINAPI MoveFileExA(LPCSTR existing_file_name, LPCSTR new_file_name, DWORD flags);
+	DLL_IMPORT BOOL WINAPI DeleteFileA(LPCSTR file_name);
+	DLL_IMPORT BOOL WINAPI CreateDirectoryA(LPCSTR path_name, void* security_attributes);
+	DLL_IMPORT DWORD WINAPI GetEnvironmentVariableA(LPCSTR name, LPSTR buffer, DWORD size);
+	DLL_IMPORT DWORD WINAPI GetLastError();
+	DLL_IMPORT BOOL WINAPI ReadFile(HANDLE file, void* buffer, DWORD bytes_to_read, DWORD* bytes_read, void* overlapped);
+	DLL_IMPORT BOOL WINAPI SetFilePointerEx(HANDLE file, s64 distance_to_move, s64* new_file_pointer, DWORD move_method);
+	DLL_IMPORT BOOL WINAPI GetFileAttributesExA(LPCSTR file_name, int info_level_id, void* file_information);
+	DLL_IMPORT HANDLE WINAPI FindFirstFileA(LPCSTR file_name, Win32_Find_Data* find_data);
+	DLL_IMPORT BOOL WINAPI FindNextFileA(HANDLE find_file, Win32_Find_Data* find_data);
+	DLL_IMPORT BOOL WINAPI FindClose(HANDLE find_file);
+
+	DLL_IMPORT HANDLE WINAPI CreateEventA(void* event_attributes, BOOL manual_reset, BOOL initial_state, LPCSTR name);
+	DLL_IMPORT BOOL WINAPI SetEvent(HANDLE event);
+	DLL_IMPORT DWORD WINAPI WaitForMultipleObjects(DWORD count, const HANDLE* handles, BOOL wait_all, DWORD milliseconds);
+	DLL_IMPORT HANDLE WINAPI FindFirstChangeNotificationA(LPCSTR path_name, BOOL watch_subtree, DWORD notify_filter);
+	DLL_IMPORT BOOL WINAPI FindNextChangeNotification(HANDLE change_handle);
+	DLL_IMPORT BOOL WINAPI FindCloseChangeNotification(HANDLE change_handle);
+	DLL_IMPORT BOOL WINAPI ReadDirectoryChangesW(HANDLE directory, void* buffer, DWORD buffer_length, BOOL watch_subtree, DWORD notify_filter, DWORD* bytes_returned, Win32_Overlapped* overlapped, void* completion_routine);
+	DLL_IMPORT BOOL WINAPI GetOverlappedResult(HANDLE file, Win32_Overlapped* overlapped, DWORD* bytes_transferred, BOOL wait);
+}
+#else
+#include <pthread.h>
+#include <semaphore.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/inotify.h>
+#include <glob.h>
+#include <dirent.h>
+#include <poll.h>
+#include <limits.h>
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <X11/Xlib.h>
+#endif
+
+#include <string.h>
+
+/* THREADS */
+
+struct Thread_Start {
+	Thread_Proc proc;
+	void* param;
+};
+
+#if CH_PLATFORM_WINDOWS
+static DWORD __stdcall thread_start(void* param) {
+#else
+static void* thread_start(void* param) {
+#endif
+	Thread_Start* const start = (Thread_Start*)param;
+	const Thread_Proc proc = start->proc;
+	void* const proc_param = start->param;
+	ch_delete start;
+
+	proc(proc_param);
+	return 0;
+}
+
+bool create_thread(Thread_Proc proc, void* param, Thread* out_thread) {
+	Thread_Start* const start = ch_new Thread_Start;
+	start->proc = proc;
+	start->param = param;
+
+#if CH_PLATFORM_WINDOWS
+	HANDLE handle = CreateThread(nullptr, 0, thread_start, start, 0, nullptr);
+	if (!handle) {
+		ch_delete start;
+		return false;
+	}
+	out_thread->handle = handle;
+#else
+	pthread_t thread;
+	if (pthread_create(&thread, nullptr, thread_start, start) != 0) {
+		ch_delete start;
+		return false;
+	}
+	pthread_detach(thread);
+	out_thread->handle = (void*)thread;
+#endif
+
+	return true;
+}
+
+u32 get_num_cores() {
+#if CH_PLATFORM_WINDOWS
+	const u32 result = GetActiveProcessorCount(WIN32_ALL_PROCESSOR_GROUPS);
+#else
+	const long result = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	return result > 0 ? (u32)result : 1;
+}
+
+Mutex::Mutex() {
+#if CH_PLATFORM_WINDOWS
+	static_assert(sizeof(storage) >= sizeof(Win32_SRW_Lock), "Mutex storage is too small");
+	InitializeSRWLock((Win32_SRW_Lock*)storage);
+#else
+	static_assert(sizeof(storage) >= sizeof(pthread_mutex_t), "Mutex storage is too small");
+	pthread_mutex_init((pthread_mutex_t*)storage, nullptr);
+#endif
+}
+
+Mutex::~Mutex() {
+#if !CH_PLATFORM_WINDOWS
+	pthread_mutex_destroy((pthread_mutex_t*)storage);
+#endif
+}
+
+void Mutex::lock() {
+#if CH_PLATFORM_WINDOWS
+	AcquireSRWLockExclusive((Win32_SRW_Lock*)storage);
+#else
+	pthread_mutex_lock((pthread_mutex_t*)storage);
+#endif
+}
+
+void Mutex::unlock() {
+#if CH_PLATFORM_WINDOWS
+	ReleaseSRWLockExclusive((Win32_SRW_Lock*)storage);
+#else
+	pthread_mutex_unlock((pthread_mutex_t*)storage);
+#endif
+}
+
+Semaphore::Semaphore(u32 initial_count) {
+#if CH_PLATFORM_WINDOWS
+	*(HANDLE*)storage = CreateSemaphoreA(nullptr, (LONG)initial_count, 0x7FFFFFFF, nullptr);
+#else
+	static_assert(sizeof(storage) >= sizeof(sem_t), "Semaphore storage is too small");
+	sem_init((sem_t*)storage, 0, initial_count);
+#endif
+}
+
+Semaphore::~Semaphore() {
+#if CH_PLATFORM_WINDOWS
+	CloseHandle(*(HANDLE*)storage);
+#else
+	sem_destroy((sem_t*)storage);
+#endif
+}
+
+void Semaphore::signal(u32 count) {
+#if CH_PLATFORM_WINDOWS
+	ReleaseSemaphore(*(HANDLE*)storage, (LONG)count, nullptr);
+#else
+	for (u32 i = 0; i < count; i += 1) sem_post((sem_t*)storage);
+#endif
+}
+
+void Semaphore::wait() {
+#if CH_PLATFORM_WINDOWS
+	WaitForSingleObject(*(HANDLE*)storage, WIN32_INFINITE);
+#else
+	while (sem_wait((sem_t*)storage) != 0) {}
+#endif
+}
+
+#if !CH_PLATFORM_WINDOWS
+// Xlib connections aren't safe to share between threads, so wake events go out over one of our own.
+static Display* wake_display;
+static Mutex wake_display_lock;
+#endif
+
+void post_wake_event(void* window_handle) {
+	if (!window_handle) return;
+
+#if CH_PLATFORM_WINDOWS
+	PostMessageA((HWND)window_handle, WIN32_WM_NULL, 0, 0);
+#else
+	wake_display_lock.lock();
+	if (!wake_display) wake_display = XOpenDisplay(nullptr);
+	if (wake_display) {
+		// An empty client message, the window's event loop ignores it but it's enough to return from waiting.
+		XEvent event = {};
+		event.xclient.type = ClientMessage;
+		event.xclient.window = (::Window)(usize)window_handle;
+		event.xclient.format = 32;
+		XSendEvent(wake_display, event.xclient.window, False, NoEventMask, &event);
+		XFlush(wake_display);
+	}
+	wake_display_lock.unlock();
+#endif
+}
+
+/* FILES */
+
+bool map_file(const char* path, Mapped_File* out_file) {
+	Mapped_File result;
+
+#if CH_PLATFORM_WINDOWS
+	// Other processes may well have it open for writing, a log being appended to for one
+	HANDLE file = CreateFileA(path, WIN32_GENERIC_READ, WIN32_FILE_SHARE_READ | WIN32_FILE_SHARE_WRITE | WIN32_FILE_SHARE_DELETE, nullptr, WIN32_OPEN_EXISTING, WIN32_FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == WIN32_INVALID_HANDLE_VALUE) return false;
+
+	s64 file_size = 0;
+	if (!GetFileSizeEx(file, &file_size) || file_size <= 0) {
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, WIN32_PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping) {
+		CloseHandle(file);
+		return false;
+	}
+
+	void* const data = MapViewOfFile(mapping, WIN32_FILE_MAP_READ, 0, 0, 0);
+	if (!data) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	result.file_handle = file;
+	result.mapping_handle = mapping;
+#else
+	const int fd = open(path, O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+		close(fd);
+		return false;
+	}
+	const usize file_size = (usize)st.st_size;
+
+	void* const data = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// The mapping keeps the file alive on its own.
+	close(fd);
+	if (data == MAP_FAILED) return false;
+#endif
+
+	result.data = (const u8*)data;
+	result.size = (usize)file_size;
+	*out_file = result;
+	return true;
+}
+
+void unmap_file(Mapped_File* file) {
+	if (!file->data) return;
+
+#if CH_PLATFORM_WINDOWS
+	UnmapViewOfFile(file->data);
+	CloseHandle((HANDLE)file->mapping_handle);
+	CloseHandle((HANDLE)file->file_handle);
+#else
+	munmap((void*)file->data, file->size);
+#endif
+
+	*file = {};
+}
+
+// Temp files sit next to the target so the rename never crosses volumes.
+static bool make_temp_path(const char* path, char* out_path, usize out_size) {
+	const char suffix[] = ".eden-save";
+	const usize path_len = strlen(path);
+	if (path_len + sizeof(suffix) > out_size) return false;
+
+	memcpy(out_path, path, path_len);
+	memcpy(out_path + path_len, suffix, sizeof(suffix));
+	return true;
+}
+
+bool write_file_atomic(const char* path, const Write_Span* spans, u32 num_spans) {
+	char temp_path[1024];
+	if (!make_temp_path(path, temp_path, sizeof(temp_path))) return false;
+
+#if CH_PLATFORM_WINDOWS
+	HANDLE file = CreateFileA(temp_path, WIN32_GENERIC_WRITE, 0, nullptr, WIN32_CREATE_ALWAYS, WIN32_FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == WIN32_INVALID_HANDLE_VALUE) return false;
+
+	// WriteFileGather wants page aligned unbuffered I/O, so each span is its own WriteFile instead. Still no copies.
+	bool ok = true;
+	for (u32 i = 0; ok && i < num_spans; i += 1) {
+		const u8* at = (const u8*)spans[i].data;
+		usize remaining = spans[i].size;
+		while (ok && remaining) {
+			const DWORD chunk = remaining > 0x40000000 ? 0x40000000 : (DWORD)remaining;
+			DWORD written = 0;
+			ok = WriteFile(file, at, chunk, &written, nullptr) && written == chunk;
+			at += written;
+			remaining -= written;
+		}
+	}
+	ok = ok && FlushFileBuffers(file);
+	CloseHandle(file);
+
+	ok = ok && MoveFileExA(temp_path, path, WIN32_MOVEFILE_REPLACE_EXISTING | WIN32_MOVEFILE_WRITE_THROUGH);
+	if (!ok) DeleteFileA(temp_path);
+	return ok;
+#else
+	// Keep the original's permissions.
+	mode_t mode = 0644;
+	struct stat st;
+	if (stat(path, &st) == 0) mode = st.st_mode & 07777;
+
+	const int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, mode);
+	if (fd < 0) return false;
+
+	// writev can stop part way through, so walk the spans by hand and resume where it left off.
+	struct iovec iov[16];
+	u32 span_index = 0;
+	usize span_offset = 0;
+	bool ok = true;
+	while (ok && span_index < num_spans) {
+		int num_iov = 0;
+		for (u32 i = span_index; i < num_spans && num_iov < 16; i += 1) {
+			const usize offset = i == span_index ? span_offset : 0;
+			iov[num_iov].iov_base = (u8*)spans[i].data + offset;
+			iov[num_iov].iov_len = spans[i].size - offset;
+			num_iov += 1;
+		}
+
+		const ssize_t written = writev(fd, iov, num_iov);
+		if (written < 0) {
+			ok = errno == EINTR;
+			continue;
+		}
+
+		usize advanced = (usize)written;
+		while (span_index < num_spans && advanced >= spans[span_index].size - span_offset) {
+			advanced -= spans[span_index].size - span_offset;
+			span_index += 1;
+			span_offset = 0;
+		}
+		span_offset += advanced;
+	}
+	ok = ok && fsync(fd) == 0;
+	ok = close(fd) == 0 && ok;
+
+	ok = ok && rename(temp_path, path) == 0;
+	if (!ok) {
+		unlink(temp_path);
+		return false;
+	}
+
+	// The rename itself only survives a crash once the directory is flushed.
+	char dir_path[1024];
+	memcpy(dir_path, path, strlen(path) + 1);
+	char* const last_slash = strrchr(dir_path, '/');
+	if (last_slash) {
+		*last_slash = 0;
+		const int dir_fd = open(last_slash == dir_path ? "/" : dir_path, O_RDONLY);
+		if (dir_fd >= 0) {
+			fsync(dir_fd);
+			close(dir_fd);
+		}
+	}
+
+	return true;
+#endif
+}
+
+usize read_file_at(const char* path, u64 offset, void* out, usize size) {
+	u8* dest = (u8*)out;
+	usize total = 0;
+
+#if CH_PLATFORM_WINDOWS
+	HANDLE file = CreateFileA(path, WIN32_GENERIC_READ, WIN32_FILE_SHARE_READ | WIN32_FILE_SHARE_WRITE | WIN32_FILE_SHARE_DELETE, nullptr, WIN32_OPEN_EXISTING, WIN32_FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == WIN32_INVALID_HANDLE_VALUE) return 0;
+
+	if (SetFilePointerEx(file, (s64)offset, nullptr, 0)) {
+		while (total < size) {
+			const usize remaining = size - total;
+			const DWORD to_read = remaining > 0x40000000 ? 0x40000000 : (DWORD)remaining;
+			DWORD num_read = 0;
+			if (!ReadFile(file, dest + total, to_read, &num_read, nullptr) || !num_read) break;
+			total += num_read;
+		}
+	}
+	CloseHandle(file);
+#else
+	const int fd = open(path, O_RDONLY);
+	if (fd < 0) return 0;
+
+	while (total < size) {
+		const ssize_t num_read = pread(fd, dest + total, size - total, (off_t)(offset + total));
+		if (num_read < 0 && errno == EINTR) continue;
+		if (num_read <= 0) break;
+		total += (usize)num_read;
+	}
+	close(fd);
+#endif
+
+	return total;
+}
+
+bool append_to_file(const char* path, const void* data, usize size) {
+#if CH_PLATFORM_WINDOWS
+	// FILE_APPEND_DATA without write access makes every write land at the end
+	HANDLE file = CreateFileA(path, WIN32_FILE_APPEND_DATA, WIN32_FILE_SHARE_READ, nullptr, WIN32_OPEN_ALWAYS, WIN32_FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == WIN32_INVALID_HANDLE_VALUE) return false;
+
+	bool ok = true;
+	const u8* src = (const u8*)data;
+	usize remaining = size;
+	while (ok && remaining) {
+		const DWORD to_write = remaining > 0x40000000 ? 0x40000000 : (DWORD)remaining;
+		DWORD written = 0;
+		ok = WriteFile(file, src, to_write, &written, nullptr) && written;
+		src += written;
+		remaining -= written;
+	}
+	ok = ok && FlushFileBuffers(file);
+	CloseHandle(file);
+	return ok;
+#else
+	const int fd = open(path, O_WRONLY | O_APPEND | O_CREAT, 0644);
+	if (fd < 0) return false;
+
+	bool ok = true;
+	const u8* src = (const u8*)data;
+	usize remaining = size;
+	while (ok && remaining) {
+		const ssize_t written = write(fd, src, remaining);
+		if (written < 0) {
+			ok = errno == EINTR;
+			continue;
+		}
+		src += written;
+		remaining -= (usize)written;
+	}
+	ok = ok && fdatasync(fd) == 0;
+	ok = close(fd) == 0 && ok;
+	return ok;
+#endif
+}
+
+bool delete_file(const char* path) {
+#if CH_PLATFORM_WINDOWS
+	return DeleteFileA(path) || GetLastError() == WIN32_ERROR_FILE_NOT_FOUND;
+#else
+	return unlink(path) == 0 || errno == ENOENT;
+#endif
+}
+
+static bool create_directory(const char* path) {
+#if CH_PLATFORM_WINDOWS
+	return CreateDirectoryA(path, nullptr) || GetLastError() == WIN32_ERROR_ALREADY_EXISTS;
+#else
+	return mkdir(path, 0700) == 0 || errno == EEXIST;
+#endif
+}
+
+/** Appends name to the directory in out_path and makes sure it exists. */
+static bool push_directory(char* out_path, usize out_size, const char* name) {
+	const usize path_len = strlen(out_path);
+	const usize name_len = strlen(name);
+	if (path_len + 1 + name_len + 1 > out_size) return false;
+
+#if CH_PLATFORM_WINDOWS
+	out_path[path_len] = '\\';
+#else
+	out_path[path_len] = '/';
+#endif
+	memcpy(out_path + path_len + 1, name, name_len + 1);
+	return create_directory(out_path);
+}
+
+bool get_cache_directory(char* out_path, usize out_size) {
+#if CH_PLATFORM_WINDOWS
+	const DWORD len = GetEnvironmentVariableA("LOCALAPPDATA", out_path, (DWORD)out_size);
+	if (!len || len >= out_size) return false;
+#else
+	// XDG_CACHE_HOME if it's set, ~/.cache otherwise
+	const char* base = getenv("XDG_CACHE_HOME");
+	const char* sub = nullptr;
+	if (!base || !*base) {
+		base = getenv("HOME");
+		sub = ".cache";
+	}
+	if (!base || !*base) return false;
+
+	const usize base_len = strlen(base);
+	if (base_len + 1 > out_size) return false;
+	memcpy(out_path, base, base_len + 1);
+	if (!create_directory(out_path)) return false;
+	if (sub && !push_directory(out_path, out_size, sub)) return false;
+#endif
+	return push_directory(out_path, out_size, "eden");
+}
+
+bool get_file_stamp(const char* path, File_Stamp* out_stamp) {
+#if CH_PLATFORM_WINDOWS
+	Win32_File_Attribute_Data data;
+	if (!GetFileAttributesExA(path, WIN32_GET_FILE_EX_INFO_STANDARD, &data)) return false;
+
+	out_stamp->modified = ((u64)data.last_write_time.high_date_time << 32) | data.last_write_time.low_date_time;
+	out_stamp->size = ((u64)data.file_size_high << 32) | data.file_size_low;
+#else
+	struct stat st;
+	if (stat(path, &st) != 0) return false;
+
+	out_stamp->modified = (u64)st.st_mtim.tv_sec * 1000000000 + (u64)st.st_mtim.tv_nsec;
+	out_stamp->size = (u64)st.st_size;
+#endif
+	return true;
+}
+
+usize find_files(const char* pattern, Found_File_Proc proc, void* data) {
+	usize result = 0;
+
+#if CH_PLATFORM_WINDOWS
+	// Found names come back without the directory, so it's put back on in front of them
+	char path[1024];
+	usize dir_len = 0;
+	for (usize i = 0; pattern[i]; i += 1) {
+		if (pattern[i] == '/' || pattern[i] == '\\') dir_len = i + 1;
+	}
+	if (dir_len >= sizeof(path)) return 0;
+	memcpy(path, pattern, dir_len);
+
+	Win32_Find_Data find_data;
+	const HANDLE find_handle = FindFirstFileA(pattern, &find_data);
+	if (find_handle == WIN32_INVALID_HANDLE_VALUE) return 0;
+
+	do {
+		if (find_data.file_attributes & WIN32_FILE_ATTRIBUTE_DIRECTORY) continue;
+
+		const usize name_len = strlen(find_data.file_name);
+		if (dir_len + name_len + 1 > sizeof(path)) continue;
+		memcpy(path + dir_len, find_data.file_name, name_len + 1);
+
+		proc(path, data);
+		result += 1;
+	} while (FindNextFileA(find_handle, &find_data));
+
+	FindClose(find_handle);
+#else
+	// A name that exists is opened as is, even if it has glob characters in it
+	struct stat st;
+	if (stat(pattern, &st) == 0) {
+		if (S_ISDIR(st.st_mode)) return 0;
+		proc(pattern, data);
+		return 1;
+	}
+	if (!strpbrk(pattern, "*?[")) return 0;
+
+	// GLOB_MARK puts a slash on the end of directories so they can be told apart without a stat each
+	glob_t found;
+	if (glob(pattern, GLOB_MARK, nullptr, &found) != 0) return 0;
+
+	for (usize i = 0; i < (usize)found.gl_pathc; i += 1) {
+		const char* const path = found.gl_pathv[i];
+		const usize len = strlen(path);
+		if (!len || path[len - 1] == '/') continue;
+
+		proc(path, data);
+		result += 1;
+	}
+
+	globfree(&found);
+#endif
+
+	return result;
+}
+
+/* DIRECTORIES */
+
+bool list_directory(const char* path, Directory_Entry_Proc proc, void* data) {
+#if CH_PLATFORM_WINDOWS
+	char pattern[1024];
+	const usize path_len = strlen(path);
+	if (path_len + 3 > sizeof(pattern)) return false;
+	memcpy(pattern, path, path_len);
+	memcpy(pattern + path_len, "\\*", 3);
+
+	Win32_Find_Data find_data;
+	const HANDLE find_handle = FindFirstFileA(pattern, &find_data);
+	if (find_handle == WIN32_INVALID_HANDLE_VALUE) return false;
+
+	do {
+		const char* const name = find_data.file_name;
+		if (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2]))) continue;
+
+		const bool is_directory = (find_data.file_attributes & WIN32_FILE_ATTRIBUTE_DIRECTORY) != 0;
+		if (is_directory && (find_data.file_attributes & WIN32_FILE_ATTRIBUTE_REPARSE_POINT)) continue;
+
+		proc(name, is_directory, data);
+	} while (FindNextFileA(find_handle, &find_data));
+
+	FindClose(find_handle);
+#else
+	DIR* const dir = opendir(path);
+	if (!dir) return false;
+
+	const usize path_len = strlen(path);
+	while (const struct dirent* const entry = readdir(dir)) {
+		const char* const name = entry->d_name;
+		if (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2]))) continue;
+
+		bool is_directory = entry->d_type == DT_DIR;
+
+		// Some filesystems don't fill in d_type, and links need following to see what they point at
+		if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) {
+			char entry_path[PATH_MAX];
+			const usize name_len = strlen(name);
+			if (path_len + name_len + 2 > sizeof(entry_path)) continue;
+			memcpy(entry_path, path, path_len);
+			entry_path[path_len] = '/';
+			memcpy(entry_path + path_len + 1, name, name_len + 1);
+
+			struct stat st;
+			if (stat(entry_path, &st) != 0) continue;
+			is_directory = S_ISDIR(st.st_mode);
+			if (is_directory && entry->d_type == DT_LNK) continue;
+			if (!is_directory && !S_ISREG(st.st_mode)) continue;
+		} else if (!is_directory && entry->d_type != DT_REG) {
+			continue;
+		}
+
+		proc(name, is_directory, data);
+	}
+
+	closedir(dir);
+#endif
+	return true;
+}
+
+/** How long changes are gathered after the first one before they're reported. */
+#define TREE_CHANGE_GATHER_MS 50
+
+#if CH_PLATFORM_WINDOWS
+struct Tree_Watcher {
+	char root[1024];
+	HANDLE directory;
+	HANDLE event;
+	Win32_Overlapped overlapped;
+
+	// Filled in by ReadDirectoryChangesW, which wants it DWORD aligned
+	alignas(8) u8 changes[64 * 1024];
+};
+
+/** Starts reading the next batch of changes into the watcher's buffer. */
+static bool read_tree_changes(Tree_Watcher* watcher) {
+	watcher->overlapped = {};
+	watcher->overlapped.event = watcher->event;
+	return ReadDirectoryChangesW(watcher->directory, watcher->changes, sizeof(watcher->changes), TRUE,
+		WIN32_FILE_NOTIFY_CHANGE_FILE_NAME | WIN32_FILE_NOTIFY_CHANGE_DIR_NAME, nullptr, &watcher->overlapped, nullptr);
+}
+
+/** Matches the project's *.eden-* ignore rule against the last part of a changed path. */
+static bool is_eden_file_name(const wchar_t* path, usize len) {
+	const wchar_t tag[] = L".eden-";
+	const usize tag_len = sizeof(tag) / sizeof(tag[0]) - 1;
+
+	usize name_start = 0;
+	for (usize i = 0; i < len; i += 1) {
+		if (path[i] == L'\\') name_start = i + 1;
+	}
+	for (usize i = name_start; i + tag_len <= len; i += 1) {
+		if (memcmp(path + i, tag, tag_len * sizeof(wchar_t)) == 0) return true;
+	}
+	return false;
+}
+
+/** @returns true if a batch of size bytes has a change to anything but eden's own files. An overflowed batch always does. */
+static bool has_project_tree_changes(const Tree_Watcher* watcher, DWORD size) {
+	if (!size) return true;
+
+	for (DWORD offset = 0;;) {
+		const Win32_File_Notify_Information* const info = (const Win32_File_Notify_Information*)(watcher->changes + offset);
+		if (!is_eden_file_name(info->file_name, info->file_name_length / sizeof(wchar_t))) return true;
+		if (!info->next_entry_offset) return false;
+		offset += info->next_entry_offset;
+	}
+}
+#else
+struct Tree_Watch_Directory {
+	int watch_descriptor;
+	char* path;
+};
+
+struct Tree_Watcher {
+	int fd;
+
+	// Grown by hand, only the thread that owns the watcher touches it
+	Tree_Watch_Directory* directories;
+	usize num_directories;
+	usize allocated_directories;
+};
+#endif
+
+Tree_Watcher* watch_tree(const char* root) {
+#if CH_PLATFORM_WINDOWS
+	const usize root_len = strlen(root);
+
+	Tree_Watcher* const watcher = ch_new Tree_Watcher;
+	if (root_len >= sizeof(watcher->root)) {
+		ch_delete watcher;
+		return nullptr;
+	}
+	memcpy(watcher->root, root, root_len + 1);
+
+	// Opened for ReadDirectoryChangesW rather than FindFirstChangeNotification, which can't say what changed
+	watcher->directory = CreateFileA(root, WIN32_FILE_LIST_DIRECTORY, WIN32_FILE_SHARE_READ | WIN32_FILE_SHARE_WRITE | WIN32_FILE_SHARE_DELETE,
+		nullptr, WIN32_OPEN_EXISTING, WIN32_FILE_FLAG_BACKUP_SEMANTICS | WIN32_FILE_FLAG_OVERLAPPED, nullptr);
+	if (watcher->directory == WIN32_INVALID_HANDLE_VALUE) {
+		ch_delete watcher;
+		return nullptr;
+	}
+
+	watcher->event = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+	if (!watcher->event || !read_tree_changes(watcher)) {
+		if (watcher->event) CloseHandle(watcher->event);
+		CloseHandle(watcher->directory);
+		ch_delete watcher;
+		return nullptr;
+	}
+	return watcher;
+#else
+	const int fd = inotify_init1(IN_CLOEXEC);
+	if (fd < 0) return nullptr;
+
+	Tree_Watcher* const watcher = ch_new Tree_Watcher;
+	watcher->fd = fd;
+	watcher->directories = nullptr;
+	watcher->num_directories = 0;
+	watcher->allocated_directories = 0;
+
+	watch_tree_directory(watcher, root);
+	if (!watcher->num_directories) {
+		close(fd);
+		ch_delete watcher;
+		return nullptr;
+	}
+	return watcher;
+#endif
+}
+
+void watch_tree_directory(Tree_Watcher* watcher, const char* path) {
+#if !CH_PLATFORM_WINDOWS
+	const int watch_descriptor = inotify_add_watch(watcher->fd, path, IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR);
+	if (watch_descriptor < 0) return;
+
+	const usize path_len = strlen(path);
+
+	// Watching the same directory again hands back the same descriptor. It may have been renamed since
+	for (usize i = 0; i < watcher->num_directories; i += 1) {
+		Tree_Watch_Directory& directory = watcher->directories[i];
+		if (directory.watch_descriptor != watch_descriptor) continue;
+
+		ch_delete[] directory.path;
+		directory.path = ch_new char[path_len + 1];
+		memcpy(directory.path, path, path_len + 1);
+		return;
+	}
+
+	if (watcher->num_directories == watcher->allocated_directories) {
+		const usize allocated = watcher->allocated_directories ? watcher->allocated_directories * 2 : 256;
+		Tree_Watch_Directory* const directories = ch_new Tree_Watch_Directory[allocated];
+		if (watcher->num_directories) memcpy(directories, watcher->directories, watcher->num_directories * sizeof(Tree_Watch_Directory));
+		ch_delete[] watcher->directories;
+
+		watcher->directories = directories;
+		watcher->allocated_directories = allocated;
+	}
+
+	Tree_Watch_Directory& directory = watcher->directories[watcher->num_directories];
+	directory.watch_descriptor = watch_descriptor;
+	directory.path = ch_new char[path_len + 1];
+	memcpy(directory.path, path, path_len + 1);
+	watcher->num_directories += 1;
+#endif
+}
+
+#if !CH_PLATFORM_WINDOWS
+static Tree_Watch_Directory* find_tree_watch_directory(Tree_Watcher* watcher, int watch_descriptor) {
+	for (usize i = 0; i < watcher->num_directories; i += 1) {
+		if (watcher->directories[i].watch_descriptor == watch_descriptor) return &watcher->directories[i];
+	}
+	return nullptr;
+}
+#endif
+
+bool wait_for_tree_changes(Tree_Watcher* watcher, Tree_Change_Proc proc, void* data) {
+#if CH_PLATFORM_WINDOWS
+	// Saves, journals and caches of our own would each cost a rescan of the whole tree, so batches of only those are dropped.
+	// Once something else has changed keep going until it's been quiet for a moment
+	bool changed = false;
+	for (;;) {
+		const DWORD wait = WaitForSingleObject(watcher->event, changed ? TREE_CHANGE_GATHER_MS : WIN32_INFINITE);
+		if (wait == WIN32_WAIT_TIMEOUT) break;
+		if (wait != WIN32_WAIT_OBJECT_0) return false;
+
+		DWORD size = 0;
+		if (!GetOverlappedResult(watcher->directory, &watcher->overlapped, &size, FALSE)) return false;
+		if (has_project_tree_changes(watcher, size)) changed = true;
+		if (!read_tree_changes(watcher)) return false;
+	}
+
+	proc(watcher->root, true, data);
+	return true;
+#else
+	// Descriptors of the directories that changed, each reported once
+	int changed[256];
+	usize num_changed = 0;
+	bool overflowed = false;
+
+	int timeout = -1;
+	for (;;) {
+		pollfd poll_fd = { watcher->fd, POLLIN, 0 };
+		const int num_ready = poll(&poll_fd, 1, timeout);
+		if (num_ready < 0 && errno == EINTR) continue;
+		if (num_ready < 0) return false;
+		if (num_ready == 0) break;
+
+		alignas(struct inotify_event) char events[4096];
+		const ssize_t read_size = read(watcher->fd, events, sizeof(events));
+		if (read_size < 0 && errno == EINTR) continue;
+		if (read_size <= 0) return false;
+
+		for (ssize_t offset = 0; offset < read_size;) {
+			const inotify_event* const event = (const inotify_event*)(events + offset);
+			offset += sizeof(inotify_event) + event->len;
+
+			if (event->mask & IN_Q_OVERFLOW) {
+				overflowed = true;
+				continue;
+			}
+
+			// The directory itself is gone. Its parent reports that, so just forget it
+			if (event->mask & IN_IGNORED) {
+				Tree_Watch_Directory* const directory = find_tree_watch_directory(watcher, event->wd);
+				if (!directory) continue;
+
+				ch_delete[] directory->path;
+				watcher->num_directories -= 1;
+				*directory = watcher->directories[watcher->num_directories];
+				continue;
+			}
+
+			bool seen = false;
+			for (usize i = 0; i < num_changed; i += 1) {
+				if (changed[i] == event->wd) seen = true;
+			}
+			if (seen) continue;
+
+			if (num_changed < sizeof(changed) / sizeof(changed[0])) {
+				changed[num_changed] = event->wd;
+				num_changed += 1;
+			} else {
+				overflowed = true;
+			}
+		}
+
+		timeout = TREE_CHANGE_GATHER_MS;
+	}
+
+	// Lost track of what changed, everything has to be checked from the root down. The root is never moved from the front
+	if (overflowed) {
+		if (watcher->num_directories) proc(watcher->directories[0].path, true, data);
+		return true;
+	}
+
+	for (usize i = 0; i < num_changed; i += 1) {
+		const Tree_Watch_Directory* const directory = find_tree_watch_directory(watcher, changed[i]);
+		if (directory) proc(directory->path, false, data);
+	}
+	return true;
+#endif
+}
+
+/* FILE WATCHING */
+
+#define MAX_WATCHED_DIRECTORIES 60
+
+struct Watched_Directory {
+	char path[1024];
+	u32 ref_count;
+#if CH_PLATFORM_WINDOWS
+	HANDLE change_handle;
+#else
+	int watch_descriptor;
+#endif
+};
+
+static Watched_Directory watched_directories[MAX_WATCHED_DIRECTORIES];
+static u32 num_watched_directories = 0;
+static Mutex watched_directories_lock;
+static volatile s32 files_changed = 0;
+static void* file_watch_window = nullptr;
+
+#if CH_PLATFORM_WINDOWS
+// Signalled when the list of directories changes so the watch thread picks up the new handles.
+static HANDLE watch_list_changed = nullptr;
+
+// Handles of unwatched directories. The watch thread may still be waiting on them, so it closes them itself once it's woken
+static ch::Array<HANDLE> retired_change_handles;
+#else
+static int inotify_fd = -1;
+#endif
+
+static void file_watch_proc(void* param) {
+	for (;;) {
+#if CH_PLATFORM_WINDOWS
+		HANDLE handles[MAX_WATCHED_DIRECTORIES + 1];
+		handles[0] = watch_list_changed;
+		DWORD num_handles = 1;
+
+		watched_directories_lock.lock();
+		for (usize i = 0; i < retired_change_handles.count; i += 1) {
+			FindCloseChangeNotification(retired_change_handles[i]);
+		}
+		retired_change_handles.count = 0;
+
+		for (u32 i = 0; i < num_watched_directories; i += 1) {
+			handles[num_handles] = watched_directories[i].change_handle;
+			num_handles += 1;
+		}
+		watched_directories_lock.unlock();
+
+		const DWORD result = WaitForMultipleObjects(num_handles, handles, FALSE, WIN32_INFINITE);
+		if (result <= WIN32_WAIT_OBJECT_0 || result >= WIN32_WAIT_OBJECT_0 + num_handles) continue;
+
+		// Fails harmlessly if the directory was unwatched while we were waiting
+		FindNextChangeNotification(handles[result - WIN32_WAIT_OBJECT_0]);
+#else
+		// What changed doesn't matter, the main thread checks stamps. Just drain the events
+		alignas(struct inotify_event) char events[4096];
+		const ssize_t read_size = read(inotify_fd, events, sizeof(events));
+		if (read_size < 0 && errno == EINTR) continue;
+		if (read_size <= 0) return;
+#endif
+
+		// A file being appended to sends a change per write. Whatever comes in over the gather delay is reported once,
+		// so a busy log wakes the main thread a few times a second rather than for every line
+		ch::sleep(TREE_CHANGE_GATHER_MS);
+#if !CH_PLATFORM_WINDOWS
+		for (;;) {
+			pollfd poll_fd = { inotify_fd, POLLIN, 0 };
+			if (poll(&poll_fd, 1, 0) <= 0) break;
+			if (read(inotify_fd, events, sizeof(events)) <= 0) break;
+		}
+#endif
+
+		atomic_store(&files_changed, 1);
+		post_wake_event(file_watch_window);
+	}
+}
+
+bool init_file_watcher(void* window_handle) {
+	file_watch_window = window_handle;
+
+#if CH_PLATFORM_WINDOWS
+	watch_list_changed = CreateEventA(nullptr, FALSE, FALSE, nullptr);
+	if (!watch_list_changed) return false;
+	retired_change_handles.allocator = ch::get_heap_allocator();
+#else
+	inotify_fd = inotify_init1(IN_CLOEXEC);
+	if (inotify_fd < 0) return false;
+#endif
+
+	Thread thread;
+	return create_thread(file_watch_proc, nullptr, &thread);
+}
+
+/** Copies everything before the last slash of path into out_path. */
+static bool get_directory_path(const char* path, char* out_path, usize out_size) {
+	const char* last_slash = nullptr;
+	for (const char* c = path; *c; c += 1) {
+		if (*c == '/' || *c == '\\') last_slash = c;
+	}
+	if (!last_slash) return false;
+
+	// Keep the slash for the root
+	const usize len = last_slash == path ? 1 : (usize)(last_slash - path);
+	if (len + 1 > out_size) return false;
+
+	memcpy(out_path, path, len);
+	out_path[len] = 0;
+	return true;
+}
+
+// Both expect watched_directories_lock to be held.
+static bool watch_directory(const char* dir_path) {
+	for (u32 i = 0; i < num_watched_directories; i += 1) {
+		Watched_Directory& dir = watched_directories[i];
+		if (strcmp(dir.path, dir_path) == 0) {
+			dir.ref_count += 1;
+			return true;
+		}
+	}
+
+	if (num_watched_directories == MAX_WATCHED_DIRECTORIES) return false;
+
+	Watched_Directory& dir = watched_directories[num_watched_directories];
+#if CH_PLATFORM_WINDOWS
+	dir.change_handle = FindFirstChangeNotificationA(dir_path, FALSE, WIN32_FILE_NOTIFY_CHANGE_FILE_NAME | WIN32_FILE_NOTIFY_CHANGE_SIZE | WIN32_FILE_NOTIFY_CHANGE_LAST_WRITE);
+	if (dir.change_handle == WIN32_INVALID_HANDLE_VALUE) return false;
+#else
+	if (inotify_fd < 0) return false;
+
+	// Editors and git replace files by renaming over them, which a watch on the file itself would lose.
+	// IN_MODIFY catches writers that append and keep the file open, they never close it for IN_CLOSE_WRITE
+	dir.watch_descriptor = inotify_add_watch(inotify_fd, dir_path, IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE);
+	if (dir.watch_descriptor < 0) return false;
+#endif
+
+	memcpy(dir.path, dir_path, strlen(dir_path) + 1);
+	dir.ref_count = 1;
+	num_watched_directories += 1;
+
+#if CH_PLATFORM_WINDOWS
+	SetEvent(watch_list_changed);
+#endif
+	return true;
+}
+
+static void unwatch_directory(const char* dir_path) {
+	for (u32 i = 0; i < num_watched_directories; i += 1) {
+		Watched_Directory& dir = watched_directories[i];
+		if (strcmp(dir.path, dir_path) != 0) continue;
+
+		dir.ref_count -= 1;
+		if (dir.ref_count) return;
+
+#if CH_PLATFORM_WINDOWS
+		retired_change_handles.push(dir.change_handle);
+		SetEvent(watch_list_changed);
+#else
+		inotify_rm_watch(inotify_fd, dir.watch_descriptor);
+#endif
+		num_watched_directories -= 1;
+		watched_directories[i] = watched_directories[num_watched_directories];
+		return;
+	}
+}
+
+bool watch_file(const char* path) {
+	char dir_path[1024];
+	if (!get_directory_path(path, dir_path, sizeof(dir_path))) return false;
+
+	watched_directories_lock.lock();
+	const bool result = watch_directory(dir_path);
+	watched_directories_lock.unlock();
+
+	return result;
+}
+
+void unwatch_file(const char* path) {
+	char dir_path[1024];
+	if (!get_directory_path(path, dir_path, sizeof(dir_path))) return;
+
+	watched_directories_lock.lock();
+	unwatch_directory(dir_path);
+	watched_directories_lock.unlock();
+}
+
+bool consume_file_changes() {
+	if (!atomic_load(&files_changed)) return false;
+
+	atomic_store(&files_changed, 0);
+	return true;
+}
+
+/* JOBS */
+
+struct Job {
+	Job_Proc proc;
+	void* data;
+};
+
+// Ring of queued jobs. Pushing blocks nothing, so it's sized well past anything we queue at once.
+#define MAX_JOBS 4096
+
+static Job job_queue[MAX_JOBS];
+static u32 job_queue_read = 0;
+static u32 job_queue_write = 0;
+static Mutex job_queue_lock;
+static Semaphore jobs_available;
+static u32 num_workers = 0;
+
+static bool pop_job(Job* out_job) {
+	bool result = false;
+
+	job_queue_lock.lock();
+	if (job_queue_read != job_queue_write) {
+		*out_job = job_queue[job_queue_read % MAX_JOBS];
+		job_queue_read += 1;
+		result = true;
+	}
+	job_queue_lock.unlock();
+
+	return result;
+}
+
+static void worker_proc(void* param) {
+	for (;;) {
+		jobs_available.wait();
+
+		Job job;
+		if (pop_job(&job)) job.proc(job.data);
+	}
+}
+
+void init_jobs() {
+	const u32 num_cores = get_num_cores();
+	const u32 wanted = num_cores > 1 ? num_cores - 1 : 0;
+
+	for (u32 i = 0; i < wanted; i += 1) {
+		Thread thread;
+		if (!create_thread(worker_proc, nullptr, &thread)) break;
+		num_workers += 1;
+	}
+}
+
+u32 get_num_workers() {
+	return num_workers;
+}
+
+void push_job(Job_Proc proc, void* data) {
+	if (!num_workers) {
+		proc(data);
+		return;
+	}
+
+	job_queue_lock.lock();
+	assert(job_queue_write - job_queue_read < MAX_JOBS);
+	job_queue[job_queue_write % MAX_JOBS] = { proc, data };
+	job_queue_write += 1;
+	job_queue_lock.unlock();
+
+	jobs_available.signal();
+}
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <ch_stl/types.h>
+
+#if CH_PLATFORM_WINDOWS
+#include <intrin.h>
+#endif
+
+/* ATOMICS */
+
+/** @returns the value after the add. */
+CH_FORCEINLINE s32 atomic_add(volatile s32* dest, s32 value) {
+#if CH_PLATFORM_WINDOWS
+	return _InterlockedExchangeAdd((volatile long*)dest, value) + value;
+#else
+	return __atomic_add_fetch(dest, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+CH_FORCEINLINE s32 atomic_load(const volatile s32* src) {
+#if CH_PLATFORM_WINDOWS
+	const s32 result = *src;
+	_ReadWriteBarrier();
+	return result;
+#else
+	return __atomic_load_n(src, __ATOMIC_ACQUIRE);
+#endif
+}
+
+CH_FORCEINLINE void atomic_store(volatile s32* dest, s32 value) {
+#if CH_PLATFORM_WINDOWS
+	_InterlockedExchange((volatile long*)dest, value);
+#else
+	__atomic_store_n(dest, value, __ATOMIC_RELEASE);
+#endif
+}
+
+/* THREADS */
+
+using Thread_Proc = void(*)(void* param);
+
+struct Thread {
+	void* handle = nullptr;
+};
+
+bool create_thread(Thread_Proc proc, void* param, Thread* out_thread);
+
+/** @returns the number of logical cores, at least 1. */
+u32 get_num_cores();
+
+/** Simple lock. Not recursive. */
+struct Mutex {
+	// Big enough for an SRWLOCK or a pthread_mutex_t.
+	alignas(8) u8 storage[64];
+
+	Mutex();
+	~Mutex();
+
+	void lock();
+	void unlock();
+};
+
+struct Semaphore {
+	alignas(8) u8 storage[64];
+
+	Semaphore(u32 initial_count = 0);
+	~Semaphore();
+
+	void signal(u32 count = 1);
+	void wait();
+};
+
+/**
+ * Wakes up the main loop if it's blocked waiting on window events.
+ * Used by workers to get finished work onto the screen.
+ */
+void post_wake_event(void* window_handle);
+
+/* FILES */
+
+/** A read only view of a whole file. Pages are only read in as they're touched. */
+struct Mapped_File {
+	const u8* data = nullptr;
+	usize size = 0;
+
+	void* file_handle = nullptr;
+	void* mapping_handle = nullptr;
+};
+
+/** @returns false if the file doesn't exist, is empty or couldn't be mapped. */
+bool map_file(const char* path, Mapped_File* out_file);
+void unmap_file(Mapped_File* file);
+
+/** A run of bytes written by write_file_atomic. */
+struct Write_Span {
+	const void* data;
+	usize size;
+};
+
+/**
+ * Writes the spans back to back to a temp file next to path, flushes it to disk and renames it over path.
+ * Until the rename the original is untouched, so a crash never leaves a half written file behind.
+ *
+ * @returns false if any step failed, the temp file is removed
+ */
+bool write_file_atomic(const char* path, const Write_Span* spans, u32 num_spans);
+
+/**
+ * Reads up to size bytes starting at offset into out. For files too big to read whole.
+ *
+ * @returns the number of bytes read, short at the end of the file and 0 if it couldn't be opened
+ */
+usize read_file_at(const char* path, u64 offset, void* out, usize size);
+
+/**
+ * Appends data to the end of path, creating it if needed, and flushes it to disk.
+ *
+ * @returns false if the file couldn't be opened or fully written
+ */
+bool append_to_file(const char* path, const void* data, usize size);
+
+/** @returns false if path couldn't be deleted. A file that's already gone counts as deleted. */
+bool delete_file(const char* path);
+
+/**
+ * Gets the per-user directory eden keeps its caches in, creating it if it isn't there yet.
+ * That's %LOCALAPPDATA%\eden on Windows and $XDG_CACHE_HOME/eden or ~/.cache/eden elsewhere.
+ *
+ * @returns false if there's no such directory or it couldn't be made
+ */
+bool get_cache_directory(char* out_path, usize out_size);
+
+/** What a file looked like on disk when it was last checked. */
+struct File_Stamp {
+	u64 modified = 0;
+	u64 size = 0;
+
+	CH_FORCEINLINE bool operator==(const File_Stamp& other) const {
+		return modified == other.modified && size == other.size;
+	}
+	CH_FORCEINLINE bool operator!=(const File_Stamp& other) const { return !(*this == other); }
+};
+
+/** @returns false if the file doesn't exist. */
+bool get_file_stamp(const char* path, File_Stamp* out_stamp);
+
+using Found_File_Proc = void(*)(const char* path, void* data);
+
+/**
+ * Calls proc with every file matching pattern, in no particular order. Wildcards (* and ?) are only
+ * understood in the last part of the path. Directories are skipped. On POSIX a pattern naming a file
+ * that exists is taken literally, it's only globbed when there's no such file.
+ *
+ * @returns the number of files found
+ */
+usize find_files(const char* pattern, Found_File_Proc proc, void* data);
+
+/* DIRECTORIES */
+
+using Directory_Entry_Proc = void(*)(const char* name, bool is_directory, void* data);
+
+/**
+ * Calls proc with the name of everything in the directory at path, other than . and ..
+ * Symbolic links to directories are skipped so a crawl can't loop.
+ *
+ * @returns false if the directory couldn't be opened
+ */
+bool list_directory(const char* path, Directory_Entry_Proc proc, void* data);
+
+/** Watches a whole tree of directories for entries being created, deleted or renamed. */
+struct Tree_Watcher;
+
+/** @returns nullptr if root couldn't be watched */
+Tree_Watcher* watch_tree(const char* root);
+
+/**
+ * inotify watches aren't recursive, so every directory found under the root has to be added as it's crawled.
+ * Does nothing on Windows, where the root's watch already covers the whole tree.
+ */
+void watch_tree_directory(Tree_Watcher* watcher, const char* path);
+
+/** @param recursive is set if everything under directory needs checking, not just what's directly in it */
+using Tree_Change_Proc = void(*)(const char* directory, bool recursive, void* data);
+
+/**
+ * Blocks until something under the root changes, then calls proc once for each directory that changed.
+ * Changes are gathered for a moment first so a checkout or build touching many files comes through as one batch.
+ * Windows always reports the whole tree from the root, but drops batches that only touched eden's own *.eden-* files.
+ *
+ * @returns false if the watch was lost
+ */
+bool wait_for_tree_changes(Tree_Watcher* watcher, Tree_Change_Proc proc, void* data);
+
+/* FILE WATCHING */
+
+/**
+ * Starts the thread that waits on watched directories. Any change wakes the main loop through window_handle.
+ *
+ * @see consume_file_changes
+ */
+bool init_file_watcher(void* window_handle);
+
+/**
+ * Watches the directory holding path rather than the file itself, so files replaced by a rename are still seen.
+ * Directories are reference counted, every watch_file needs a matching unwatch_file.
+ */
+bool watch_file(const char* path);
+void unwatch_file(const char* path);
+
+/**
+ * @returns true if anything in a watched directory changed since the last call.
+ * Doesn't say what, callers compare File_Stamps of the files they care about.
+ */
+bool consume_file_changes();
+
+/* JOBS */
+
+using Job_Proc = void(*)(void* data);
+
+/** Starts a worker per core, leaving one for the main thread. */
+void init_jobs();
+
+/** @returns the number of workers jobs are spread across. */
+u32 get_num_workers();
+
+/** Queues proc to be called with data on a worker. Runs it right away if there are no workers. */
+void push_job(Job_Proc proc, void* data);
@@ -223,8 +223,9 @@ u8 lex(u8 dfa, const u8* p, const u8* const end, Lexeme*& lexemes) {
     return dfa;
 }
 
-const u8* temp_parser_gap;
-u64 temp_parser_gap_size;
+// Files are lexed on workers as they're opened, so every thread gets its own.
+thread_local const u8* temp_parser_gap;
+thread_local u64 temp_parser_gap_size;
 
 static const u8 lexeme_sentinel_buffer[16];
 u64 toklen(const Lexeme* l) {
@@ -987,34 +988,199 @@ static void parse(Lexeme* l, Lexeme* end) {
     }
 }
 
+static Syntax_Style get_lexeme_style(const Lexeme* l, const Lexeme* begin, const Lexeme* end) {
+    switch (l->dfa) {
+    case DFA_FUNCTION:
+        return is_keyword(l) ? SS_KEYWORD : SS_FUNCTION;
+    case DFA_PARAM:
+        return is_keyword(l) ? SS_KEYWORD : SS_PARAM;
+    case DFA_KEYWORD:
+        return SS_KEYWORD;
+    case DFA_PREPROC:
+        return SS_PREPROC;
+    case DFA_MACRO:
+        return SS_MACRO;
+    case DFA_STRINGLIT:
+    case DFA_STRINGLIT_BS:
+    case DFA_CHARLIT:
+    case DFA_CHARLIT_BS:
+        return SS_STRINGLIT;
+    case DFA_BLOCK_COMMENT:
+    case DFA_BLOCK_COMMENT_STAR:
+    case DFA_LINE_COMMENT:
+        return SS_COMMENT;
+    case DFA_WHITE_BS:
+    case DFA_WHITE:
+        // The closing quote or comment slash starts the whitespace lexeme, so it
+        // has to inherit the style of whatever it is closing.
+        if (l > begin && (l[-1].dfa == DFA_STRINGLIT || l[-1].dfa == DFA_CHARLIT)) return SS_STRINGLIT;
+        if (l > begin && l[-1].dfa <= DFA_LINE_COMMENT) return SS_COMMENT;
+        return SS_DEFAULT;
+    case DFA_IDENT:
+        return is_keyword(l) ? SS_KEYWORD : SS_DEFAULT;
+    case DFA_OP:
+    case DFA_OP2:
+        return SS_OP;
+    case DFA_NUMLIT:
+        return SS_NUMLIT;
+    case DFA_SLASH:
+        if (l + 1 < end && l[1].dfa <= DFA_LINE_COMMENT) return SS_COMMENT;
+        return SS_OP;
+    case DFA_TYPE:
+        return is_keyword(l) ? SS_KEYWORD : SS_TYPE;
+    case DFA_LABEL:
+        return SS_LABEL;
+    }
+    return SS_DEFAULT;
+}
+
+static usize get_lexeme_index(const ch::Gap_Buffer<u8>& b, const u8* p) {
+    // A pointer sitting exactly on the gap refers to the first byte after it.
+    if (p <= b.gap) return p - b.data;
+    return p - b.data - b.gap_size;
+}
+
+static void push_style_run(ch::Array<Style_Run>& runs, usize first_run_in_line, usize length, u8 style) {
+    if (runs.count > first_run_in_line) {
+        Style_Run& last = runs[runs.count - 1];
+        if (last.style == style && last.length + length <= 0xFFFF) {
+            last.length += (u16)length;
+            return;
+        }
+    }
+
+    while (length > 0xFFFF) {
+        Style_Run run = { 0xFFFF, style };
+        runs.push(run);
+        length -= 0xFFFF;
+    }
+    Style_Run run = { (u16)length, style };
+    runs.push(run);
+}
+
+// The lexer's state going into each line from first_line on. Taken before the parser overwrites the lexemes' states
+// with what it worked out, each line starts in the state of the last lexeme before it.
+static void record_line_lex_states(Buffer* buf, usize first_line, usize first_line_start, u8 first_state, const Lexeme* end) {
+    const ch::Gap_Buffer<u8>& b = buf->gap_buffer;
+    ch::Array<u8>& states = buf->line_lex_states;
+
+    states.count = first_line;
+    if (states.allocated < buf->eol_table.count) states.reserve(buf->eol_table.count - states.allocated);
+
+    const Lexeme* l = buf->lexemes.begin();
+    u8 state = first_state;
+    usize line_start = first_line_start;
+    for (usize line = first_line; line < buf->eol_table.count; line += 1) {
+        while (l < end && get_lexeme_index(b, l->i) < line_start) {
+            state = l->dfa;
+            l++;
+        }
+        states.push(state);
+        line_start += buf->eol_table[line];
+    }
+}
+
+// Folds the lexemes into per-line style runs. This runs once per parse so that
+// the renderer only has to step through a handful of runs per line.
+// Lines before first_line keep the runs they have.
+static void build_style_runs(Buffer* buf, usize first_line, usize first_line_start) {
+    const ch::Gap_Buffer<u8>& b = buf->gap_buffer;
+    ch::Array<Style_Run>& runs = buf->style_runs;
+    ch::Array<u32>& line_runs = buf->line_style_runs;
+
+    runs.count = first_line ? line_runs[first_line] : 0;
+    line_runs.count = first_line;
+    if (line_runs.allocated < buf->eol_table.count + 1) line_runs.reserve(buf->eol_table.count + 1 - line_runs.allocated);
+
+    // The last lexeme is the sentinel marking the real end of the buffer.
+    const Lexeme* const begin = buf->lexemes.begin();
+    const Lexeme* const end = buf->lexemes.end() - 1;
+    const Lexeme* l = begin;
+
+    usize line_start = first_line_start;
+    for (usize line = first_line; line < buf->eol_table.count; line += 1) {
+        const usize first_run = runs.count;
+        line_runs.push((u32)first_run);
+
+        const usize line_end = line_start + buf->eol_table[line];
+        usize at = line_start;
+        while (at < line_end) {
+            while (l + 1 < end && get_lexeme_index(b, l[1].i) <= at) l++;
+
+            usize run_end = line_end;
+            if (l + 1 <= end) {
+                const usize next = get_lexeme_index(b, l[1].i);
+                if (next > at && next < run_end) run_end = next;
+            }
+
+            const u8 style = l < end ? get_lexeme_style(l, begin, end) : SS_DEFAULT;
+            push_style_run(runs, first_run, run_end - at, style);
+            at = run_end;
+        }
+
+        line_start = line_end;
+    }
+    line_runs.push((u32)runs.count);
+}
+
+// Furthest a resumed parse backs up looking for a line at the top level.
+const usize max_parse_backup_lines = 256;
+
 void parse_cpp(Buffer* buf) {
     if (!buf->syntax_dirty || buf->disable_parse) return;
     buf->syntax_dirty = false;
     ch::Gap_Buffer<u8>& b = buf->gap_buffer;
     usize buffer_count = b.count();
 
+    // Lines above an edit that said where it started keep their runs, the lexer picks up from the state it was in there.
+    usize first_line = 0;
+    usize first_line_start = 0;
+    if (buf->syntax_resume_version == buf->version && buf->syntax_resume_line < buf->line_lex_states.count &&
+        buf->syntax_resume_line < buf->line_style_runs.count && buf->syntax_resume_line < buf->eol_table.count) {
+        first_line = buf->syntax_resume_line;
+        first_line_start = buf->syntax_resume_index;
+
+        // The parser only sees what's lexed again, so back up to a line that starts with an identifier in column 0.
+        // That's nearly always a declaration at the top level, which is where the parser would have been anyway.
+        // Not too far though, a log being followed may not have one for a long way up.
+        const usize backup_limit = first_line > max_parse_backup_lines ? first_line - max_parse_backup_lines : 0;
+        while (first_line > backup_limit) {
+            if (buf->line_lex_states[first_line] == DFA_NEWLINE && first_line_start < buffer_count &&
+                char_type[b[first_line_start]] == IDENT*P) break;
+
+            first_line -= 1;
+            first_line_start -= buf->eol_table[first_line];
+        }
+    }
+    u8 lexer = first_line ? buf->line_lex_states[first_line] : DFA_NEWLINE;
+    buf->syntax_resume_version = 0;
+    const u8 first_state = lexer;
+
     // Three extra lexemes:
     // One extra lexeme at the front.
     // One at the back to indicate buffer end to the parser, pointing to safe
     // scratch data.
     // One after that pointing to the the real position of the (unreadable) buffer
     // end, so that identifier lengths can be correctly computed.
-    buf->lexemes.reserve((1 + buffer_count + 1 + 1) - buf->lexemes.allocated);
+    const usize num_lexemes = 1 + (buffer_count - first_line_start) + 1 + 1;
+    if (buf->lexemes.allocated < num_lexemes) buf->lexemes.reserve(num_lexemes - buf->lexemes.allocated);
     buf->lexemes.count = 1;
-    if (buffer_count) {
-        u8 lexer = DFA_NEWLINE;
+    if (first_line_start < buffer_count) {
+        const usize gap_index = b.gap - b.data;
+        const u8* const first = first_line_start < gap_index ? b.data + first_line_start : b.data + first_line_start + b.gap_size;
+
         Lexeme* lex_seeker = buf->lexemes.begin();
         {
-            lex_seeker->i = b.data;
+            lex_seeker->i = first;
             lex_seeker->dfa = (Lex_Dfa)lexer;
-            lex_seeker->cached_first = b.data[0];
+            lex_seeker->cached_first = first[0];
             lex_seeker++;
         }
         
         f64 lex_time = -ch::get_time_in_seconds();
-        lexer = lex(lexer, b.data, b.gap, lex_seeker);
+        if (first < b.gap) lexer = lex(lexer, first, b.gap, lex_seeker);
         Lexeme* lexeme_at_gap = lex_seeker - 1;
-        lexer = lex(lexer, b.gap + b.gap_size, b.data + b.allocated, lex_seeker);
+        lexer = lex(lexer, first < b.gap ? b.gap + b.gap_size : first, b.data + b.allocated, lex_seeker);
         lex_time += ch::get_time_in_seconds();
 
         if (lexeme_at_gap > buf->lexemes.begin() && lexeme_at_gap < lex_seeker) {
@@ -1028,6 +1194,8 @@ void parse_cpp(Buffer* buf) {
             // lexeme_at_gap->cached_first should definitely not have changed.
         }
 
+        record_line_lex_states(buf, first_line, first_line_start, first_state, lex_seeker);
+
         {
             assert(lex_seeker < buf->lexemes.begin() + buf->lexemes.allocated);
             lex_seeker->dfa = DFA_NUM_STATES;
@@ -1053,6 +1221,10 @@ void parse_cpp(Buffer* buf) {
         buf->lex_time += lex_time;
         buf->parse_time += parse_time;
         buf->lex_parse_count++;
+    } else {
+        record_line_lex_states(buf, first_line, first_line_start, first_state, buf->lexemes.begin());
     }
+
+    build_style_runs(buf, first_line, first_line_start);
 }
 } // namespace parsing
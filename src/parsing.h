@@ -70,6 +70,35 @@ struct Lexeme {
     CH_FORCEINLINE u8 c() const { return cached_first; }
 };
 
+// These are the highlight categories the renderer actually consumes.
+// The parser still works in terms of DFA states; after every parse the
+// lexemes are folded down into one of these and stored as per-line runs,
+// so the render loop never has to look at a lexeme.
+// Colours come from the theme table in config, indexed by this enum.
+enum Syntax_Style : u8 {
+    SS_DEFAULT,
+    SS_KEYWORD,
+    SS_TYPE,
+    SS_FUNCTION,
+    SS_PARAM,
+    SS_PREPROC,
+    SS_MACRO,
+    SS_STRINGLIT,
+    SS_NUMLIT,
+    SS_COMMENT,
+    SS_OP,
+    SS_LABEL,
+
+    SS_COUNT,
+};
+
+// A run of identically styled bytes. Runs never cross a line boundary.
+// Runs longer than a u16 are split, which is rare enough not to matter.
+struct Style_Run {
+    u16 length;
+    u8 style;
+};
+
 bool is_keyword(const Lexeme* l);
 void parse_cpp(Buffer* b);
 
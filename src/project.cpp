@@ -0,0 +1,820 @@
+#include "project.h"
+
+#include <ch_stl/array.h>
+#include <ch_stl/memory.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define PROJECT_SSE2 1
+#include <emmintrin.h>
+#else
+#define PROJECT_SSE2 0
+#endif
+
+/**
+ * Files are stored in chunks that never move once allocated, so matching can read them on workers
+ * while the crawler keeps adding more. Only num_project_files is published, after the file is written.
+ */
+const usize project_files_per_chunk = 64 * 1024;
+const usize max_project_chunks = 1024;
+
+/** Files are matched in ranges this big. Has to divide project_files_per_chunk so a range never spans chunks. */
+const usize project_query_range_size = 16 * 1024;
+
+/** Paths are packed into pages of this size. A page whose files have all been removed is reused, never freed. */
+const usize project_string_page_size = 1024 * 1024;
+
+struct Project_File {
+	/** Relative to the root. The lower cased copy used for matching sits right after it. */
+	const char* path;
+	const char* lower;
+	u32 path_len;
+	u32 name_start;
+
+	/** Which of string_pages the path is packed into. */
+	u32 string_page;
+};
+
+/**
+ * masks[i] has a bit for every kind of character in files[i]'s path, and is 0 once the file is removed.
+ * They're kept apart from the files so the first pass of a query is one straight run over them.
+ */
+struct Project_File_Chunk {
+	u64 masks[project_files_per_chunk];
+	Project_File files[project_files_per_chunk];
+};
+
+static Project_File_Chunk* file_chunks[max_project_chunks];
+static volatile s32 num_project_files = 0;
+static volatile s32 project_version = 0;
+
+static char project_root[1024];
+static void* project_window = nullptr;
+
+/**
+ * Held by queries for as long as they read files, and by the crawl thread while it reuses a removed file's slot or
+ * string page. A removed file's mask is cleared first, so only a query that got past it just before can still be reading.
+ */
+static Mutex project_files_lock;
+
+// Everything below belongs to the crawl thread
+
+struct Project_Directory {
+	/** Relative to the root, empty for the root itself. */
+	char* path;
+	bool removed;
+
+	/** Live files directly in this directory, and its subdirectories. */
+	ch::Array<u32> files;
+	ch::Array<u32> children;
+};
+
+static ch::Array<Project_Directory> directories;
+
+struct Project_String_Page {
+	u8* data;
+	usize size;
+	usize used;
+
+	/** Bytes still held by files that haven't been removed. */
+	usize live;
+};
+
+static ch::Array<Project_String_Page> string_pages;
+static u32 current_string_page = 0;
+
+/** Pages whose files are all gone, and slots of removed files. Both are reused before anything new is allocated. */
+static ch::Array<u32> free_string_pages;
+static ch::Array<u32> free_files;
+
+struct Ignore_Rule {
+	char pattern[256];
+	bool directory_only;
+
+	/** Matched against the whole relative path instead of just the name. */
+	bool match_path;
+};
+
+#define MAX_IGNORE_RULES 256
+
+static Ignore_Rule ignore_rules[MAX_IGNORE_RULES];
+static u32 num_ignore_rules = 0;
+
+/** Files added since the main loop was last woken. */
+static usize files_since_wake = 0;
+
+CH_FORCEINLINE u8 to_lower(u8 c) {
+	return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+/** Letters and digits get a bit each, everything else shares what's left. Expects lower cased c. */
+CH_FORCEINLINE u64 get_char_bit(u8 c) {
+	if (c >= 'a' && c <= 'z') return 1ull << (c - 'a');
+	if (c >= '0' && c <= '9') return 1ull << (26 + c - '0');
+	return 1ull << (36 + c % 28);
+}
+
+CH_FORCEINLINE Project_File& get_project_file(u64 index) {
+	return file_chunks[index / project_files_per_chunk]->files[index % project_files_per_chunk];
+}
+
+CH_FORCEINLINE u64& get_project_file_mask(u64 index) {
+	return file_chunks[index / project_files_per_chunk]->masks[index % project_files_per_chunk];
+}
+
+/** Must be called with project_files_lock held if there are free_string_pages. */
+static char* push_string(usize size, u32* out_page) {
+	if (!string_pages.count || string_pages[current_string_page].used + size > string_pages[current_string_page].size) {
+		// The current page is left to be freed by its last file, and can't be that file's page anymore once it's moved on from
+		const u32 old_page = current_string_page;
+
+		bool found = false;
+		for (usize i = 0; i < free_string_pages.count; i += 1) {
+			if (string_pages[free_string_pages[i]].size < size) continue;
+
+			current_string_page = free_string_pages[i];
+			free_string_pages.remove(i);
+			found = true;
+			break;
+		}
+
+		if (!found) {
+			Project_String_Page page;
+			page.size = size > project_string_page_size ? size : project_string_page_size;
+			page.data = ch_new u8[page.size];
+			string_pages.push(page);
+			current_string_page = (u32)(string_pages.count - 1);
+		}
+		string_pages[current_string_page].used = 0;
+		string_pages[current_string_page].live = 0;
+
+		if (string_pages.count > 1 && old_page != current_string_page && !string_pages[old_page].live) free_string_pages.push(old_page);
+	}
+
+	Project_String_Page& page = string_pages[current_string_page];
+	char* const result = (char*)(page.data + page.used);
+	page.used += size;
+	page.live += size;
+	*out_page = current_string_page;
+	return result;
+}
+
+/** '*' matches anything but '/', '**' matches anything at all and '?' matches any one character but '/'. */
+static bool match_wildcard(const char* pattern, const char* text) {
+	while (*pattern) {
+		if (*pattern == '*') {
+			const bool any_depth = pattern[1] == '*';
+			pattern += any_depth ? 2 : 1;
+
+			for (const char* t = text;; t += 1) {
+				if (match_wildcard(pattern, t)) return true;
+				if (!*t || (!any_depth && *t == '/')) return false;
+			}
+		}
+
+		if (!*text || (*text == '/' && *pattern != '/')) return false;
+		if (*pattern != '?' && *pattern != *text) return false;
+
+		pattern += 1;
+		text += 1;
+	}
+	return !*text;
+}
+
+static bool is_ignored(const char* path, const char* name, bool is_directory) {
+	for (u32 i = 0; i < num_ignore_rules; i += 1) {
+		const Ignore_Rule& rule = ignore_rules[i];
+		if (rule.directory_only && !is_directory) continue;
+
+		if (match_wildcard(rule.pattern, rule.match_path ? path : name)) return true;
+	}
+	return false;
+}
+
+static void add_ignore_rule(const char* pattern, usize size) {
+	if (num_ignore_rules == MAX_IGNORE_RULES) return;
+
+	Ignore_Rule& rule = ignore_rules[num_ignore_rules];
+	rule.directory_only = false;
+	rule.match_path = false;
+
+	if (size && pattern[size - 1] == '/') {
+		rule.directory_only = true;
+		size -= 1;
+	}
+
+	// "**/name" matches name at any depth, which is what a plain name does anyway
+	if (size > 3 && memcmp(pattern, "**/", 3) == 0) {
+		pattern += 3;
+		size -= 3;
+	}
+
+	if (size && pattern[0] == '/') {
+		rule.match_path = true;
+		pattern += 1;
+		size -= 1;
+	}
+	for (usize i = 0; i < size; i += 1) {
+		if (pattern[i] == '/') rule.match_path = true;
+	}
+
+	if (!size || size >= sizeof(rule.pattern)) return;
+	memcpy(rule.pattern, pattern, size);
+	rule.pattern[size] = 0;
+	num_ignore_rules += 1;
+}
+
+static void load_ignore_rules() {
+	// Dot directories are version control and tool caches. Our own sidecars are never worth opening
+	add_ignore_rule(".*/", 3);
+	add_ignore_rule("*.eden-*", 8);
+
+	char path[sizeof(project_root) + 16];
+	snprintf(path, sizeof(path), "%s/.gitignore", project_root);
+
+	Mapped_File file;
+	if (!map_file(path, &file)) return;
+	defer(unmap_file(&file));
+
+	usize line_start = 0;
+	while (line_start < file.size) {
+		usize line_end = line_start;
+		while (line_end < file.size && file.data[line_end] != '\n') line_end += 1;
+		const usize next_line = line_end + 1;
+
+		while (line_start < line_end && (file.data[line_start] == ' ' || file.data[line_start] == '\t')) line_start += 1;
+		while (line_end > line_start && (file.data[line_end - 1] == ' ' || file.data[line_end - 1] == '\t' || file.data[line_end - 1] == '\r')) line_end -= 1;
+
+		const char first = line_start < line_end ? (char)file.data[line_start] : '#';
+		if (first != '#' && first != '!') add_ignore_rule((const char*)file.data + line_start, line_end - line_start);
+
+		line_start = next_line;
+	}
+}
+
+static void get_project_path(const char* path, char* out_path, usize out_size) {
+	if (path[0]) {
+		snprintf(out_path, out_size, "%s/%s", project_root, path);
+	} else {
+		snprintf(out_path, out_size, "%s", project_root);
+	}
+}
+
+/** Joins a directory's relative path and a name in it. */
+static void join_path(const char* directory, const char* name, char* out_path, usize out_size) {
+	snprintf(out_path, out_size, "%s%s%s", directory, directory[0] ? "/" : "", name);
+}
+
+static void add_file(u32 directory_index, const char* name) {
+	// Anything removed gets reused first, so files that come and go don't grow the index
+	const bool reuse = free_files.count || free_string_pages.count;
+	if (reuse) project_files_lock.lock();
+	defer(if (reuse) project_files_lock.unlock());
+
+	u64 index = (u64)num_project_files;
+	if (free_files.count) {
+		index = free_files[free_files.count - 1];
+		free_files.count -= 1;
+	} else if (index == project_files_per_chunk * max_project_chunks) {
+		return;
+	}
+
+	Project_Directory& directory = directories[directory_index];
+	const usize dir_len = strlen(directory.path);
+	const usize name_len = strlen(name);
+	const usize name_start = dir_len ? dir_len + 1 : 0;
+	const usize path_len = name_start + name_len;
+
+	u32 string_page;
+	char* const path = push_string((path_len + 1) * 2, &string_page);
+	if (dir_len) {
+		memcpy(path, directory.path, dir_len);
+		path[dir_len] = '/';
+	}
+	memcpy(path + name_start, name, name_len + 1);
+
+	char* const lower = path + path_len + 1;
+	u64 mask = 0;
+	for (usize i = 0; i <= path_len; i += 1) {
+		lower[i] = (char)to_lower((u8)path[i]);
+		if (i < path_len) mask |= get_char_bit((u8)lower[i]);
+	}
+
+	const usize chunk = (usize)(index / project_files_per_chunk);
+	if (!file_chunks[chunk]) file_chunks[chunk] = ch_new Project_File_Chunk;
+
+	Project_File& file = get_project_file(index);
+	file.path = path;
+	file.lower = lower;
+	file.path_len = (u32)path_len;
+	file.name_start = (u32)name_start;
+	file.string_page = string_page;
+	get_project_file_mask(index) = mask;
+
+	directory.files.push((u32)index);
+	if (index == (u64)num_project_files) atomic_store(&num_project_files, (s32)(index + 1));
+	files_since_wake += 1;
+}
+
+static void remove_file(u32 index) {
+	// A zero mask is never matched, the slot is dead from here on
+	get_project_file_mask(index) = 0;
+	free_files.push(index);
+
+	const Project_File& file = get_project_file(index);
+	Project_String_Page& page = string_pages[file.string_page];
+	page.live -= (file.path_len + 1) * 2;
+	if (!page.live && file.string_page != current_string_page) free_string_pages.push(file.string_page);
+}
+
+static u32 add_directory(const char* path) {
+	Project_Directory directory;
+	directory.removed = false;
+	directory.files.allocator = ch::get_heap_allocator();
+	directory.children.allocator = ch::get_heap_allocator();
+
+	const usize path_len = strlen(path);
+	directory.path = ch_new char[path_len + 1];
+	memcpy(directory.path, path, path_len + 1);
+
+	directories.push(directory);
+	return (u32)(directories.count - 1);
+}
+
+static void remove_directory_tree(u32 directory_index) {
+	ch::Array<u32> stack;
+	stack.allocator = ch::get_heap_allocator();
+	defer(stack.free());
+	stack.push(directory_index);
+
+	while (stack.count) {
+		const u32 index = stack[stack.count - 1];
+		stack.count -= 1;
+
+		Project_Directory& directory = directories[index];
+		if (directory.removed) continue;
+
+		for (usize i = 0; i < directory.files.count; i += 1) {
+			remove_file(directory.files[i]);
+		}
+		for (usize i = 0; i < directory.children.count; i += 1) {
+			stack.push(directory.children[i]);
+		}
+
+		directory.removed = true;
+		directory.files.free();
+		directory.children.free();
+	}
+}
+
+struct Directory_Listing {
+	ch::Array<char*> files;
+	ch::Array<char*> directories;
+};
+
+static void add_listing_entry(const char* name, bool is_directory, void* data) {
+	Directory_Listing* const listing = (Directory_Listing*)data;
+
+	const usize name_len = strlen(name);
+	char* const copy = ch_new char[name_len + 1];
+	memcpy(copy, name, name_len + 1);
+
+	if (is_directory) {
+		listing->directories.push(copy);
+	} else {
+		listing->files.push(copy);
+	}
+}
+
+static void free_listing(Directory_Listing* listing) {
+	for (usize i = 0; i < listing->files.count; i += 1) ch_delete[] listing->files[i];
+	for (usize i = 0; i < listing->directories.count; i += 1) ch_delete[] listing->directories[i];
+	listing->files.free();
+	listing->directories.free();
+}
+
+static int compare_names(const void* a, const void* b) {
+	return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+/** @returns the index of name in the sorted names, or -1 */
+static s64 find_name(char* const* names, usize count, const char* name) {
+	char* const* const found = (char* const*)bsearch(&name, names, count, sizeof(char*), compare_names);
+	return found ? found - names : -1;
+}
+
+static const char* get_path_name(const char* path) {
+	const char* result = path;
+	for (const char* c = path; *c; c += 1) {
+		if (*c == '/') result = c + 1;
+	}
+	return result;
+}
+
+/**
+ * Lists the directory again and brings its files and subdirectories up to date. New subdirectories are pushed onto
+ * crawl to be listed in turn, existing ones too if recursive.
+ */
+static void rescan_directory(u32 directory_index, bool recursive, ch::Array<u32>* crawl) {
+	if (directories[directory_index].removed) return;
+
+	char absolute_path[2048];
+	get_project_path(directories[directory_index].path, absolute_path, sizeof(absolute_path));
+
+	Directory_Listing listing;
+	listing.files.allocator = ch::get_heap_allocator();
+	listing.directories.allocator = ch::get_heap_allocator();
+	defer(free_listing(&listing));
+
+	if (!list_directory(absolute_path, add_listing_entry, &listing)) {
+		// Gone, its parent is going to notice too
+		if (directory_index) remove_directory_tree(directory_index);
+		return;
+	}
+
+	qsort(listing.files.begin(), listing.files.count, sizeof(char*), compare_names);
+	qsort(listing.directories.begin(), listing.directories.count, sizeof(char*), compare_names);
+
+	// Anything still listed is crossed off, what's left over afterwards is new
+	{
+		Project_Directory& directory = directories[directory_index];
+		for (usize i = 0; i < directory.files.count; i += 1) {
+			const Project_File& file = get_project_file(directory.files[i]);
+			const s64 found = find_name(listing.files.begin(), listing.files.count, file.path + file.name_start);
+			if (found >= 0) {
+				ch_delete[] listing.files[found];
+				listing.files[found] = nullptr;
+				continue;
+			}
+
+			remove_file(directory.files[i]);
+			directory.files.remove(i);
+			i -= 1;
+		}
+
+		for (usize i = 0; i < directory.children.count; i += 1) {
+			const u32 child = directory.children[i];
+			const s64 found = find_name(listing.directories.begin(), listing.directories.count, get_path_name(directories[child].path));
+			if (found >= 0) {
+				ch_delete[] listing.directories[found];
+				listing.directories[found] = nullptr;
+				if (recursive) crawl->push(child);
+				continue;
+			}
+
+			remove_directory_tree(child);
+			directory.children.remove(i);
+			i -= 1;
+		}
+	}
+
+	// Crossed off names were set to null above, so these loops can't use find_name anymore
+	for (usize i = 0; i < listing.files.count; i += 1) {
+		const char* const name = listing.files[i];
+		if (!name) continue;
+
+		char path[2048];
+		join_path(directories[directory_index].path, name, path, sizeof(path));
+		if (is_ignored(path, name, false)) continue;
+		add_file(directory_index, name);
+	}
+
+	for (usize i = 0; i < listing.directories.count; i += 1) {
+		const char* const name = listing.directories[i];
+		if (!name) continue;
+
+		char path[2048];
+		join_path(directories[directory_index].path, name, path, sizeof(path));
+		if (is_ignored(path, name, true)) continue;
+
+		// May move directories, so nothing holds a reference into it across this
+		const u32 child = add_directory(path);
+		directories[directory_index].children.push(child);
+		crawl->push(child);
+	}
+}
+
+static void crawl_project(u32 directory_index, bool recursive, Tree_Watcher* watcher) {
+	ch::Array<u32> crawl;
+	crawl.allocator = ch::get_heap_allocator();
+	defer(crawl.free());
+
+	const u32 first_new_directory = (u32)directories.count;
+	rescan_directory(directory_index, recursive, &crawl);
+
+	while (crawl.count) {
+		const u32 index = crawl[crawl.count - 1];
+		crawl.count -= 1;
+
+		// Watched before it's listed so nothing created in between is missed
+		if (watcher && index >= first_new_directory) {
+			char absolute_path[2048];
+			get_project_path(directories[index].path, absolute_path, sizeof(absolute_path));
+			watch_tree_directory(watcher, absolute_path);
+		}
+
+		rescan_directory(index, recursive, &crawl);
+
+		// Let an open picker see the files as they come in, without waking it for every one
+		if (files_since_wake >= 64 * 1024) {
+			atomic_add(&project_version, 1);
+			post_wake_event(project_window);
+			files_since_wake = 0;
+		}
+	}
+
+	atomic_add(&project_version, 1);
+	post_wake_event(project_window);
+	files_since_wake = 0;
+}
+
+static void on_tree_changed(const char* absolute_path, bool recursive, void* data) {
+	Tree_Watcher* const watcher = (Tree_Watcher*)data;
+
+	// Watched paths are always under the root
+	const usize root_len = strlen(project_root);
+	const char* relative_path = absolute_path + root_len;
+	if (*relative_path == '/' || *relative_path == '\\') relative_path += 1;
+
+	for (usize i = 0; i < directories.count; i += 1) {
+		const Project_Directory& directory = directories[i];
+		if (directory.removed || strcmp(directory.path, relative_path) != 0) continue;
+
+		crawl_project((u32)i, recursive, watcher);
+		return;
+	}
+}
+
+static void project_proc(void* param) {
+	load_ignore_rules();
+
+	// Watching starts first so changes made during the crawl still come through afterwards
+	Tree_Watcher* const watcher = watch_tree(project_root);
+
+	const u32 root = add_directory("");
+	crawl_project(root, true, watcher);
+
+	if (!watcher) return;
+	while (wait_for_tree_changes(watcher, on_tree_changed, watcher)) {}
+}
+
+void init_project(const char* root, void* window) {
+	usize root_len = strlen(root);
+	if (root_len >= sizeof(project_root)) return;
+
+	while (root_len > 1 && (root[root_len - 1] == '/' || root[root_len - 1] == '\\')) root_len -= 1;
+	memcpy(project_root, root, root_len);
+	project_root[root_len] = 0;
+	project_window = window;
+
+	directories.allocator = ch::get_heap_allocator();
+	string_pages.allocator = ch::get_heap_allocator();
+	free_string_pages.allocator = ch::get_heap_allocator();
+	free_files.allocator = ch::get_heap_allocator();
+
+	Thread thread;
+	create_thread(project_proc, nullptr, &thread);
+}
+
+const char* get_project_root() {
+	return project_root;
+}
+
+u32 get_project_version() {
+	return (u32)atomic_load(&project_version);
+}
+
+/* MATCHING */
+
+CH_FORCEINLINE bool is_word_start(const char* path, u32 i) {
+	if (!i) return true;
+
+	const char prev = path[i - 1];
+	if (prev == '/' || prev == '_' || prev == '-' || prev == '.' || prev == ' ') return true;
+
+	// camelCase
+	return path[i] >= 'A' && path[i] <= 'Z' && prev >= 'a' && prev <= 'z';
+}
+
+/**
+ * Matches query left to right against lower from start, taking the first occurrence of each character.
+ *
+ * @returns false if query isn't a subsequence of lower from start
+ */
+static bool score_subsequence(const Project_File& file, u32 start, const char* query, usize query_len, s32* out_score) {
+	s32 score = 0;
+	u32 at = start;
+	u32 last = 0;
+	for (usize i = 0; i < query_len; i += 1) {
+		// memchr does the scanning a vector at a time
+		const char* const found = (const char*)memchr(file.lower + at, query[i], file.path_len - at);
+		if (!found) return false;
+
+		const u32 index = (u32)(found - file.lower);
+		if (is_word_start(file.path, index)) score += 8;
+		if (index >= file.name_start) score += 2;
+
+		if (i && index == last + 1) {
+			score += 6;
+		} else if (i) {
+			const u32 gap = index - last - 1;
+			score -= gap < 8 ? (s32)gap : 8;
+		}
+
+		last = index;
+		at = index + 1;
+	}
+
+	*out_score = score;
+	return true;
+}
+
+static bool score_file(const Project_File& file, const char* query, usize query_len, s32* out_score) {
+	// Short paths win ties, they're usually what was meant
+	const s32 length_penalty = (s32)(file.path_len / 16);
+
+	// The whole query inside the file name is about as good as it gets
+	s32 score;
+	if (score_subsequence(file, file.name_start, query, query_len, &score)) {
+		*out_score = score + 32 - length_penalty;
+		return true;
+	}
+
+	if (!score_subsequence(file, 0, query, query_len, &score)) return false;
+	*out_score = score - length_penalty;
+	return true;
+}
+
+CH_FORCEINLINE bool is_better_match(const Project_Match& a, const Project_Match& b) {
+	if (a.score != b.score) return a.score > b.score;
+	return a.path_len < b.path_len;
+}
+
+/** Keeps matches sorted best first, dropping whatever falls off the end. */
+static void insert_match(Project_Match* matches, usize* num_matches, usize max, const Project_Match& match) {
+	if (*num_matches == max && !is_better_match(match, matches[max - 1])) return;
+
+	usize i = *num_matches < max ? *num_matches : max - 1;
+	if (*num_matches < max) *num_matches += 1;
+
+	while (i > 0 && is_better_match(match, matches[i - 1])) {
+		matches[i] = matches[i - 1];
+		i -= 1;
+	}
+	matches[i] = match;
+}
+
+/** Shared by everyone working on a query. Freed by whoever lets go of it last, late workers may still be on their way to it. */
+struct Project_Query {
+	char query[256];
+	usize query_len;
+	u64 query_mask;
+	usize max;
+
+	u64 num_files;
+	s32 num_ranges;
+	volatile s32 next_range;
+	volatile s32 ranges_done;
+	volatile s32 ref_count;
+
+	/** Signaled once by whoever finishes the last range. */
+	Semaphore done;
+
+	Mutex lock;
+	Project_Match matches[max_project_matches];
+	usize num_matches;
+};
+
+static void match_range(const Project_Query* query, u64 first, u64 end, Project_Match* matches, usize* num_matches) {
+	const u64* const masks = &get_project_file_mask(first);
+	const usize count = (usize)(end - first);
+	const u64 query_mask = query->query_mask;
+
+	usize i = 0;
+#if PROJECT_SSE2
+	// Most paths are missing some character of the query. Two masks at a time rules them out before anything reads a path
+	const __m128i wanted = _mm_set1_epi64x((s64)query_mask);
+	for (; i + 2 <= count; i += 2) {
+		const __m128i v = _mm_loadu_si128((const __m128i*)(masks + i));
+		const __m128i missing = _mm_xor_si128(_mm_and_si128(v, wanted), wanted);
+		const int has_all = _mm_movemask_epi8(_mm_cmpeq_epi32(missing, _mm_setzero_si128()));
+		if (!has_all) continue;
+
+		for (usize j = 0; j < 2; j += 1) {
+			// Both 32 bit halves of the mask have to have had nothing missing
+			if (((has_all >> (j * 8)) & 0xFF) != 0xFF) continue;
+
+			s32 score;
+			const Project_File& file = get_project_file(first + i + j);
+			if (score_file(file, query->query, query->query_len, &score)) insert_match(matches, num_matches, query->max, { file.path, file.path_len, score });
+		}
+	}
+#endif
+
+	for (; i < count; i += 1) {
+		if ((masks[i] & query_mask) != query_mask) continue;
+
+		s32 score;
+		const Project_File& file = get_project_file(first + i);
+		if (score_file(file, query->query, query->query_len, &score)) insert_match(matches, num_matches, query->max, { file.path, file.path_len, score });
+	}
+}
+
+static void unref_project_query(Project_Query* query) {
+	if (!atomic_add(&query->ref_count, -1)) ch_delete query;
+}
+
+static void run_project_query(Project_Query* query) {
+	for (;;) {
+		const s32 range = atomic_add(&query->next_range, 1) - 1;
+		if (range >= query->num_ranges) break;
+
+		const u64 first = (u64)range * project_query_range_size;
+		const u64 end = first + project_query_range_size < query->num_files ? first + project_query_range_size : query->num_files;
+
+		Project_Match matches[max_project_matches];
+		usize num_matches = 0;
+		match_range(query, first, end, matches, &num_matches);
+
+		query->lock.lock();
+		for (usize i = 0; i < num_matches; i += 1) {
+			insert_match(query->matches, &query->num_matches, query->max, matches[i]);
+		}
+		query->lock.unlock();
+
+		if (atomic_add(&query->ranges_done, 1) == query->num_ranges) query->done.signal();
+	}
+}
+
+static void project_query_job(void* data) {
+	Project_Query* const query = (Project_Query*)data;
+	run_project_query(query);
+	unref_project_query(query);
+}
+
+usize find_project_files(const char* query, Project_Match* out, usize max) {
+	if (max > max_project_matches) max = max_project_matches;
+	if (!max) return 0;
+
+	const u64 num_files = (u64)atomic_load(&num_project_files);
+
+	usize query_len = 0;
+	char lower_query[256];
+	u64 query_mask = 0;
+	for (const char* c = query; *c && query_len + 1 < sizeof(lower_query); c += 1) {
+		if (*c == ' ') continue;
+
+		lower_query[query_len] = (char)to_lower((u8)*c);
+		query_mask |= get_char_bit((u8)lower_query[query_len]);
+		query_len += 1;
+	}
+	lower_query[query_len] = 0;
+
+	project_files_lock.lock();
+	defer(project_files_lock.unlock());
+
+	if (!query_len) {
+		usize result = 0;
+		for (u64 i = 0; i < num_files && result < max; i += 1) {
+			if (!get_project_file_mask(i)) continue;
+
+			const Project_File& file = get_project_file(i);
+			out[result] = { file.path, file.path_len, 0 };
+			result += 1;
+		}
+		return result;
+	}
+
+	const u32 num_workers = get_num_workers();
+
+	Project_Query* const shared = ch_new Project_Query;
+	memcpy(shared->query, lower_query, query_len + 1);
+	shared->query_len = query_len;
+	shared->query_mask = query_mask;
+	shared->max = max;
+	shared->num_files = num_files;
+	shared->num_ranges = (s32)((num_files + project_query_range_size - 1) / project_query_range_size);
+	shared->next_range = 0;
+	shared->ranges_done = 0;
+	shared->ref_count = (s32)num_workers + 1;
+	shared->num_matches = 0;
+
+	for (u32 i = 0; i < num_workers; i += 1) {
+		push_job(project_query_job, shared);
+	}
+
+	// Take ranges ourselves too. If the workers are busy with something else we just end up doing all of them
+	run_project_query(shared);
+
+	// Whatever's left is mid range on a worker. Sleep until it's merged rather than spin against it for a core
+	if (shared->num_ranges) shared->done.wait();
+
+	const usize result = shared->num_matches;
+	memcpy(out, shared->matches, result * sizeof(Project_Match));
+	unref_project_query(shared);
+
+	return result;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "os.h"
+
+/**
+ * Every file under the project root, kept in memory for finding files by name. The root is crawled on a thread of its
+ * own at startup and watched afterwards, only the directories that change are listed again.
+ *
+ * Directories starting with '.' are skipped, and so is anything matching a pattern in the root's .gitignore.
+ * Negated patterns aren't supported.
+ */
+void init_project(const char* root, void* window);
+
+/** @returns the absolute path of the root, without a slash on the end */
+const char* get_project_root();
+
+/** Bumped whenever files are added to or removed from the index. */
+u32 get_project_version();
+
+const usize max_project_matches = 64;
+
+struct Project_Match {
+	/**
+	 * Relative to the root and '/' separated. Always safe to read, but once get_project_version has moved on
+	 * the file may have been removed and its memory given to another path.
+	 */
+	const char* path;
+	u32 path_len;
+	s32 score;
+};
+
+/**
+ * Fuzzy matches query against every indexed path. The characters of query have to appear in the path in order,
+ * ignoring case. Matches at the start of words, inside the file name and right after each other score higher.
+ * The work is spread across the job workers. An empty query lists files in the order they were found.
+ *
+ * @returns the number of matches written to out, best first, no more than max_project_matches
+ */
+usize find_project_files(const char* query, Project_Match* out, usize max);
@@ -0,0 +1,114 @@
+#include "prompt.h"
+
+#include <ch_stl/input.h>
+#include <string.h>
+
+struct Prompt {
+	const char* label = nullptr;
+	Prompt_Confirm_Func on_confirm = nullptr;
+	Prompt_Change_Func on_change = nullptr;
+	Prompt_Key_Func on_key = nullptr;
+
+	char text[256] = {};
+	usize count = 0;
+};
+
+static Prompt the_prompt;
+static bool prompt_active = false;
+static u32 prompt_version = 0;
+
+void begin_prompt(const char* label, Prompt_Confirm_Func on_confirm, Prompt_Change_Func on_change, Prompt_Key_Func on_key) {
+	the_prompt.label = label;
+	the_prompt.on_confirm = on_confirm;
+	the_prompt.on_change = on_change;
+	the_prompt.on_key = on_key;
+	the_prompt.text[0] = 0;
+	the_prompt.count = 0;
+	prompt_active = true;
+	prompt_version += 1;
+}
+
+void end_prompt() {
+	prompt_active = false;
+	prompt_version += 1;
+}
+
+bool is_prompt_active() {
+	return prompt_active;
+}
+
+bool is_prompt_active_for(Prompt_Confirm_Func on_confirm) {
+	return prompt_active && the_prompt.on_confirm == on_confirm;
+}
+
+bool prompt_on_key_pressed(u32 key) {
+	switch (key) {
+		case CH_KEY_ENTER: {
+			// The callback may well open another prompt, so it gets its own copy of the text
+			char text[sizeof(the_prompt.text)];
+			memcpy(text, the_prompt.text, the_prompt.count + 1);
+			const Prompt_Confirm_Func on_confirm = the_prompt.on_confirm;
+
+			end_prompt();
+			if (on_confirm) on_confirm(text);
+			return true;
+		}
+		case CH_KEY_ESCAPE:
+			end_prompt();
+			return true;
+		case CH_KEY_BACKSPACE:
+			// Back over a whole codepoint, continuation bytes are 10xxxxxx
+			while (the_prompt.count > 0) {
+				the_prompt.count -= 1;
+				if ((the_prompt.text[the_prompt.count] & 0xC0) != 0x80) break;
+			}
+			the_prompt.text[the_prompt.count] = 0;
+			prompt_version += 1;
+			if (the_prompt.on_change) the_prompt.on_change(the_prompt.text);
+			return true;
+	}
+	return the_prompt.on_key && the_prompt.on_key(key);
+}
+
+void prompt_on_char_entered(u32 c) {
+	// Enter, backspace and escape come through as keys
+	if (c < 32 || c == 127 || c > 0x10FFFF) return;
+
+	u8 encoded[4];
+	usize size = 0;
+	if (c < 0x80) {
+		encoded[size++] = (u8)c;
+	} else if (c < 0x800) {
+		encoded[size++] = (u8)(0xC0 | (c >> 6));
+		encoded[size++] = (u8)(0x80 | (c & 0x3F));
+	} else if (c < 0x10000) {
+		encoded[size++] = (u8)(0xE0 | (c >> 12));
+		encoded[size++] = (u8)(0x80 | ((c >> 6) & 0x3F));
+		encoded[size++] = (u8)(0x80 | (c & 0x3F));
+	} else {
+		encoded[size++] = (u8)(0xF0 | (c >> 18));
+		encoded[size++] = (u8)(0x80 | ((c >> 12) & 0x3F));
+		encoded[size++] = (u8)(0x80 | ((c >> 6) & 0x3F));
+		encoded[size++] = (u8)(0x80 | (c & 0x3F));
+	}
+
+	if (the_prompt.count + size >= sizeof(the_prompt.text)) return;
+
+	memcpy(the_prompt.text + the_prompt.count, encoded, size);
+	the_prompt.count += size;
+	the_prompt.text[the_prompt.count] = 0;
+	prompt_version += 1;
+	if (the_prompt.on_change) the_prompt.on_change(the_prompt.text);
+}
+
+const char* get_prompt_label() {
+	return the_prompt.label ? the_prompt.label : "";
+}
+
+const char* get_prompt_text() {
+	return the_prompt.text;
+}
+
+u32 get_prompt_version() {
+	return prompt_version;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <ch_stl/types.h>
+
+/**
+ * A line of text input drawn over the focused view's powerline. While it's up it gets all typing,
+ * enter confirms it and escape throws it away.
+ */
+using Prompt_Confirm_Func = void (*)(const char* text);
+
+/** Called with the new text whenever it's typed into. */
+using Prompt_Change_Func = void (*)(const char* text);
+
+/** Gets keys the prompt doesn't use itself. @returns true if it used key */
+using Prompt_Key_Func = bool (*)(u32 key);
+
+/** Opens the prompt, replacing any that was already up. */
+void begin_prompt(const char* label, Prompt_Confirm_Func on_confirm, Prompt_Change_Func on_change = nullptr, Prompt_Key_Func on_key = nullptr);
+void end_prompt();
+
+bool is_prompt_active();
+
+/** @returns true if the prompt is up and was opened with on_confirm */
+bool is_prompt_active_for(Prompt_Confirm_Func on_confirm);
+
+/** @returns true if the prompt used key and it shouldn't go to any action bound to it */
+bool prompt_on_key_pressed(u32 key);
+void prompt_on_char_entered(u32 c);
+
+const char* get_prompt_label();
+const char* get_prompt_text();
+
+/** Bumped on every change so views know to draw it again. */
+u32 get_prompt_version();
@@ -0,0 +1,425 @@
+#include "search.h"
+
+#include "buffer_view.h"
+#include "prompt.h"
+
+#include <ch_stl/input.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#define SEARCH_SSE2 1
+#include <emmintrin.h>
+#else
+#define SEARCH_SSE2 0
+#endif
+
+#if CH_PLATFORM_WINDOWS
+#include <intrin.h>
+#endif
+
+struct Search {
+	Buffer_ID the_buffer = invalid_buffer_id;
+
+	u8 needle[max_search_needle_size];
+	usize needle_size = 0;
+
+	/** Where every match starts, sorted. */
+	ch::Array<usize> matches;
+	/** Hit max_search_matches, there are more after the last one. */
+	bool is_truncated = false;
+
+	/** The buffer's version the matches were last brought up to. */
+	u64 buffer_version = 0;
+
+	/** Bytes changed by edits that haven't been searched again yet. Only valid if has_dirty. */
+	bool has_dirty = false;
+	usize dirty_start = 0;
+	usize dirty_end = 0;
+
+	/** Where the cursor was when the prompt opened. Typing finds the first match from here. */
+	usize origin = 0;
+
+	/** The prompt was confirmed, the matches stay highlighted until end_search. */
+	bool is_confirmed = false;
+};
+
+static Search the_search;
+static u32 search_version = 0;
+
+/** Shown on the prompt, updated with the match count. */
+static char search_label[64] = "Find: ";
+
+/** Matches found for a range before they're spliced into the list. */
+static ch::Array<usize> found_matches;
+
+static u32 count_trailing_zeros(u32 x) {
+#if CH_PLATFORM_WINDOWS
+	unsigned long result;
+	_BitScanForward(&result, x);
+	return (u32)result;
+#else
+	return (u32)__builtin_ctz(x);
+#endif
+}
+
+/**
+ * Finds everywhere needle starts in data, overlapping ones included. Blocks of 16 places are tested at once against
+ * needle's first and last bytes, only places where both match have the bytes in between compared.
+ *
+ * @param base is added to every offset written to out
+ * @returns false if it stopped because out reached max_search_matches
+ */
+static bool find_in_span(const u8* data, usize size, const u8* needle, usize needle_size, usize base, ch::Array<usize>* out) {
+	if (size < needle_size) return true;
+
+	// Every place a match can start is in [0, num_starts)
+	const usize num_starts = size - needle_size + 1;
+	const usize last = needle_size - 1;
+	usize i = 0;
+
+#if SEARCH_SSE2
+	const __m128i first_byte = _mm_set1_epi8((char)needle[0]);
+	const __m128i last_byte = _mm_set1_epi8((char)needle[last]);
+
+	// Two blocks a step so the loads and compares of one overlap the other's movemask
+	for (; i + 32 <= num_starts; i += 32) {
+		const __m128i first_a = _mm_loadu_si128((const __m128i*)(data + i));
+		const __m128i first_b = _mm_loadu_si128((const __m128i*)(data + i + 16));
+		const __m128i last_a = _mm_loadu_si128((const __m128i*)(data + i + last));
+		const __m128i last_b = _mm_loadu_si128((const __m128i*)(data + i + last + 16));
+
+		const __m128i hits_a = _mm_and_si128(_mm_cmpeq_epi8(first_a, first_byte), _mm_cmpeq_epi8(last_a, last_byte));
+		const __m128i hits_b = _mm_and_si128(_mm_cmpeq_epi8(first_b, first_byte), _mm_cmpeq_epi8(last_b, last_byte));
+		u32 mask = (u32)_mm_movemask_epi8(hits_a) | ((u32)_mm_movemask_epi8(hits_b) << 16);
+
+		while (mask) {
+			const usize start = i + count_trailing_zeros(mask);
+			mask &= mask - 1;
+
+			if (needle_size > 2 && memcmp(data + start + 1, needle + 1, needle_size - 2) != 0) continue;
+			if (out->count >= max_search_matches) return false;
+			out->push(base + start);
+		}
+	}
+#endif
+
+	for (; i < num_starts; i += 1) {
+		if (data[i] != needle[0] || data[i + last] != needle[last]) continue;
+		if (needle_size > 2 && memcmp(data + i + 1, needle + 1, needle_size - 2) != 0) continue;
+		if (out->count >= max_search_matches) return false;
+		out->push(base + i);
+	}
+
+	return true;
+}
+
+/**
+ * Finds every match lying entirely within [start, end) of gap_buffer, in order. Both sides of the gap are searched
+ * where they are. The few bytes either side of it are copied together to catch the matches it splits.
+ *
+ * @returns false if it stopped because out reached max_search_matches
+ */
+static bool find_in_range(const ch::Gap_Buffer<u8>& gap_buffer, usize start, usize end, const u8* needle, usize needle_size, ch::Array<usize>* out) {
+	const usize gap_index = (usize)(gap_buffer.gap - gap_buffer.data);
+	const u8* const after_gap = gap_buffer.gap + gap_buffer.gap_size;
+
+	if (start < gap_index) {
+		const usize span_end = end < gap_index ? end : gap_index;
+		if (!find_in_span(gap_buffer.data + start, span_end - start, needle, needle_size, start, out)) return false;
+	}
+
+	if (needle_size > 1 && start < gap_index && end > gap_index) {
+		const usize overlap = needle_size - 1;
+		const usize joined_start = gap_index - start > overlap ? gap_index - overlap : start;
+		const usize joined_end = end - gap_index > overlap ? gap_index + overlap : end;
+
+		u8 joined[max_search_needle_size * 2];
+		memcpy(joined, gap_buffer.data + joined_start, gap_index - joined_start);
+		memcpy(joined + (gap_index - joined_start), after_gap, joined_end - gap_index);
+
+		// Only the bytes either side of the gap went in, so anything found here straddles it
+		if (!find_in_span(joined, joined_end - joined_start, needle, needle_size, joined_start, out)) return false;
+	}
+
+	if (end > gap_index) {
+		const usize span_start = start > gap_index ? start : gap_index;
+		if (!find_in_span(after_gap + (span_start - gap_index), end - span_start, needle, needle_size, span_start, out)) return false;
+	}
+
+	return true;
+}
+
+/** @returns the index of the first match starting at or after offset */
+static usize find_first_match_from(usize offset) {
+	usize lo = 0;
+	usize hi = the_search.matches.count;
+	while (lo < hi) {
+		const usize mid = lo + (hi - lo) / 2;
+		if (the_search.matches[mid] < offset) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+static void update_search_label() {
+	const usize num_matches = the_search.matches.count;
+	if (!the_search.needle_size) {
+		snprintf(search_label, sizeof(search_label), "Find: ");
+		return;
+	}
+	if (!num_matches) {
+		snprintf(search_label, sizeof(search_label), "Find (no matches): ");
+		return;
+	}
+
+	// Numbered by the first match from the cursor, which is the selected one after a jump
+	usize current = 0;
+	const Buffer_View* const view = get_focused_view();
+	if (view && view->the_buffer == the_search.the_buffer) {
+		current = find_first_match_from(view->cursor < view->selection ? view->cursor : view->selection);
+		if (current == num_matches) current = 0;
+	}
+
+	snprintf(search_label, sizeof(search_label), "Find (%llu of %llu%s): ", (unsigned long long)current + 1, (unsigned long long)num_matches, the_search.is_truncated ? "+" : "");
+}
+
+/** Searches all of the buffer again. */
+static void find_all_matches(const Buffer* buffer) {
+	the_search.matches.count = 0;
+	the_search.is_truncated = false;
+	if (the_search.needle_size) {
+		const usize count = buffer->gap_buffer.count();
+		the_search.is_truncated = !find_in_range(buffer->gap_buffer, 0, count, the_search.needle, the_search.needle_size, &the_search.matches);
+	}
+
+	the_search.has_dirty = false;
+	the_search.buffer_version = buffer->version;
+	search_version += 1;
+}
+
+/** Replaces the matches lying within [start, end) with what's there now. */
+static void find_matches_in_range(const Buffer* buffer, usize start, usize end) {
+	const usize count = buffer->gap_buffer.count();
+	if (end > count) end = count;
+	if (start > end) start = end;
+
+	ch::Array<usize>& matches = the_search.matches;
+	const usize needle_size = the_search.needle_size;
+
+	// Whatever was already found in range gets found again, so they all go
+	const usize first = find_first_match_from(start);
+	const usize last = end - start >= needle_size ? find_first_match_from(end - needle_size + 1) : first;
+
+	found_matches.count = 0;
+	find_in_range(buffer->gap_buffer, start, end, the_search.needle, needle_size, &found_matches);
+
+	const usize old_count = last - first;
+	const usize new_count = found_matches.count;
+	const usize tail_count = matches.count - last;
+	if (matches.count - old_count + new_count > max_search_matches) {
+		find_all_matches(buffer);
+		return;
+	}
+
+	if (new_count > old_count) {
+		for (usize i = old_count; i < new_count; i += 1) {
+			matches.push(0);
+		}
+	}
+	memmove(matches.begin() + first + new_count, matches.begin() + last, tail_count * sizeof(usize));
+	matches.count = first + new_count + tail_count;
+	if (new_count) memcpy(matches.begin() + first, found_matches.begin(), new_count * sizeof(usize));
+
+	search_version += 1;
+}
+
+static void select_match(usize index) {
+	Buffer_View* const view = get_focused_view();
+	if (!view || view->the_buffer != the_search.the_buffer || index >= the_search.matches.count) return;
+
+	const usize start = the_search.matches[index];
+	view->select_and_show(start, start + the_search.needle_size);
+	search_version += 1;
+}
+
+static void on_search_changed(const char* text) {
+	const usize size = strlen(text);
+	if (size > max_search_needle_size) return;
+
+	memcpy(the_search.needle, text, size);
+	the_search.needle_size = size;
+
+	Buffer* const buffer = find_buffer(the_search.the_buffer);
+	if (!buffer) return;
+	find_all_matches(buffer);
+
+	// Each keystroke starts over from where the prompt was opened, so backspacing walks back to earlier matches
+	if (the_search.matches.count) {
+		usize index = find_first_match_from(the_search.origin);
+		if (index == the_search.matches.count) index = 0;
+		select_match(index);
+	} else {
+		Buffer_View* const view = get_focused_view();
+		if (view && view->the_buffer == the_search.the_buffer) view->select_and_show(the_search.origin, the_search.origin);
+	}
+
+	update_search_label();
+}
+
+static bool on_search_key(u32 key) {
+	switch (key) {
+		case CH_KEY_UP:
+			jump_to_next_match(false);
+			return true;
+		case CH_KEY_DOWN:
+			jump_to_next_match(true);
+			return true;
+	}
+	return false;
+}
+
+static void on_search_confirmed(const char* text) {
+	// Still found and highlighted, F3 carries on through them
+	the_search.is_confirmed = the_search.needle_size > 0;
+	if (!the_search.is_confirmed) end_search();
+}
+
+void open_search() {
+	Buffer_View* const view = get_focused_view();
+	if (!view) return;
+
+	end_search();
+
+	the_search.the_buffer = view->the_buffer;
+	the_search.origin = view->cursor < view->selection ? view->cursor : view->selection;
+	the_search.matches.allocator = ch::get_heap_allocator();
+	found_matches.allocator = ch::get_heap_allocator();
+
+	update_search_label();
+	begin_prompt(search_label, on_search_confirmed, on_search_changed, on_search_key);
+}
+
+void end_search() {
+	if (the_search.the_buffer == invalid_buffer_id) return;
+
+	the_search.the_buffer = invalid_buffer_id;
+	the_search.needle_size = 0;
+	the_search.matches.free();
+	found_matches.free();
+	the_search.is_truncated = false;
+	the_search.has_dirty = false;
+	the_search.is_confirmed = false;
+	search_version += 1;
+}
+
+bool is_search_active() {
+	return the_search.the_buffer != invalid_buffer_id;
+}
+
+void jump_to_next_match(bool forward) {
+	const Buffer_View* const view = get_focused_view();
+	const usize num_matches = the_search.matches.count;
+	if (!view || view->the_buffer != the_search.the_buffer || !num_matches) return;
+
+	const usize selection_min = view->cursor < view->selection ? view->cursor : view->selection;
+
+	usize index;
+	if (forward) {
+		// A selected match is the current one, the next starts after it
+		index = find_first_match_from(view->has_selection() ? selection_min + 1 : selection_min);
+		if (index == num_matches) index = 0;
+	} else {
+		index = find_first_match_from(selection_min);
+		index = index ? index - 1 : num_matches - 1;
+	}
+
+	select_match(index);
+	update_search_label();
+}
+
+void tick_search() {
+	if (the_search.the_buffer == invalid_buffer_id) return;
+
+	// Escaped out of the prompt
+	if (!the_search.is_confirmed && !is_prompt_active_for(on_search_confirmed)) {
+		end_search();
+		return;
+	}
+
+	const Buffer* const buffer = find_buffer(the_search.the_buffer);
+	if (!buffer) {
+		end_search();
+		return;
+	}
+
+	if (buffer->version == the_search.buffer_version) return;
+
+	// A new version without any edits is either nothing, like the gutter redrawing, or a windowed buffer
+	// moving its window. Neither is worth telling apart, a window is small enough to search again as a whole
+	if (!the_search.needle_size) {
+		the_search.buffer_version = buffer->version;
+	} else if (the_search.has_dirty && !the_search.is_truncated) {
+		find_matches_in_range(buffer, the_search.dirty_start, the_search.dirty_end);
+		the_search.has_dirty = false;
+		the_search.buffer_version = buffer->version;
+	} else {
+		find_all_matches(buffer);
+	}
+
+	update_search_label();
+}
+
+/** Where index ends up after [offset, offset + removed) was replaced by inserted bytes. Indices in the removed bytes go to the end of the new ones. */
+static usize remap_search_index(usize index, usize offset, usize removed, usize inserted) {
+	if (index <= offset) return index;
+	if (index >= offset + removed) return index - removed + inserted;
+	return offset + inserted;
+}
+
+void on_search_buffer_edited(Buffer_ID the_buffer, usize offset, usize removed, usize inserted) {
+	if (the_buffer != the_search.the_buffer || !the_search.needle_size) return;
+
+	ch::Array<usize>& matches = the_search.matches;
+	const usize needle_size = the_search.needle_size;
+
+	// Matches ending before the edit are left alone, ones overlapping it are dropped and the rest shift along with it
+	const usize first = find_first_match_from(offset >= needle_size ? offset - needle_size + 1 : 0);
+	usize write = first;
+	for (usize i = first; i < matches.count; i += 1) {
+		if (matches[i] < offset + removed) continue;
+		matches[write] = matches[i] - removed + inserted;
+		write += 1;
+	}
+	matches.count = write;
+
+	// New matches can start up to a needle before the edit and end up to a needle after it
+	const usize start = offset >= needle_size - 1 ? offset - (needle_size - 1) : 0;
+	const usize end = offset + inserted + (needle_size - 1);
+	if (the_search.has_dirty) {
+		const usize dirty_start = remap_search_index(the_search.dirty_start, offset, removed, inserted);
+		const usize dirty_end = remap_search_index(the_search.dirty_end, offset, removed, inserted);
+		the_search.dirty_start = dirty_start < start ? dirty_start : start;
+		the_search.dirty_end = dirty_end > end ? dirty_end : end;
+	} else {
+		the_search.dirty_start = start;
+		the_search.dirty_end = end;
+		the_search.has_dirty = true;
+	}
+	search_version += 1;
+}
+
+usize get_search_matches(Buffer_ID the_buffer, const usize** out_matches, usize* out_match_size) {
+	if (the_buffer != the_search.the_buffer || !the_search.needle_size) return 0;
+
+	*out_matches = the_search.matches.begin();
+	*out_match_size = the_search.needle_size;
+	return the_search.matches.count;
+}
+
+u32 get_search_version() {
+	return search_version;
+}
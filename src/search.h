@@ -0,0 +1,44 @@
+#pragma once
+
+#include "buffer.h"
+
+/**
+ * Incremental search in one buffer at a time. Every match is kept in a sorted list of offsets, so views highlight the
+ * visible ones without searching while they draw. Edits drop and shift the matches they touched and only search again
+ * around where they landed.
+ *
+ * Matching is exact, case sensitive and finds overlapping matches. Windowed buffers are only searched within their window.
+ */
+
+/** Longest query that can be searched for, in bytes. */
+const usize max_search_needle_size = 256;
+
+/** Past this many the list stops growing, so a one letter query can't eat all our memory. */
+const usize max_search_matches = 1 << 22;
+
+/** Opens the find prompt on the focused view. Matches are found and jumped to as the query is typed. */
+void open_search();
+
+/** Drops the matches and stops highlighting them. */
+void end_search();
+
+/** @returns true while there's a query being searched for, whether or not the prompt is still up */
+bool is_search_active();
+
+/** Moves the focused view to the next match after its cursor, or the one before it. Wraps around the buffer. */
+void jump_to_next_match(bool forward);
+
+/** Searches again wherever the buffer changed since the last tick. Called once a frame. */
+void tick_search();
+
+/** Must be told about every change to a buffer's contents: [offset, offset + removed) was replaced by inserted bytes. */
+void on_search_buffer_edited(Buffer_ID the_buffer, usize offset, usize removed, usize inserted);
+
+/**
+ * @param out_matches is set to the offsets every match starts at, sorted
+ * @returns the number of matches in the_buffer, 0 if it isn't the one being searched
+ */
+usize get_search_matches(Buffer_ID the_buffer, const usize** out_matches, usize* out_match_size);
+
+/** Bumped whenever the matches change, so views know to draw them again. */
+u32 get_search_version();